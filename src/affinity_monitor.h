@@ -0,0 +1,287 @@
+
+#pragma once
+
+#ifndef _AFFINITY_MONITOR_H
+#define _AFFINITY_MONITOR_H
+
+#include <sys/resource.h>
+
+#include "test_suite.h"
+
+/*
+ * class AffinityMonitor - Counts CPU migrations and context switches of
+ *                         worker threads during a run
+ *
+ * GetThreadAffinity() only tells where a thread is at one moment. Here each
+ * worker calls Begin() before its work, Sample() every now and then while
+ * working, and End() when it finishes. Sample() only calls sched_getcpu()
+ * (which is served by the vDSO) every sample_interval calls, and otherwise
+ * decrements a counter in the thread's own cache line.
+ *
+ * A thread has an expected CPU if it is set with SetExpectedCoreList(), or
+ * if its affinity mask has exactly one CPU when Begin() is called (e.g. it
+ * is a pinned ThreadPool worker). Samples taken on any other CPU are
+ * counted as strays; a run with strays is flagged as violating affinity,
+ * since its per-core cache numbers are not trustworthy. Voluntary and
+ * involuntary context switches of the thread between Begin() and End()
+ * come from getrusage(RUSAGE_THREAD).
+ */
+class AffinityMonitor {
+ public:
+  // Expected CPU of threads that are not pinned
+  static constexpr int NO_CPU = -1;
+
+  /*
+   * class ThreadStat - What is known about one thread
+   */
+  class ThreadStat {
+   public:
+    int expected_cpu;
+    int first_cpu;
+    int last_cpu;
+
+    uint64_t sample_num;
+    uint64_t migration_num;
+    uint64_t stray_num;
+
+    uint64_t voluntary_switch_num;
+    uint64_t involuntary_switch_num;
+  };
+
+ private:
+  /*
+   * class ThreadState - Per-thread state only written by the owner
+   */
+  class ThreadState {
+   public:
+    ThreadStat stat;
+    uint64_t countdown;
+
+    // Context switch counters at Begin()
+    long start_nvcsw;
+    long start_nivcsw;
+  };
+
+  PaddedArray<ThreadState> state_list;
+  std::vector<int> expected_cpu_list;
+  uint64_t sample_interval;
+
+  /*
+   * GetPinnedCore() - Returns the only CPU the calling thread may run on,
+   *                   or NO_CPU if there are more
+   */
+  static int GetPinnedCore() {
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    int ret = pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if(ret != 0 || CPU_COUNT(&cpu_set) != 1) {
+      return NO_CPU;
+    }
+
+    for(int cpu = 0;cpu < CPU_SETSIZE;cpu++) {
+      if(CPU_ISSET(cpu, &cpu_set)) {
+        return cpu;
+      }
+    }
+
+    return NO_CPU;
+  }
+
+  /*
+   * TakeSample() - Records the CPU the calling thread is running on
+   */
+  void TakeSample(ThreadState *state_p) {
+    ThreadStat &stat = state_p->stat;
+    int cpu = sched_getcpu();
+
+    if(stat.sample_num == 0UL) {
+      stat.first_cpu = cpu;
+    } else if(cpu != stat.last_cpu) {
+      stat.migration_num++;
+    }
+
+    if(stat.expected_cpu != NO_CPU && cpu != stat.expected_cpu) {
+      stat.stray_num++;
+    }
+
+    stat.last_cpu = cpu;
+    stat.sample_num++;
+    state_p->countdown = sample_interval;
+
+    return;
+  }
+
+ public:
+
+  /*
+   * Constructor
+   */
+  AffinityMonitor(uint64_t thread_num, uint64_t p_sample_interval = 1024UL) :
+    state_list{thread_num},
+    expected_cpu_list{},
+    sample_interval{p_sample_interval} {
+    assert(sample_interval > 0UL);
+
+    return;
+  }
+
+  /*
+   * SetExpectedCoreList() - Sets the CPU each thread is assigned to
+   *
+   * This overrides the affinity mask of threads in the list
+   */
+  void SetExpectedCoreList(const std::vector<int> &core_list) {
+    expected_cpu_list = core_list;
+
+    return;
+  }
+
+  inline uint64_t GetThreadNum() const {
+    return state_list.GetCount();
+  }
+
+  /*
+   * Begin() - Resets the state of the calling thread and takes a sample
+   */
+  void Begin(uint64_t thread_id) {
+    ThreadState &state = state_list[thread_id];
+    state.stat = ThreadStat{};
+
+    if(thread_id < expected_cpu_list.size()) {
+      state.stat.expected_cpu = expected_cpu_list[thread_id];
+    } else {
+      state.stat.expected_cpu = GetPinnedCore();
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    state.start_nvcsw = usage.ru_nvcsw;
+    state.start_nivcsw = usage.ru_nivcsw;
+
+    TakeSample(&state);
+
+    return;
+  }
+
+  /*
+   * Sample() - Takes a sample every sample_interval calls
+   */
+  inline void Sample(uint64_t thread_id) {
+    ThreadState &state = state_list[thread_id];
+    if(--state.countdown == 0UL) {
+      TakeSample(&state);
+    }
+
+    return;
+  }
+
+  /*
+   * End() - Takes a final sample and reads context switches
+   */
+  void End(uint64_t thread_id) {
+    ThreadState &state = state_list[thread_id];
+    TakeSample(&state);
+
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    state.stat.voluntary_switch_num = usage.ru_nvcsw - state.start_nvcsw;
+    state.stat.involuntary_switch_num = usage.ru_nivcsw - state.start_nivcsw;
+
+    return;
+  }
+
+  /*
+   * GetThreadStat() - Returns the statistics of a thread after End()
+   */
+  inline const ThreadStat &GetThreadStat(uint64_t thread_id) const {
+    return state_list[thread_id].stat;
+  }
+
+  /*
+   * GetMigrationNum() - Returns migrations observed on all threads
+   */
+  uint64_t GetMigrationNum() const {
+    uint64_t total = 0UL;
+    for(uint64_t thread_id = 0;thread_id < GetThreadNum();thread_id++) {
+      total += GetThreadStat(thread_id).migration_num;
+    }
+
+    return total;
+  }
+
+  /*
+   * GetInvoluntarySwitchNum() - Returns involuntary context switches of all
+   *                             threads
+   */
+  uint64_t GetInvoluntarySwitchNum() const {
+    uint64_t total = 0UL;
+    for(uint64_t thread_id = 0;thread_id < GetThreadNum();thread_id++) {
+      total += GetThreadStat(thread_id).involuntary_switch_num;
+    }
+
+    return total;
+  }
+
+  /*
+   * HasViolation() - Returns whether any thread with an expected CPU was
+   *                  seen on another CPU
+   */
+  bool HasViolation() const {
+    for(uint64_t thread_id = 0;thread_id < GetThreadNum();thread_id++) {
+      if(GetThreadStat(thread_id).stray_num > 0UL) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  /*
+   * Print() - Prints per-thread statistics and whether the run is flagged
+   */
+  void Print() const {
+    for(uint64_t thread_id = 0;thread_id < GetThreadNum();thread_id++) {
+      const ThreadStat &stat = GetThreadStat(thread_id);
+      dbg_printf("Thread %lu: expected CPU %d; CPU %d -> %d; "
+                 "%lu samples; %lu migrations; %lu strays; "
+                 "context switches %lu voluntary %lu involuntary\n",
+                 thread_id,
+                 stat.expected_cpu,
+                 stat.first_cpu,
+                 stat.last_cpu,
+                 stat.sample_num,
+                 stat.migration_num,
+                 stat.stray_num,
+                 stat.voluntary_switch_num,
+                 stat.involuntary_switch_num);
+    }
+
+    if(HasViolation() == true) {
+      dbg_printf("WARNING: pinned threads ran on other CPUs; "
+                 "per-core results are not reliable\n");
+    }
+
+    return;
+  }
+};
+
+/*
+ * StartThreadsMonitored() - Runs StartThreads() with Begin() and End() of
+ *                           the monitor around fn(thread_id, args...)
+ *
+ * fn should call monitor_p->Sample(thread_id) in its loop
+ */
+template <typename Fn, typename... Args>
+void StartThreadsMonitored(AffinityMonitor *monitor_p,
+                           Fn &&fn,
+                           Args &&... args) {
+  StartThreads(monitor_p->GetThreadNum(), [&](uint64_t thread_id) {
+    monitor_p->Begin(thread_id);
+    fn(thread_id, args...);
+    monitor_p->End(thread_id);
+  });
+
+  return;
+}
+
+#endif
@@ -0,0 +1,1045 @@
+
+#pragma once
+
+#ifndef _BENCH_DRIVER_H
+#define _BENCH_DRIVER_H
+
+#include "test_suite.h"
+
+/*
+ * class ThroughputReport - Operations performed by each thread in a given
+ *                          interval
+ */
+class ThroughputReport {
+ private:
+  std::vector<uint64_t> op_count_list;
+  // Seconds
+  double interval;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  ThroughputReport(const std::vector<uint64_t> &p_op_count_list,
+                   double p_interval) :
+    op_count_list{p_op_count_list},
+    interval{p_interval} {
+    assert(op_count_list.size() > 0UL);
+
+    return;
+  }
+
+  inline const std::vector<uint64_t> &GetOpCountList() const {
+    return op_count_list;
+  }
+
+  inline uint64_t GetThreadNum() const {
+    return op_count_list.size();
+  }
+
+  /*
+   * GetInterval() - Returns the length of the measurement in seconds
+   */
+  inline double GetInterval() const {
+    return interval;
+  }
+
+  /*
+   * GetTotalOps() - Returns the number of operations of all threads
+   */
+  uint64_t GetTotalOps() const {
+    return std::accumulate(op_count_list.begin(),
+                           op_count_list.end(),
+                           0UL);
+  }
+
+  /*
+   * GetThroughput() - Returns operations per second
+   */
+  double GetThroughput() const {
+    if(interval <= 0.0) {
+      return 0.0;
+    }
+
+    return GetTotalOps() / interval;
+  }
+
+  /*
+   * GetImbalance() - Returns (max - min) / mean of per-thread operations
+   *
+   * 0 means all threads did the same amount of work
+   */
+  double GetImbalance() const {
+    auto it = std::minmax_element(op_count_list.begin(), op_count_list.end());
+    double mean = static_cast<double>(GetTotalOps()) / GetThreadNum();
+    if(mean == 0.0) {
+      return 0.0;
+    }
+
+    return (*it.second - *it.first) / mean;
+  }
+
+  /*
+   * Print() - Prints total operations, throughput and imbalance
+   */
+  void Print() const {
+    auto it = std::minmax_element(op_count_list.begin(), op_count_list.end());
+    dbg_printf("%lu threads; %f s; %lu ops; %f MOps/sec; "
+               "per thread min %lu max %lu; imbalance %.2f%%\n",
+               GetThreadNum(),
+               interval,
+               GetTotalOps(),
+               GetThroughput() / 1e6,
+               *it.first,
+               *it.second,
+               GetImbalance() * 100.0);
+
+    return;
+  }
+};
+
+/*
+ * class TimedRun - Start barrier and stop flag of a run driven by RunTimed()
+ *
+ * The stop flag is only written once, so checking it costs a load from a
+ * cache line that stays shared by all cores
+ */
+class TimedRun {
+ private:
+  SpinBarrier barrier;
+  std::atomic<bool> stop_flag;
+
+ public:
+
+  /*
+   * Constructor - The extra barrier slot is for the timer thread
+   */
+  TimedRun(uint64_t num_threads) :
+    barrier{num_threads + 1UL},
+    stop_flag{false} {
+    return;
+  }
+
+  /*
+   * WaitForStart() - Blocks until all threads are ready; the duration is
+   *                  measured from here
+   */
+  inline void WaitForStart() {
+    barrier.Wait();
+
+    return;
+  }
+
+  inline bool IsStopped() const {
+    return stop_flag.load(std::memory_order_relaxed);
+  }
+
+  inline void Stop() {
+    stop_flag.store(true, std::memory_order_relaxed);
+
+    return;
+  }
+};
+
+/*
+ * RunTimed() - Runs body(thread_id, run_p) on one thread per counter for
+ *              the given number of seconds and reports the operations the
+ *              threads counted
+ *
+ * This is the skeleton shared by timed drivers. The body does its per-thread
+ * setup, calls run_p->WaitForStart() exactly once, and then works and adds
+ * to its counter until run_p->IsStopped() is true. A timer thread starts
+ * with the workers and stops the run after the duration elapses, so no
+ * thread finishes early and the tail of the run is not single-threaded.
+ *
+ * Counters are not reset before the run; the report only has operations of
+ * this run
+ */
+template <typename Body>
+ThroughputReport RunTimed(ThreadCounterArray *counter_array_p,
+                          double seconds,
+                          Body &&body) {
+  ThreadCounterArray &counter_array = *counter_array_p;
+  uint64_t num_threads = counter_array.GetThreadNum();
+  std::vector<uint64_t> start_list = counter_array.GetSnapshot();
+  TimedRun run{num_threads};
+  double interval = 0.0;
+
+  std::thread timer_thread{[&]() {
+    run.WaitForStart();
+
+    Timer timer{true};
+    SleepFor(static_cast<uint64_t>(seconds * 1000.0));
+    run.Stop();
+
+    interval = timer.Stop();
+  }};
+
+  StartThreads(num_threads, [&](uint64_t thread_id) {
+    body(thread_id, &run);
+  });
+
+  timer_thread.join();
+
+  std::vector<uint64_t> op_count_list = counter_array.GetSnapshot();
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    op_count_list[thread_id] -= start_list[thread_id];
+  }
+
+  return ThroughputReport{op_count_list, interval};
+}
+
+/*
+ * RunForDuration() - Calls fn(thread_id, args...) repeatedly on one thread
+ *                    per counter for the given number of seconds
+ *
+ * Each call to fn is counted as one operation, and workers check the stop
+ * flag before every call (see RunTimed()). Unlike running a fixed number of
+ * operations per thread, no thread finishes early.
+ *
+ * Other threads (e.g. ThroughputSampler) could watch the counters while the
+ * run is in progress
+ */
+template <typename Fn, typename... Args>
+ThroughputReport RunForDuration(ThreadCounterArray *counter_array_p,
+                                double seconds,
+                                Fn &&fn,
+                                Args &&... args) {
+  ThreadCounterArray &counter_array = *counter_array_p;
+
+  return RunTimed(counter_array_p,
+                  seconds,
+                  [&](uint64_t thread_id, TimedRun *run_p) {
+    run_p->WaitForStart();
+
+    while(run_p->IsStopped() == false) {
+      fn(thread_id, args...);
+      counter_array.Add(thread_id);
+    }
+  });
+}
+
+/*
+ * RunForDuration() - Same as above on num_threads threads, with a private
+ *                    counter array
+ */
+template <typename Fn, typename... Args>
+ThroughputReport RunForDuration(uint64_t num_threads,
+                                double seconds,
+                                Fn &&fn,
+                                Args &&... args) {
+  ThreadCounterArray counter_array{num_threads};
+
+  return RunForDuration(&counter_array, seconds, fn, args...);
+}
+
+/*
+ * enum class ArrivalMode - How an open-loop driver schedules operations
+ *
+ *   FIXED_RATE - Operations are evenly spaced
+ *   POISSON    - Inter-arrival times are exponentially distributed
+ */
+enum class ArrivalMode {
+  FIXED_RATE,
+  POISSON,
+};
+
+/*
+ * class OpenLoopReport - Rate and latency of an open-loop run
+ *
+ * Latency is measured from the time an operation was scheduled to be sent,
+ * not the time it was actually sent. If the system under test stalls, the
+ * operations that should have been sent during the stall are still charged
+ * with the waiting time, which corrects coordinated omission
+ */
+class OpenLoopReport {
+ private:
+  double target_rate;
+  double interval;
+  // Operations that were scheduled but could not be issued before the end
+  // of the run because the system fell behind
+  uint64_t missed_num;
+  // Latency of every completed operation in nanoseconds, sorted
+  std::vector<uint64_t> latency_list;
+
+ public:
+
+  /*
+   * Constructor - Takes ownership of the latency list and sorts it
+   */
+  OpenLoopReport(double p_target_rate,
+                 double p_interval,
+                 uint64_t p_missed_num,
+                 std::vector<uint64_t> &&p_latency_list) :
+    target_rate{p_target_rate},
+    interval{p_interval},
+    missed_num{p_missed_num},
+    latency_list{std::move(p_latency_list)} {
+    std::sort(latency_list.begin(), latency_list.end());
+
+    return;
+  }
+
+  inline double GetTargetRate() const {
+    return target_rate;
+  }
+
+  /*
+   * GetAchievedRate() - Returns completed operations per second
+   */
+  inline double GetAchievedRate() const {
+    return latency_list.size() / interval;
+  }
+
+  inline uint64_t GetOpCount() const {
+    return latency_list.size();
+  }
+
+  inline uint64_t GetMissedNum() const {
+    return missed_num;
+  }
+
+  /*
+   * GetLatency() - Returns the latency at a percentile in nanoseconds, e.g.
+   *                GetLatency(99.9)
+   */
+  uint64_t GetLatency(double percentile) const {
+    if(latency_list.size() == 0UL) {
+      return 0UL;
+    }
+
+    size_t index = \
+      static_cast<size_t>(percentile / 100.0 * (latency_list.size() - 1));
+
+    return latency_list[index];
+  }
+
+  /*
+   * GetMaxLatency() - Returns the largest latency in nanoseconds
+   */
+  uint64_t GetMaxLatency() const {
+    return latency_list.size() == 0UL ? 0UL : latency_list.back();
+  }
+
+  /*
+   * Print() - Prints rate and latency percentiles
+   */
+  void Print() const {
+    dbg_printf("target %f ops/sec; achieved %f ops/sec; missed %lu; "
+               "latency (us) p50 %.2f p99 %.2f p99.9 %.2f max %.2f\n",
+               target_rate,
+               GetAchievedRate(),
+               missed_num,
+               GetLatency(50.0) / 1e3,
+               GetLatency(99.0) / 1e3,
+               GetLatency(99.9) / 1e3,
+               GetMaxLatency() / 1e3);
+
+    return;
+  }
+};
+
+/*
+ * RunOpenLoop() - Issues fn(thread_id, args...) from num_threads threads
+ *                 at an aggregate target rate for the given number of seconds
+ *
+ * Each thread issues target_rate / num_threads operations per second on its
+ * own schedule. With FIXED_RATE the schedules of different threads are 
+ * staggered such that the aggregate is evenly spaced; with POISSON the
+ * inter-arrival times are drawn from an exponential distribution using 
+ * SimpleInt64Random as the uniform source.
+ *
+ * A thread never issues an operation before its scheduled time, but if it 
+ * is behind schedule it issues immediately without skipping, and the latency
+ * includes the time spent behind. Operations scheduled after the end of the
+ * run are not issued; those scheduled before the end but not issued in time
+ * are reported as missed.
+ */
+template <typename Fn, typename... Args>
+OpenLoopReport RunOpenLoop(uint64_t num_threads,
+                           double target_rate,
+                           double seconds,
+                           ArrivalMode mode,
+                           Fn &&fn,
+                           Args &&... args) {
+  // If we are ahead of schedule by more than this we sleep instead of 
+  // spinning
+  static constexpr uint64_t SLEEP_THRESHOLD_NS = 200000UL;
+
+  assert(target_rate > 0.0);
+
+  double thread_interval_ns = 1e9 * num_threads / target_rate;
+  uint64_t duration_ns = static_cast<uint64_t>(seconds * 1e9);
+
+  std::vector<std::vector<uint64_t>> latency_list_list(num_threads);
+  std::vector<uint64_t> missed_list(num_threads, 0UL);
+  SpinBarrier barrier{num_threads};
+  Timer timer{false};
+
+  StartThreads(num_threads, [&](uint64_t thread_id) {
+    std::vector<uint64_t> &latency_list = latency_list_list[thread_id];
+    latency_list.reserve(
+      static_cast<size_t>(duration_ns / thread_interval_ns * 1.1) + 16UL);
+
+    SimpleInt64Random<> rand{};
+    uint64_t op_index = 0UL;
+
+    if(barrier.Wait() == true) {
+      timer.Start();
+    }
+
+    uint64_t start_ns = GetSteadyClockNs();
+    uint64_t end_ns = start_ns + duration_ns;
+
+    // Stagger fixed-rate schedules of different threads
+    double next_ns = start_ns;
+    if(mode == ArrivalMode::FIXED_RATE) {
+      next_ns += thread_interval_ns * thread_id / num_threads;
+    }
+
+    while(true) {
+      if(mode == ArrivalMode::POISSON) {
+        // Map the hash to (0, 1] such that log() is finite
+        double u = (rand(op_index, thread_id) >> 11) * (1.0 / (1UL << 53));
+        next_ns += -std::log(1.0 - u) * thread_interval_ns;
+      }
+
+      uint64_t intended_ns = static_cast<uint64_t>(next_ns);
+      if(intended_ns >= end_ns) {
+        break;
+      }
+
+      uint64_t now_ns = GetSteadyClockNs();
+      if(now_ns >= end_ns) {
+        // Everything left until the end is missed
+        missed_list[thread_id] += \
+          static_cast<uint64_t>((end_ns - intended_ns) / thread_interval_ns);
+        break;
+      }
+
+      if(intended_ns > now_ns + SLEEP_THRESHOLD_NS) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(
+          intended_ns - now_ns - SLEEP_THRESHOLD_NS / 2));
+      }
+
+      uint64_t i = 0UL;
+      while(now_ns < intended_ns) {
+        SpinPause(i++);
+        now_ns = GetSteadyClockNs();
+      }
+
+      fn(thread_id, args...);
+
+      latency_list.push_back(GetSteadyClockNs() - intended_ns);
+      op_index++;
+
+      if(mode == ArrivalMode::FIXED_RATE) {
+        next_ns += thread_interval_ns;
+      }
+    }
+  });
+
+  double interval = timer.Stop();
+
+  std::vector<uint64_t> latency_list{};
+  uint64_t missed_num = 0UL;
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    latency_list.insert(latency_list.end(),
+                        latency_list_list[thread_id].begin(),
+                        latency_list_list[thread_id].end());
+    missed_num += missed_list[thread_id];
+  }
+
+  return OpenLoopReport{target_rate,
+                        interval,
+                        missed_num,
+                        std::move(latency_list)};
+}
+
+/*
+ * class SteadyStateDetector - Decides whether throughput has settled from
+ *                             periodic samples of the total operation count
+ *
+ * Each pair of consecutive samples gives the throughput of one sampling
+ * interval. We keep the last window_size of them, and the run is in steady
+ * state once the window is full and its coefficient of variation (stddev
+ * divided by mean) is below the threshold.
+ */
+class SteadyStateDetector {
+ private:
+  uint64_t window_size;
+  double cv_threshold;
+
+  // Ring buffer of the most recent interval throughput values
+  std::vector<double> window;
+  uint64_t sample_num;
+
+  uint64_t last_ns;
+  uint64_t last_total;
+
+  double cv;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  SteadyStateDetector(uint64_t p_window_size, double p_cv_threshold) :
+    window_size{p_window_size},
+    cv_threshold{p_cv_threshold},
+    window(p_window_size, 0.0),
+    sample_num{0UL},
+    last_ns{0UL},
+    last_total{0UL},
+    cv{INFINITY} {
+    assert(window_size > 1UL);
+
+    return;
+  }
+
+  /*
+   * AddSample() - Adds a sample of the total operation count taken at the
+   *               given time, and returns whether we are in steady state
+   */
+  bool AddSample(uint64_t timestamp_ns, uint64_t total) {
+    if(sample_num > 0UL && timestamp_ns > last_ns) {
+      double throughput = \
+        (total - last_total) * 1e9 / (timestamp_ns - last_ns);
+      window[(sample_num - 1UL) % window_size] = throughput;
+    }
+
+    sample_num++;
+    last_ns = timestamp_ns;
+    last_total = total;
+
+    // The first sample has no interval
+    if(sample_num - 1UL < window_size) {
+      return false;
+    }
+
+    double sum = 0.0;
+    for(double throughput : window) {
+      sum += throughput;
+    }
+
+    double mean = sum / window_size;
+    double square_sum = 0.0;
+    for(double throughput : window) {
+      square_sum += (throughput - mean) * (throughput - mean);
+    }
+
+    cv = (mean > 0.0) ? std::sqrt(square_sum / window_size) / mean : INFINITY;
+
+    return IsSteady();
+  }
+
+  /*
+   * IsSteady() - Returns whether the last window is stable enough
+   */
+  inline bool IsSteady() const {
+    return cv < cv_threshold;
+  }
+
+  /*
+   * GetCV() - Returns the coefficient of variation of the last full window
+   *
+   * This is infinity before the window is full
+   */
+  inline double GetCV() const {
+    return cv;
+  }
+};
+
+/*
+ * class PhaseLength - When a phase of PhaseRunner ends
+ *
+ * There are four kinds of phases:
+ *   Once()       - The functor is called exactly once on each thread; it
+ *                  does its own looping, e.g. bulk-loading a key range
+ *   Ops(n)       - The functor is called n times on each thread
+ *   Seconds(t)   - The functor is called repeatedly on each thread until t
+ *                  seconds have elapsed since the phase started
+ *   SteadyState() - The functor is called repeatedly until a sampler
+ *                  thread detects that throughput has settled (see
+ *                  SteadyStateDetector), or max_seconds has elapsed. This is
+ *                  meant for warmup, such that the next phase starts as
+ *                  soon as allocator pools, tree shapes or GC have reached
+ *                  equilibrium
+ */
+class PhaseLength {
+ public:
+  enum class Mode {
+    ONCE,
+    OP_COUNT,
+    DURATION,
+    STEADY_STATE,
+  };
+
+  Mode mode;
+  uint64_t op_count;
+  double seconds;
+
+  // Only used by SteadyState()
+  double cv_threshold;
+  uint64_t window_size;
+  uint64_t sample_interval_us;
+
+  static PhaseLength Once() {
+    return PhaseLength{Mode::ONCE, 1UL, 0.0, 0.0, 0UL, 0UL};
+  }
+
+  static PhaseLength Ops(uint64_t op_count) {
+    return PhaseLength{Mode::OP_COUNT, op_count, 0.0, 0.0, 0UL, 0UL};
+  }
+
+  static PhaseLength Seconds(double seconds) {
+    return PhaseLength{Mode::DURATION, 0UL, seconds, 0.0, 0UL, 0UL};
+  }
+
+  /*
+   * SteadyState() - Ends when the coefficient of variation of the last
+   *                 window_size sampled throughput values is below 
+   *                 cv_threshold, sampling every sample_interval_ms
+   */
+  static PhaseLength SteadyState(double max_seconds = 60.0,
+                                 double cv_threshold = 0.02,
+                                 uint64_t window_size = 20UL,
+                                 double sample_interval_ms = 5.0) {
+    return PhaseLength{Mode::STEADY_STATE,
+                       0UL,
+                       max_seconds,
+                       cv_threshold,
+                       window_size,
+                       static_cast<uint64_t>(sample_interval_ms * 1000.0)};
+  }
+};
+
+/*
+ * class PhaseReport - Per-phase throughput of a PhaseRunner run
+ */
+class PhaseReport {
+ private:
+  std::vector<std::string> name_list;
+  std::vector<ThroughputReport> report_list;
+  std::vector<bool> measure_flag_list;
+
+  // Coefficient of variation when a SteadyState() phase ended, or NAN for
+  // other phases. It is not below the threshold if the phase timed out
+  std::vector<double> steady_cv_list;
+  std::vector<bool> steady_flag_list;
+
+ public:
+
+  /*
+   * AddPhase() - Appends the result of a phase
+   */
+  void AddPhase(const std::string &name,
+                const ThroughputReport &report,
+                bool measure_flag,
+                double steady_cv = NAN,
+                bool steady_flag = false) {
+    name_list.push_back(name);
+    report_list.push_back(report);
+    measure_flag_list.push_back(measure_flag);
+    steady_cv_list.push_back(steady_cv);
+    steady_flag_list.push_back(steady_flag);
+
+    return;
+  }
+
+  /*
+   * IsSteadyStateReached() - Returns whether a SteadyState() phase ended 
+   *                          because throughput settled rather than timing
+   *                          out
+   */
+  inline bool IsSteadyStateReached(size_t index) const {
+    return steady_flag_list[index];
+  }
+
+  /*
+   * GetWarmupInterval() - Returns the detected warmup duration, i.e. the
+   *                       total length of SteadyState() phases in seconds
+   */
+  double GetWarmupInterval() const {
+    double interval = 0.0;
+    for(size_t i = 0;i < report_list.size();i++) {
+      if(std::isnan(steady_cv_list[i]) == false) {
+        interval += report_list[i].GetInterval();
+      }
+    }
+
+    return interval;
+  }
+
+  inline size_t GetPhaseNum() const {
+    return name_list.size();
+  }
+
+  inline const std::string &GetPhaseName(size_t index) const {
+    return name_list[index];
+  }
+
+  inline const ThroughputReport &GetPhase(size_t index) const {
+    return report_list[index];
+  }
+
+  /*
+   * GetPhase() - Returns the report of a phase by name
+   */
+  const ThroughputReport &GetPhase(const std::string &name) const {
+    for(size_t i = 0;i < name_list.size();i++) {
+      if(name_list[i] == name) {
+        return report_list[i];
+      }
+    }
+
+    assert(false);
+    throw "Phase not found";
+  }
+
+  /*
+   * GetMeasureReport() - Returns the combined report of all measure phases
+   *
+   * Operations are summed per thread, and intervals are summed. This is the
+   * number that should be reported as the throughput of the benchmark
+   */
+  ThroughputReport GetMeasureReport() const {
+    std::vector<uint64_t> op_count_list{};
+    double interval = 0.0;
+
+    for(size_t i = 0;i < report_list.size();i++) {
+      if(measure_flag_list[i] == false) {
+        continue;
+      }
+
+      const std::vector<uint64_t> &list = report_list[i].GetOpCountList();
+      op_count_list.resize(list.size(), 0UL);
+      for(size_t thread_id = 0;thread_id < list.size();thread_id++) {
+        op_count_list[thread_id] += list[thread_id];
+      }
+
+      interval += report_list[i].GetInterval();
+    }
+
+    assert(op_count_list.size() > 0UL);
+
+    return ThroughputReport{op_count_list, interval};
+  }
+
+  /*
+   * Print() - Prints every phase
+   */
+  void Print() const {
+    for(size_t i = 0;i < report_list.size();i++) {
+      dbg_printf("Phase \"%s\"%s:\n",
+                 name_list[i].c_str(),
+                 measure_flag_list[i] ? " (measured)" : "");
+      report_list[i].Print();
+
+      if(std::isnan(steady_cv_list[i]) == false) {
+        dbg_printf("Warmup %s after %f s (CV = %f)\n",
+                   steady_flag_list[i] ? "reached steady state" : "timed out",
+                   report_list[i].GetInterval(),
+                   steady_cv_list[i]);
+      }
+    }
+
+    return;
+  }
+};
+
+/*
+ * class EmptyThreadState - Default per-thread state of PhaseRunner
+ */
+class EmptyThreadState {};
+
+/*
+ * class PhaseRunner - Runs a benchmark as a sequence of phases, e.g. load, 
+ *                     warmup, measure and drain/verify
+ *
+ * Each phase is a functor called as fn(thread_id, state_p), where state_p
+ * points to a ThreadState object owned by the runner for that thread. State
+ * objects are created once (cache line aligned) and live as long as the 
+ * runner, so keys loaded in one phase could be looked up in the next.
+ *
+ * All phases of a Run() execute inside a single StartThreads() call, with a
+ * reusable barrier between phases, so the same pinned threads run every 
+ * phase. Between two phases the last thread arriving at the barrier stops
+ * the Timer of the finished phase, snapshots and resets the per-thread 
+ * operation counters, and starts the Timer of the next phase before the 
+ * others are released. The first phase is started the same way once all
+ * threads have arrived.
+ *
+ * Each call of the functor counts as one operation. Once() phases could 
+ * count their own operations with AddOps(). Only phases added with
+ * measure_flag set count toward PhaseReport::GetMeasureReport().
+ *
+ * SteadyState() phases start a sampler thread that reads the per-thread
+ * counters periodically and ends the phase once throughput has settled.
+ *
+ * Usage:
+ *   PhaseRunner<MyState> runner{num_threads};
+ *   runner.AddPhase("load", PhaseLength::Once(), load_fn);
+ *   runner.AddPhase("warmup", PhaseLength::SteadyState(), op_fn);
+ *   runner.AddPhase("measure", PhaseLength::Seconds(10.0), op_fn, true);
+ *   runner.AddPhase("verify", PhaseLength::Once(), verify_fn);
+ *   PhaseReport report = runner.Run();
+ */
+template <typename ThreadState = EmptyThreadState>
+class PhaseRunner {
+ public:
+  using PhaseFn = std::function<void(uint64_t, ThreadState *)>;
+
+ private:
+  // In Seconds() phases each thread reads the clock once every this many
+  // operations to check whether the phase has ended
+  static constexpr uint64_t CLOCK_CHECK_INTERVAL = 16UL;
+
+  class Phase {
+   public:
+    std::string name;
+    PhaseLength length;
+    PhaseFn fn;
+    bool measure_flag;
+  };
+
+  uint64_t num_threads;
+  std::vector<Phase> phase_list;
+
+  PaddedArray<ThreadState> state_list;
+  ThreadCounterArray counter_array;
+
+  // Set when the current Seconds() phase should end, and the time it ends
+  std::atomic<bool> stop_flag;
+  uint64_t deadline_ns;
+
+  // Timer of each phase of the current run
+  std::vector<Timer> timer_list;
+
+  // Sampler of the current SteadyState() phase, and the result of it
+  std::thread sampler_thread;
+  double steady_cv;
+  bool steady_flag;
+
+  /*
+   * SampleSteadyState() - Body of the sampler thread
+   */
+  void SampleSteadyState(const PhaseLength &length) {
+    SteadyStateDetector detector{length.window_size, length.cv_threshold};
+    std::chrono::microseconds interval{length.sample_interval_us};
+
+    while(stop_flag.load(std::memory_order_relaxed) == false) {
+      std::this_thread::sleep_for(interval);
+
+      uint64_t now_ns = GetSteadyClockNs();
+      if(detector.AddSample(now_ns, counter_array.GetTotal()) == true) {
+        steady_flag = true;
+        break;
+      }
+
+      if(now_ns >= deadline_ns) {
+        break;
+      }
+    }
+
+    steady_cv = detector.GetCV();
+    stop_flag.store(true, std::memory_order_relaxed);
+
+    return;
+  }
+
+  /*
+   * StartPhase() - Resets per-phase states and starts the phase timer
+   *
+   * Only one thread calls this while others wait at the barrier
+   */
+  void StartPhase(size_t index) {
+    const PhaseLength &length = phase_list[index].length;
+
+    counter_array.Reset();
+    stop_flag.store(false, std::memory_order_relaxed);
+    deadline_ns = \
+      GetSteadyClockNs() + static_cast<uint64_t>(length.seconds * 1e9);
+    steady_cv = NAN;
+    steady_flag = false;
+
+    timer_list[index].Start();
+
+    if(length.mode == PhaseLength::Mode::STEADY_STATE) {
+      sampler_thread = \
+        std::thread{&PhaseRunner::SampleSteadyState, this, length};
+    }
+
+    return;
+  }
+
+  /*
+   * FinishPhase() - Stops the timer and the sampler of a phase
+   *
+   * Only one thread calls this after all threads finished the phase
+   */
+  void FinishPhase(size_t index, PhaseReport *report_p) {
+    timer_list[index].Stop();
+
+    if(sampler_thread.joinable() == true) {
+      sampler_thread.join();
+    }
+
+    const Phase &phase = phase_list[index];
+    report_p->AddPhase(phase.name,
+                       ThroughputReport{counter_array.GetSnapshot(),
+                                        timer_list[index].GetInterval()},
+                       phase.measure_flag,
+                       steady_cv,
+                       steady_flag);
+
+    return;
+  }
+
+  /*
+   * RunPhase() - Executes a phase on one thread
+   */
+  void RunPhase(const Phase &phase, uint64_t thread_id) {
+    ThreadState *state_p = &state_list[thread_id];
+
+    switch(phase.length.mode) {
+      case PhaseLength::Mode::ONCE:
+        phase.fn(thread_id, state_p);
+        break;
+      case PhaseLength::Mode::OP_COUNT:
+        for(uint64_t i = 0;i < phase.length.op_count;i++) {
+          phase.fn(thread_id, state_p);
+          counter_array.Add(thread_id);
+        }
+
+        break;
+      case PhaseLength::Mode::STEADY_STATE:
+        // The sampler thread sets the stop flag
+        while(stop_flag.load(std::memory_order_relaxed) == false) {
+          phase.fn(thread_id, state_p);
+          counter_array.Add(thread_id);
+        }
+
+        break;
+      case PhaseLength::Mode::DURATION: {
+        uint64_t i = 0UL;
+        while(stop_flag.load(std::memory_order_relaxed) == false) {
+          phase.fn(thread_id, state_p);
+          counter_array.Add(thread_id);
+
+          if((++i % CLOCK_CHECK_INTERVAL) == 0UL &&
+             GetSteadyClockNs() >= deadline_ns) {
+            stop_flag.store(true, std::memory_order_relaxed);
+          }
+        }
+
+        break;
+      }
+      default:
+        assert(false);
+    }
+
+    return;
+  }
+
+ public:
+
+  /*
+   * Constructor - Creates per-thread states
+   */
+  PhaseRunner(uint64_t p_num_threads) :
+    num_threads{p_num_threads},
+    phase_list{},
+    state_list{p_num_threads},
+    counter_array{p_num_threads},
+    stop_flag{false},
+    deadline_ns{0UL},
+    timer_list{},
+    sampler_thread{},
+    steady_cv{NAN},
+    steady_flag{false} {
+    assert(num_threads > 0UL);
+
+    return;
+  }
+
+  /*
+   * AddPhase() - Appends a phase to the end of the phase list
+   */
+  void AddPhase(const std::string &name,
+                const PhaseLength &length,
+                const PhaseFn &fn,
+                bool measure_flag = false) {
+    phase_list.push_back(Phase{name, length, fn, measure_flag});
+
+    return;
+  }
+
+  /*
+   * AddOps() - Counts operations done by a thread in the current phase
+   *
+   * This is intended for Once() phases whose functor does its own looping
+   */
+  inline void AddOps(uint64_t thread_id, uint64_t delta) {
+    counter_array.Add(thread_id, delta);
+
+    return;
+  }
+
+  /*
+   * GetThreadState() - Returns the state of a thread
+   *
+   * This should not be called while a run is in progress except by the
+   * owner thread
+   */
+  inline ThreadState &GetThreadState(uint64_t thread_id) {
+    return state_list[thread_id];
+  }
+
+  inline uint64_t GetThreadNum() const {
+    return num_threads;
+  }
+
+  /*
+   * Run() - Runs all phases in order and returns their reports
+   */
+  PhaseReport Run() {
+    PhaseReport report{};
+    if(phase_list.size() == 0UL) {
+      return report;
+    }
+
+    SpinBarrier barrier{num_threads};
+    timer_list.assign(phase_list.size(), Timer{false});
+
+    StartThreads(num_threads, [&](uint64_t thread_id) {
+      // The first phase is also started by the last thread to arrive, such
+      // that thread creation and dispatch are not part of its Timer
+      if(barrier.Wait() == true) {
+        StartPhase(0);
+      }
+
+      for(size_t i = 0;i < phase_list.size();i++) {
+        // Start barrier: all threads begin the phase together
+        barrier.Wait();
+
+        RunPhase(phase_list[i], thread_id);
+
+        // End barrier: the last thread closes this phase and prepares the
+        // next one, while the others wait at the next start barrier
+        if(barrier.Wait() == true) {
+          FinishPhase(i, &report);
+
+          if(i + 1 < phase_list.size()) {
+            StartPhase(i + 1);
+          }
+        }
+      }
+    });
+
+    return report;
+  }
+};
+
+#endif
@@ -40,5 +40,19 @@ static void dummy(const char*, ...) {}
 // if there is one
 #define likely(x)   __builtin_expect(!!(x), 1)
 #define unlikely(x) __builtin_expect(!!(x), 0)
+
+// This is the size of a cache line on all platforms we care about. Data 
+// written by different threads should be separated by at least this many
+// bytes to avoid false sharing
+#define CACHE_LINE_SIZE 64
+
+// Hint the processor that we are in a spin loop. On x86 this is the PAUSE
+// instruction which saves power and avoids memory order violation penalty
+// when the loop exits
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_pause() __builtin_ia32_pause()
+#else
+#define cpu_pause() do {} while(0)
+#endif
  
 #endif
@@ -0,0 +1,238 @@
+
+#pragma once
+
+#ifndef _COROUTINE_H
+#define _COROUTINE_H
+
+#include "bench_driver.h"
+
+/*
+ * Stackless coroutines for keeping many operations in flight per thread
+ *
+ * An operation is a class derived from Coroutine whose Resume() body is
+ * wrapped in CORO_BEGIN() and CORO_END(). Inside the body, CORO_YIELD()
+ * suspends the operation, and the next Resume() continues right after it.
+ * CORO_PREFETCH(addr) issues a prefetch and then yields, such that other
+ * operations run while the cache line is on its way.
+ *
+ * The body is a switch statement on the line number of the last yield
+ * (i.e. a Duff's device), so suspending and resuming costs one indirect
+ * jump and nothing is allocated. The catch is that local variables do not
+ * survive a yield: anything used across a yield must be a data member of
+ * the operation, and CORO_YIELD() cannot appear inside another switch.
+ *
+ * After CORO_END() the state is reset, so the next Resume() starts a new
+ * operation from the top of the body. This way one object is a reusable
+ * slot of the scheduler.
+ *
+ * Usage:
+ *   class LookupOp : public Coroutine {
+ *    private:
+ *     Node *node_p;
+ *    public:
+ *     CoroutineStatus Resume(uint64_t thread_id) {
+ *       CORO_BEGIN();
+ *       node_p = root_p;
+ *       while(node_p->IsLeaf() == false) {
+ *         CORO_PREFETCH(node_p->GetChild(key));
+ *         node_p = node_p->GetChild(key);
+ *       }
+ *       CORO_END();
+ *     }
+ *   };
+ */
+
+/*
+ * enum class CoroutineStatus - Returned by Resume()
+ */
+enum class CoroutineStatus {
+  // The operation yielded and should be resumed later
+  SUSPENDED,
+  // The operation has finished; the next Resume() starts a new one
+  DONE,
+};
+
+#define CORO_BEGIN() \
+  switch(this->coro_state) { \
+    case 0:
+
+#define CORO_YIELD() \
+  do { \
+    this->coro_state = __LINE__; \
+    return CoroutineStatus::SUSPENDED; \
+    case __LINE__:; \
+  } while(0)
+
+#define CORO_PREFETCH(addr) \
+  do { \
+    __builtin_prefetch(addr); \
+    CORO_YIELD(); \
+  } while(0)
+
+#define CORO_END() \
+  } \
+  this->coro_state = 0; \
+  return CoroutineStatus::DONE;
+
+/*
+ * class Coroutine - Base class of operations; only holds the resume point
+ */
+class Coroutine {
+ protected:
+  // Line of the last yield, or 0 if the operation has not started
+  int coro_state;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  Coroutine() :
+    coro_state{0} {
+    return;
+  }
+
+  /*
+   * IsRunning() - Returns whether the operation has started and not finished
+   */
+  inline bool IsRunning() const {
+    return coro_state != 0;
+  }
+};
+
+/*
+ * class CoroutineScheduler - Round-robin scheduler over a fixed number of
+ *                            operation slots on one thread
+ *
+ * Op must be derived from Coroutine and have
+ * CoroutineStatus Resume(uint64_t thread_id). A finished slot starts a new
+ * operation the next time it is resumed, so there are always slot_num
+ * operations in flight
+ */
+template <typename Op>
+class CoroutineScheduler {
+ private:
+  uint64_t thread_id;
+  std::vector<Op> slot_list;
+
+ public:
+
+  /*
+   * Constructor - Slots are built with make_fn(thread_id, slot_id)
+   */
+  template <typename MakeFn>
+  CoroutineScheduler(uint64_t p_thread_id, uint64_t slot_num, MakeFn &&make_fn) :
+    thread_id{p_thread_id},
+    slot_list{} {
+    assert(slot_num > 0UL);
+
+    slot_list.reserve(slot_num);
+    for(uint64_t slot_id = 0;slot_id < slot_num;slot_id++) {
+      slot_list.push_back(make_fn(thread_id, slot_id));
+    }
+
+    return;
+  }
+
+  inline uint64_t GetSlotNum() const {
+    return slot_list.size();
+  }
+
+  inline Op &GetSlot(uint64_t slot_id) {
+    return slot_list[slot_id];
+  }
+
+  /*
+   * Step() - Resumes every slot once; returns the number of operations that
+   *          finished
+   */
+  inline uint64_t Step() {
+    uint64_t done_num = 0UL;
+    for(Op &op : slot_list) {
+      if(op.Resume(thread_id) == CoroutineStatus::DONE) {
+        done_num++;
+      }
+    }
+
+    return done_num;
+  }
+
+  /*
+   * Drain() - Resumes slots until no operation is in flight; returns the
+   *           number of operations that finished
+   *
+   * Slots that are not running are not resumed, so no new operation starts
+   */
+  uint64_t Drain() {
+    uint64_t done_num = 0UL;
+    bool running_flag = true;
+    while(running_flag == true) {
+      running_flag = false;
+      for(Op &op : slot_list) {
+        if(op.IsRunning() == false) {
+          continue;
+        }
+
+        if(op.Resume(thread_id) == CoroutineStatus::DONE) {
+          done_num++;
+        } else {
+          running_flag = true;
+        }
+      }
+    }
+
+    return done_num;
+  }
+};
+
+/*
+ * RunCoroutinesForDuration() - Runs slot_num interleaved operations on each
+ *                              thread for the given number of seconds
+ *
+ * Like RunForDuration() this is built on RunTimed(), but each worker runs a
+ * CoroutineScheduler instead of calling a functor. Slots are built with
+ * make_fn(thread_id, slot_id), which must return an Op. Every finished
+ * operation is counted in the counter array, and the stop flag is checked
+ * once every round over the slots. Operations still in flight when the run
+ * stops are not counted
+ */
+template <typename Op, typename MakeFn>
+ThroughputReport RunCoroutinesForDuration(ThreadCounterArray *counter_array_p,
+                                          double seconds,
+                                          uint64_t slot_num,
+                                          MakeFn &&make_fn) {
+  ThreadCounterArray &counter_array = *counter_array_p;
+
+  return RunTimed(counter_array_p,
+                  seconds,
+                  [&](uint64_t thread_id, TimedRun *run_p) {
+    CoroutineScheduler<Op> scheduler{thread_id, slot_num, make_fn};
+    run_p->WaitForStart();
+
+    while(run_p->IsStopped() == false) {
+      uint64_t done_num = scheduler.Step();
+      if(done_num > 0UL) {
+        counter_array.Add(thread_id, done_num);
+      }
+    }
+  });
+}
+
+/*
+ * RunCoroutinesForDuration() - Same as above on num_threads threads, with a
+ *                              private counter array
+ */
+template <typename Op, typename MakeFn>
+ThroughputReport RunCoroutinesForDuration(uint64_t num_threads,
+                                          double seconds,
+                                          uint64_t slot_num,
+                                          MakeFn &&make_fn) {
+  ThreadCounterArray counter_array{num_threads};
+
+  return RunCoroutinesForDuration<Op>(&counter_array,
+                                      seconds,
+                                      slot_num,
+                                      make_fn);
+}
+
+#endif
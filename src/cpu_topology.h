@@ -0,0 +1,610 @@
+
+#pragma once
+
+#ifndef _CPU_TOPOLOGY_H
+#define _CPU_TOPOLOGY_H
+
+#include <dirent.h>
+#include <set>
+#include <tuple>
+
+#include "test_suite.h"
+
+/*
+ * class CpuInfo - Location of a logical CPU in the machine
+ *
+ * All IDs except cpu_id are dense indices assigned by CpuTopology, i.e. they
+ * range from 0 to (number of such units - 1). Cache domains are identified
+ * by the smallest logical CPU sharing the cache, or -1 if unknown
+ */
+class CpuInfo {
+ public:
+  // Logical CPU number as used by sched_setaffinity()
+  int cpu_id;
+  // Dense socket index
+  int socket_id;
+  // Dense physical core index, unique across sockets
+  int core_id;
+  // Index of this CPU among its SMT siblings (0 for the first hardware thread)
+  int smt_id;
+  // NUMA node the CPU belongs to
+  int numa_node;
+  // Smallest CPU sharing the L2 and L3 cache with this CPU
+  int l2_domain;
+  int l3_domain;
+};
+
+/*
+ * enum class PlacementPolicy - How threads are assigned to logical CPUs
+ *
+ *   COMPACT        - Fill one socket before going to the next, with SMT
+ *                    siblings of a core placed next to each other
+ *   SCATTER        - Round-robin across sockets; on each socket use physical
+ *                    cores before SMT siblings
+ *   PHYSICAL_FIRST - Use the first hardware thread of every physical core
+ *                    (socket by socket) before using any SMT sibling
+ */
+enum class PlacementPolicy {
+  COMPACT,
+  SCATTER,
+  PHYSICAL_FIRST,
+};
+
+/*
+ * class CpuTopology - Sockets, cores, SMT siblings, caches and NUMA nodes of
+ *                     the current machine
+ *
+ * Information is read from /sys/devices/system/cpu. If sysfs is not
+ * available we fall back to a flat topology with GetCoreNum() single-threaded
+ * cores on one socket, which is what PinToCore() used to assume.
+ *
+ * On top of that this class computes thread placements for StartThreads(),
+ * such that a scaling sweep adds SMT or cross-socket effects in a known order
+ * rather than whatever the logical CPU numbering happens to be.
+ */
+class CpuTopology {
+ private:
+  // Sorted by cpu_id
+  std::vector<CpuInfo> cpu_list;
+
+  int socket_num;
+  int core_num;
+  int numa_node_num;
+
+  static constexpr const char *SYSFS_CPU_PATH = "/sys/devices/system/cpu";
+
+  /*
+   * ReadFile() - Reads the first line of a file without the trailing newline
+   *
+   * Returns false if the file could not be opened
+   */
+  static bool ReadFile(const std::string &path, std::string *value_p) {
+    FILE *fp = fopen(path.c_str(), "r");
+    if(fp == nullptr) {
+      return false;
+    }
+
+    char buffer[4096];
+    if(fgets(buffer, sizeof(buffer), fp) == nullptr) {
+      buffer[0] = '\0';
+    }
+
+    fclose(fp);
+
+    size_t len = strlen(buffer);
+    while(len > 0 && (buffer[len - 1] == '\n' || buffer[len - 1] == ' ')) {
+      len--;
+    }
+
+    value_p->assign(buffer, len);
+
+    return true;
+  }
+
+  /*
+   * ReadInt() - Reads an integer file; returns the default value on failure
+   */
+  static int ReadInt(const std::string &path, int default_value) {
+    std::string value;
+    if(ReadFile(path, &value) == false) {
+      return default_value;
+    }
+
+    try {
+      return std::stoi(value);
+    } catch(...) {
+      return default_value;
+    }
+  }
+
+  /*
+   * ReadCacheDomains() - Finds the smallest CPU sharing L2 and L3 with a CPU
+   */
+  static void ReadCacheDomains(CpuInfo *info_p) {
+    info_p->l2_domain = -1;
+    info_p->l3_domain = -1;
+
+    std::string cpu_path = \
+      std::string{SYSFS_CPU_PATH} + "/cpu" + std::to_string(info_p->cpu_id);
+
+    for(int index = 0;;index++) {
+      std::string cache_path = \
+        cpu_path + "/cache/index" + std::to_string(index);
+
+      int level = ReadInt(cache_path + "/level", -1);
+      if(level == -1) {
+        break;
+      }
+
+      // L1 instruction cache has the same level as L1 data cache, but we
+      // only care about L2 and L3 which are unified
+      std::string shared_list;
+      if(ReadFile(cache_path + "/shared_cpu_list", &shared_list) == false) {
+        continue;
+      }
+
+      std::vector<int> shared = ParseCpuList(shared_list);
+      if(shared.size() == 0UL) {
+        continue;
+      }
+
+      int domain = *std::min_element(shared.begin(), shared.end());
+      if(level == 2) {
+        info_p->l2_domain = domain;
+      } else if(level == 3) {
+        info_p->l3_domain = domain;
+      }
+    }
+
+    return;
+  }
+
+  /*
+   * ReadNumaNode() - Returns the NUMA node of a CPU, or 0 if not found
+   *
+   * sysfs has a "nodeX" link under the directory of each CPU
+   */
+  static int ReadNumaNode(int cpu_id) {
+    std::string cpu_path = \
+      std::string{SYSFS_CPU_PATH} + "/cpu" + std::to_string(cpu_id);
+    DIR *dir = opendir(cpu_path.c_str());
+    if(dir == nullptr) {
+      return 0;
+    }
+
+    int node = 0;
+    struct dirent *entry;
+    while((entry = readdir(dir)) != nullptr) {
+      if(strncmp(entry->d_name, "node", 4) == 0 &&
+         entry->d_name[4] >= '0' &&
+         entry->d_name[4] <= '9') {
+        node = atoi(entry->d_name + 4);
+        break;
+      }
+    }
+
+    closedir(dir);
+
+    return node;
+  }
+
+  /*
+   * LoadFlat() - Falls back to GetCoreNum() CPUs on a single socket
+   */
+  void LoadFlat() {
+    cpu_list.clear();
+    for(int cpu_id = 0;cpu_id < static_cast<int>(::GetCoreNum());cpu_id++) {
+      cpu_list.push_back(CpuInfo{cpu_id, 0, cpu_id, 0, 0, -1, -1});
+    }
+
+    return;
+  }
+
+  /*
+   * Load() - Reads topology from sysfs
+   *
+   * Socket, core and node IDs reported by the kernel are not necessarily
+   * dense (e.g. core_id could skip numbers), so we remap them to indices
+   */
+  void Load() {
+    std::string online;
+    if(ReadFile(std::string{SYSFS_CPU_PATH} + "/online", &online) == false) {
+      LoadFlat();
+      return;
+    }
+
+    std::map<int, int> socket_map{};
+    std::map<std::pair<int, int>, int> core_map{};
+    std::map<int, int> node_map{};
+    // Number of hardware threads seen so far on each physical core
+    std::map<int, int> smt_count_map{};
+
+    for(int cpu_id : ParseCpuList(online)) {
+      std::string topology_path = std::string{SYSFS_CPU_PATH} + "/cpu" +
+                                  std::to_string(cpu_id) + "/topology";
+
+      int package = ReadInt(topology_path + "/physical_package_id", 0);
+      int core = ReadInt(topology_path + "/core_id", cpu_id);
+      int node = ReadNumaNode(cpu_id);
+
+      // map::insert() does not overwrite, so the index is only assigned
+      // the first time a key is seen
+      int socket_id = \
+        socket_map.insert(std::make_pair(package,
+                                         (int)socket_map.size())).first->second;
+      int core_id = \
+        core_map.insert(std::make_pair(std::make_pair(package, core),
+                                       (int)core_map.size())).first->second;
+      int numa_node = \
+        node_map.insert(std::make_pair(node,
+                                       (int)node_map.size())).first->second;
+
+      CpuInfo info{cpu_id, socket_id, core_id, smt_count_map[core_id]++,
+                   numa_node, -1, -1};
+      ReadCacheDomains(&info);
+
+      cpu_list.push_back(info);
+    }
+
+    if(cpu_list.size() == 0UL) {
+      LoadFlat();
+    }
+
+    return;
+  }
+
+  /*
+   * CountDistinct() - Counts distinct values of a CpuInfo member
+   */
+  int CountDistinct(int CpuInfo::*member_p) const {
+    std::set<int> value_set{};
+    for(const CpuInfo &info : cpu_list) {
+      value_set.insert(info.*member_p);
+    }
+
+    return static_cast<int>(value_set.size());
+  }
+
+ public:
+
+  /*
+   * Constructor - Reads the topology of the current machine
+   */
+  CpuTopology() {
+    Load();
+
+    socket_num = CountDistinct(&CpuInfo::socket_id);
+    core_num = CountDistinct(&CpuInfo::core_id);
+    numa_node_num = CountDistinct(&CpuInfo::numa_node);
+
+    return;
+  }
+
+  /*
+   * Get() - Returns the topology of the current machine, which is only
+   *         read once
+   */
+  static const CpuTopology &Get() {
+    static CpuTopology topology{};
+    return topology;
+  }
+
+  /*
+   * ParseCpuList() - Parses a CPU list string in the kernel format, e.g.
+   *                  "0-3,8,10-11"
+   *
+   * Malformed ranges are ignored
+   */
+  static std::vector<int> ParseCpuList(const std::string &s) {
+    std::vector<int> result{};
+    size_t start = 0;
+
+    while(start < s.size()) {
+      size_t end = s.find(',', start);
+      if(end == std::string::npos) {
+        end = s.size();
+      }
+
+      std::string range = s.substr(start, end - start);
+      start = end + 1;
+
+      int low, high;
+      if(sscanf(range.c_str(), "%d-%d", &low, &high) == 2) {
+        for(int cpu_id = low;cpu_id <= high;cpu_id++) {
+          result.push_back(cpu_id);
+        }
+      } else if(sscanf(range.c_str(), "%d", &low) == 1) {
+        result.push_back(low);
+      }
+    }
+
+    return result;
+  }
+
+  /*
+   * ParseCpuListStrict() - Same as ParseCpuList(), but returns false if any
+   *                        range is malformed or the list is empty
+   *
+   * This is for lists given by users, where a typo should not silently
+   * select fewer CPUs
+   */
+  static bool ParseCpuListStrict(const std::string &s,
+                                 std::vector<int> *result_p) {
+    std::vector<int> result{};
+    size_t start = 0;
+
+    while(start <= s.size()) {
+      size_t end = s.find(',', start);
+      if(end == std::string::npos) {
+        end = s.size();
+      }
+
+      std::string range = s.substr(start, end - start);
+      start = end + 1;
+
+      // %n makes sure that the whole range is consumed
+      int low, high, length = -1;
+      if(sscanf(range.c_str(), "%d-%d%n", &low, &high, &length) == 2 &&
+         length == static_cast<int>(range.size())) {
+        if(low < 0 || low > high || high >= CPU_SETSIZE) {
+          return false;
+        }
+
+        for(int cpu_id = low;cpu_id <= high;cpu_id++) {
+          result.push_back(cpu_id);
+        }
+      } else if(sscanf(range.c_str(), "%d%n", &low, &length) == 1 &&
+                length == static_cast<int>(range.size()) &&
+                low >= 0) {
+        result.push_back(low);
+      } else {
+        return false;
+      }
+    }
+
+    if(result.empty() == true) {
+      return false;
+    }
+
+    *result_p = result;
+
+    return true;
+  }
+
+  inline const std::vector<CpuInfo> &GetCpuList() const {
+    return cpu_list;
+  }
+
+  /*
+   * GetCpuNum() - Returns the number of online logical CPUs
+   */
+  inline int GetCpuNum() const {
+    return static_cast<int>(cpu_list.size());
+  }
+
+  inline int GetSocketNum() const {
+    return socket_num;
+  }
+
+  /*
+   * GetCoreNum() - Returns the number of physical cores
+   */
+  inline int GetCoreNum() const {
+    return core_num;
+  }
+
+  inline int GetNumaNodeNum() const {
+    return numa_node_num;
+  }
+
+  /*
+   * GetSMTWidth() - Returns the maximum number of hardware threads per core
+   */
+  int GetSMTWidth() const {
+    int width = 0;
+    for(const CpuInfo &info : cpu_list) {
+      width = std::max(width, info.smt_id + 1);
+    }
+
+    return width;
+  }
+
+  /*
+   * GetAllowedCpuList() - Returns the online CPUs in the affinity mask of
+   *                       the process
+   *
+   * Falls back to all online CPUs if none of them is in the mask, which
+   * only happens if the mask and the topology disagree
+   */
+  std::vector<CpuInfo> GetAllowedCpuList() const {
+    std::vector<int> allowed_list = GetAllowedCoreList();
+
+    std::vector<CpuInfo> result{};
+    for(const CpuInfo &info : cpu_list) {
+      if(std::find(allowed_list.begin(),
+                   allowed_list.end(),
+                   info.cpu_id) != allowed_list.end()) {
+        result.push_back(info);
+      }
+    }
+
+    if(result.empty() == true) {
+      return cpu_list;
+    }
+
+    return result;
+  }
+
+  /*
+   * GetPlacement() - Returns the logical CPU for each of num_threads threads
+   *                  under the given policy
+   *
+   * Only CPUs in the affinity mask of the process are used, since threads
+   * cannot be pinned to the others. If there are more threads than such
+   * CPUs the order wraps around within them
+   */
+  std::vector<int> GetPlacement(PlacementPolicy policy,
+                                uint64_t num_threads) const {
+    std::vector<CpuInfo> usable_list = GetAllowedCpuList();
+
+    // Each CPU is ranked by a tuple; CPUs are used in ascending rank order
+    std::vector<std::pair<std::tuple<int, int, int, int>, int>> rank_list{};
+
+    // Physical cores are numbered in the order they appear, so we need
+    // each core's position within its own socket for SCATTER
+    std::map<int, int> core_rank_map{};
+    std::vector<int> socket_core_count(socket_num, 0);
+    for(const CpuInfo &info : usable_list) {
+      if(core_rank_map.count(info.core_id) == 0UL) {
+        core_rank_map[info.core_id] = socket_core_count[info.socket_id]++;
+      }
+    }
+
+    for(const CpuInfo &info : usable_list) {
+      int core_rank = core_rank_map[info.core_id];
+      std::tuple<int, int, int, int> rank;
+
+      switch(policy) {
+        case PlacementPolicy::COMPACT:
+          rank = std::make_tuple(info.socket_id,
+                                 info.core_id,
+                                 info.smt_id,
+                                 info.cpu_id);
+          break;
+        case PlacementPolicy::SCATTER:
+          rank = std::make_tuple(info.smt_id,
+                                 core_rank,
+                                 info.socket_id,
+                                 info.cpu_id);
+          break;
+        case PlacementPolicy::PHYSICAL_FIRST:
+          rank = std::make_tuple(info.smt_id,
+                                 info.socket_id,
+                                 info.core_id,
+                                 info.cpu_id);
+          break;
+        default:
+          assert(false);
+      }
+
+      rank_list.push_back(std::make_pair(rank, info.cpu_id));
+    }
+
+    std::sort(rank_list.begin(), rank_list.end());
+
+    std::vector<int> result{};
+    for(uint64_t i = 0;i < num_threads;i++) {
+      result.push_back(rank_list[i % rank_list.size()].second);
+    }
+
+    return result;
+  }
+
+  /*
+   * GetPlacement() - Returns placement from a policy name or an explicit
+   *                  CPU list
+   *
+   * This is intended for values from Argv or Envp. Accepted names are
+   * "compact", "scatter" and "physical"; anything else is parsed as a CPU
+   * list such as "0,2,4-7", which is repeated if shorter than num_threads.
+   * Exits with an error if the string is neither, or if the list has a CPU
+   * that is not online or not in the affinity mask of the process
+   */
+  std::vector<int> GetPlacement(const std::string &policy,
+                                uint64_t num_threads) const {
+    if(policy == "compact") {
+      return GetPlacement(PlacementPolicy::COMPACT, num_threads);
+    } else if(policy == "scatter") {
+      return GetPlacement(PlacementPolicy::SCATTER, num_threads);
+    } else if(policy == "physical") {
+      return GetPlacement(PlacementPolicy::PHYSICAL_FIRST, num_threads);
+    }
+
+    std::vector<int> allowed_list = GetAllowedCoreList();
+    std::vector<int> parsed_list{};
+    if(ParseCpuListStrict(policy, &parsed_list) == false) {
+      fprintf(stderr,
+              "ERROR: Unknown placement \"%s\"; expected compact, scatter, "
+              "physical or a CPU list such as 0,2,4-7\n",
+              policy.c_str());
+      exit(1);
+    }
+
+    for(int cpu_id : parsed_list) {
+      if(std::find_if(cpu_list.begin(),
+                      cpu_list.end(),
+                      [cpu_id](const CpuInfo &info) {
+                        return info.cpu_id == cpu_id;
+                      }) == cpu_list.end()) {
+        fprintf(stderr,
+                "ERROR: CPU %d in placement \"%s\" is not online\n",
+                cpu_id,
+                policy.c_str());
+        exit(1);
+      }
+
+      if(std::find(allowed_list.begin(),
+                   allowed_list.end(),
+                   cpu_id) == allowed_list.end()) {
+        fprintf(stderr,
+                "ERROR: CPU %d in placement \"%s\" is not in the affinity "
+                "mask of this process\n",
+                cpu_id,
+                policy.c_str());
+        exit(1);
+      }
+    }
+
+    std::vector<int> result{};
+    for(uint64_t i = 0;i < num_threads;i++) {
+      result.push_back(parsed_list[i % parsed_list.size()]);
+    }
+
+    return result;
+  }
+
+  /*
+   * Print() - Prints the topology summary and each CPU
+   */
+  void Print() const {
+    dbg_printf("%d sockets; %d physical cores; %d logical CPUs; "
+               "%d NUMA nodes; SMT width %d\n",
+               socket_num,
+               core_num,
+               GetCpuNum(),
+               numa_node_num,
+               GetSMTWidth());
+
+    for(const CpuInfo &info : cpu_list) {
+      dbg_printf("  CPU %3d: socket %d core %3d smt %d node %d "
+                 "L2 %3d L3 %3d\n",
+                 info.cpu_id,
+                 info.socket_id,
+                 info.core_id,
+                 info.smt_id,
+                 info.numa_node,
+                 info.l2_domain,
+                 info.l3_domain);
+    }
+
+    return;
+  }
+};
+
+/*
+ * StartThreadsWithPolicy() - Launches num_threads threads placed according
+ *                            to the given policy
+ */
+template <typename Fn, typename... Args>
+void StartThreadsWithPolicy(PlacementPolicy policy,
+                            uint64_t num_threads,
+                            Fn &&fn,
+                            Args &&... args) {
+  StartThreadsOnCores(CpuTopology::Get().GetPlacement(policy, num_threads),
+                      std::forward<Fn>(fn),
+                      std::forward<Args>(args)...);
+
+  return;
+}
+
+#endif
@@ -0,0 +1,407 @@
+
+#pragma once
+
+#ifndef _CYCLE_TIMER_H
+#define _CYCLE_TIMER_H
+
+#include <ctime>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define CYCLE_TIMER_USE_TSC
+#endif
+
+#include "common.h"
+
+/*
+ * GetMonotonicRawNs() - Returns CLOCK_MONOTONIC_RAW in nanoseconds
+ *
+ * Unlike CLOCK_MONOTONIC this is not slewed by NTP, so it is what the TSC
+ * is calibrated against
+ */
+inline uint64_t GetMonotonicRawNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000UL + ts.tv_nsec;
+}
+
+/*
+ * ReadCycleBegin() - Reads the TSC at the beginning of a timed region
+ *
+ * RDTSC is not serializing, so it could execute before earlier instructions
+ * finish. The LFENCE in front waits for them; the one after keeps later
+ * instructions (i.e. the timed code) from starting before the TSC is read.
+ *
+ * On other architectures this returns nanoseconds of CLOCK_MONOTONIC_RAW
+ */
+inline uint64_t ReadCycleBegin() {
+#ifdef CYCLE_TIMER_USE_TSC
+  _mm_lfence();
+  uint64_t tsc = __rdtsc();
+  _mm_lfence();
+
+  return tsc;
+#else
+  return GetMonotonicRawNs();
+#endif
+}
+
+/*
+ * ReadCycleEnd() - Reads the TSC at the end of a timed region
+ *
+ * RDTSCP waits for all earlier instructions, and the LFENCE after it keeps
+ * later instructions from starting before the TSC is read
+ */
+inline uint64_t ReadCycleEnd() {
+#ifdef CYCLE_TIMER_USE_TSC
+  unsigned int aux;
+  uint64_t tsc = __rdtscp(&aux);
+  _mm_lfence();
+
+  return tsc;
+#else
+  return GetMonotonicRawNs();
+#endif
+}
+
+/*
+ * ReadCycle() - Reads the TSC without fences
+ *
+ * The read could be reordered with nearby instructions by a few tens of
+ * cycles, which does not matter for regions that are much longer or are
+ * summed over many calls, and it is several times cheaper
+ */
+inline uint64_t ReadCycle() {
+#ifdef CYCLE_TIMER_USE_TSC
+  return __rdtsc();
+#else
+  return GetMonotonicRawNs();
+#endif
+}
+
+/*
+ * class CycleClock - TSC frequency, calibrated once per process
+ *
+ * The frequency is measured against CLOCK_MONOTONIC_RAW over a few short
+ * windows, and the median is taken. Each end of a window is a clock read
+ * sandwiched between two TSC reads; the pair with the smallest gap out of a
+ * few tries is used, such that an interrupt between the reads does not
+ * skew the result.
+ *
+ * Calibration happens on first use, which takes CALIBRATION_ROUND_NUM *
+ * CALIBRATION_NS. Call Calibrate() at startup to keep it out of any
+ * measurement
+ */
+class CycleClock {
+ private:
+  static constexpr uint64_t CALIBRATION_NS = 10000000UL;
+  static constexpr int CALIBRATION_ROUND_NUM = 5;
+  static constexpr int SANDWICH_TRY_NUM = 8;
+
+  /*
+   * ReadPair() - Reads a TSC value and a clock value taken at the same time
+   */
+  static void ReadPair(uint64_t *tsc_p, uint64_t *ns_p) {
+    uint64_t best_gap = UINT64_MAX;
+    *tsc_p = 0UL;
+    *ns_p = 0UL;
+    for(int i = 0;i < SANDWICH_TRY_NUM;i++) {
+      uint64_t before = ReadCycleBegin();
+      uint64_t ns = GetMonotonicRawNs();
+      uint64_t after = ReadCycleEnd();
+
+      if(after - before < best_gap) {
+        best_gap = after - before;
+        *tsc_p = before + (after - before) / 2;
+        *ns_p = ns;
+      }
+    }
+
+    return;
+  }
+
+  /*
+   * MeasureCyclesPerNs() - Runs the calibration
+   */
+  static double MeasureCyclesPerNs() {
+#ifdef CYCLE_TIMER_USE_TSC
+    if(IsInvariant() == false) {
+      dbg_printf("WARNING: TSC is not invariant; cycle counts could drift "
+                 "with frequency scaling and across cores\n");
+    }
+
+    double rate_list[CALIBRATION_ROUND_NUM];
+    for(int round = 0;round < CALIBRATION_ROUND_NUM;round++) {
+      uint64_t start_tsc = 0UL, start_ns = 0UL;
+      uint64_t end_tsc = 0UL, end_ns = 0UL;
+      ReadPair(&start_tsc, &start_ns);
+      do {
+        ReadPair(&end_tsc, &end_ns);
+      } while(end_ns - start_ns < CALIBRATION_NS);
+
+      rate_list[round] = static_cast<double>(end_tsc - start_tsc) / \
+                         (end_ns - start_ns);
+    }
+
+    std::sort(rate_list, rate_list + CALIBRATION_ROUND_NUM);
+
+    return rate_list[CALIBRATION_ROUND_NUM / 2];
+#else
+    return 1.0;
+#endif
+  }
+
+ public:
+
+  /*
+   * IsInvariant() - Returns whether the TSC ticks at a constant rate in all
+   *                 P-, C- and T-states (CPUID 0x80000007 EDX bit 8)
+   */
+  static bool IsInvariant() {
+#ifdef CYCLE_TIMER_USE_TSC
+    unsigned int eax, ebx, ecx, edx;
+    if(__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0) {
+      return false;
+    }
+
+    return (edx & (1U << 8)) != 0;
+#else
+    return false;
+#endif
+  }
+
+  /*
+   * GetCyclesPerNs() - Returns the calibrated TSC frequency in GHz
+   */
+  static double GetCyclesPerNs() {
+    // Initialization of function statics is thread-safe
+    static const double cycles_per_ns = MeasureCyclesPerNs();
+
+    return cycles_per_ns;
+  }
+
+  /*
+   * Calibrate() - Calibrates now if it has not been done
+   */
+  static void Calibrate() {
+    GetCyclesPerNs();
+
+    return;
+  }
+
+  /*
+   * CyclesToNs() - Converts a number of cycles into nanoseconds
+   */
+  inline static double CyclesToNs(uint64_t cycles) {
+    return cycles / GetCyclesPerNs();
+  }
+};
+
+/*
+ * class ClockOverhead - Cost of timing an empty region with each clock,
+ *                       measured once per process
+ *
+ * For each clock this is the median difference between two back-to-back
+ * reads over many tries, i.e. what a timer reports for a region with
+ * nothing in it. Timers constructed with subtract_flag set take this off
+ * every interval they return, so short regions are not dominated by the
+ * cost of reading the clock.
+ *
+ * Like TSC calibration this happens on first use; Calibrate() (or
+ * PrintRunHeader()) at startup keeps it out of measurements
+ */
+class ClockOverhead {
+ public:
+  /*
+   * class Result - Overhead of each clock
+   */
+  class Result {
+   public:
+    double system_clock_ns;
+    double steady_clock_ns;
+    double monotonic_raw_ns;
+    // Between ReadCycleBegin() and ReadCycleEnd()
+    uint64_t tsc_cycles;
+  };
+
+ private:
+  static constexpr int TRY_NUM = 10001;
+
+  /*
+   * MeasureChrono() - Returns the median of back-to-back reads of a chrono
+   *                   clock in nanoseconds
+   */
+  template <typename Clock>
+  static double MeasureChrono() {
+    std::vector<double> ns_list(TRY_NUM);
+    for(int i = 0;i < TRY_NUM;i++) {
+      typename Clock::time_point start = Clock::now();
+      typename Clock::time_point end = Clock::now();
+      ns_list[i] = std::chrono::duration<double, std::nano>(end - start).count();
+    }
+
+    std::nth_element(ns_list.begin(),
+                     ns_list.begin() + TRY_NUM / 2,
+                     ns_list.end());
+
+    return ns_list[TRY_NUM / 2];
+  }
+
+  /*
+   * Measure() - Measures all clocks
+   */
+  static Result Measure() {
+    Result result;
+    result.system_clock_ns = MeasureChrono<std::chrono::system_clock>();
+    result.steady_clock_ns = MeasureChrono<std::chrono::steady_clock>();
+
+    std::vector<uint64_t> value_list(TRY_NUM);
+    for(int i = 0;i < TRY_NUM;i++) {
+      uint64_t start = GetMonotonicRawNs();
+      value_list[i] = GetMonotonicRawNs() - start;
+    }
+
+    std::nth_element(value_list.begin(),
+                     value_list.begin() + TRY_NUM / 2,
+                     value_list.end());
+    result.monotonic_raw_ns = static_cast<double>(value_list[TRY_NUM / 2]);
+
+    for(int i = 0;i < TRY_NUM;i++) {
+      uint64_t start = ReadCycleBegin();
+      value_list[i] = ReadCycleEnd() - start;
+    }
+
+    std::nth_element(value_list.begin(),
+                     value_list.begin() + TRY_NUM / 2,
+                     value_list.end());
+    result.tsc_cycles = value_list[TRY_NUM / 2];
+
+    return result;
+  }
+
+ public:
+
+  /*
+   * Get() - Returns the overhead, measuring it on first call
+   */
+  static const Result &Get() {
+    // Initialization of function statics is thread-safe
+    static const Result result = Measure();
+
+    return result;
+  }
+
+  /*
+   * Calibrate() - Measures now if it has not been done
+   */
+  static void Calibrate() {
+    Get();
+
+    return;
+  }
+
+  /*
+   * Print() - Prints the overhead of each clock
+   */
+  static void Print() {
+    const Result &result = Get();
+    dbg_printf("Empty region: system_clock %.1f ns; steady_clock %.1f ns; "
+               "CLOCK_MONOTONIC_RAW %.1f ns; TSC %lu cycles (%.1f ns)\n",
+               result.system_clock_ns,
+               result.steady_clock_ns,
+               result.monotonic_raw_ns,
+               result.tsc_cycles,
+               CycleClock::CyclesToNs(result.tsc_cycles));
+
+    return;
+  }
+};
+
+/*
+ * class CycleTimer - Timer based on the TSC for short regions
+ *
+ * The interface is the same as Timer, and in addition it returns the
+ * interval in cycles and nanoseconds. Start() and Stop() each cost a few
+ * tens of cycles, compared with a clock_gettime() call for Timer
+ */
+class CycleTimer {
+ private:
+  uint64_t start;
+  uint64_t end;
+  // Cycles taken off every interval
+  uint64_t overhead;
+
+ public:
+
+  /*
+   * Constructor
+   *
+   * start_flag denotes whether the timer starts immediately. If
+   * subtract_flag is set, the overhead of an empty region is taken off the
+   * interval. Calibration is done here, if not yet, and before the timer
+   * starts
+   */
+  CycleTimer(bool start_flag = true, bool subtract_flag = false) :
+    start{0UL},
+    end{0UL},
+    overhead{0UL} {
+    CycleClock::Calibrate();
+    if(subtract_flag == true) {
+      overhead = ClockOverhead::Get().tsc_cycles;
+    }
+
+    if(start_flag == true) {
+      Start();
+    }
+
+    return;
+  }
+
+  /*
+   * Start() - Starts the timer until Stop() is called
+   */
+  inline void Start() {
+    start = ReadCycleBegin();
+
+    return;
+  }
+
+  /*
+   * Stop() - Stops the timer and returns seconds since the last Start()
+   */
+  inline double Stop() {
+    end = ReadCycleEnd();
+
+    return GetInterval();
+  }
+
+  /*
+   * GetCycles() - Returns cycles between the latest Start() and Stop()
+   */
+  inline uint64_t GetCycles() const {
+    uint64_t cycles = end - start;
+
+    return cycles > overhead ? cycles - overhead : 0UL;
+  }
+
+  /*
+   * GetNs() - Returns nanoseconds between the latest Start() and Stop()
+   */
+  inline double GetNs() const {
+    return CycleClock::CyclesToNs(GetCycles());
+  }
+
+  /*
+   * GetInterval() - Returns seconds between the latest Start() and Stop()
+   */
+  inline double GetInterval() const {
+    return GetNs() / 1e9;
+  }
+};
+
+#endif
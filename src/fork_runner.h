@@ -0,0 +1,392 @@
+
+#pragma once
+
+#ifndef _FORK_RUNNER_H
+#define _FORK_RUNNER_H
+
+#include <type_traits>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "bench_driver.h"
+#include "latency_histogram.h"
+
+/*
+ * class ForkResult - Default result of one forked run
+ *
+ * Results live in memory shared between the parent and the children, so
+ * this must be trivially copyable and must not own any pointer. Children
+ * write it in place; nothing is serialized.
+ */
+class ForkResult {
+ public:
+  static constexpr uint64_t MAX_THREAD_NUM = 256UL;
+  static constexpr uint64_t MAX_COUNTER_NUM = 16UL;
+  // Enough for a histogram of the default precision over all 64-bit values,
+  // i.e. about 58 KB per slot
+  static constexpr uint64_t MAX_HISTOGRAM_BUCKET_NUM = \
+    (65UL - LatencyHistogram::DEFAULT_PRECISION_BITS) << \
+    LatencyHistogram::DEFAULT_PRECISION_BITS;
+
+  // Per-thread operation counts and the interval of a timed run
+  uint64_t thread_num;
+  uint64_t op_count_list[MAX_THREAD_NUM];
+  double interval;
+
+  // Free-form counters defined by the workload
+  uint64_t counter_list[MAX_COUNTER_NUM];
+
+  // CacheMeter readings as (accesses, misses); zero without PAPI
+  long long l1_access;
+  long long l1_miss;
+  long long l3_access;
+  long long l3_miss;
+
+  // Buckets of a LatencyHistogram; histogram_bucket_num is 0 if none is set
+  uint32_t histogram_precision_bits;
+  uint64_t histogram_max_value;
+  uint64_t histogram_bucket_num;
+  uint64_t histogram_min;
+  uint64_t histogram_max;
+  uint64_t histogram_count_list[MAX_HISTOGRAM_BUCKET_NUM];
+
+  /*
+   * SetThroughputReport() - Stores the result of a timed run
+   */
+  void SetThroughputReport(const ThroughputReport &report) {
+    assert(report.GetThreadNum() <= MAX_THREAD_NUM);
+
+    thread_num = report.GetThreadNum();
+    std::copy(report.GetOpCountList().begin(),
+              report.GetOpCountList().end(),
+              op_count_list);
+    interval = report.GetInterval();
+
+    return;
+  }
+
+  /*
+   * GetThroughputReport() - Rebuilds the report stored by the child
+   */
+  ThroughputReport GetThroughputReport() const {
+    return ThroughputReport{
+      std::vector<uint64_t>(op_count_list, op_count_list + thread_num),
+      interval};
+  }
+
+  /*
+   * SetHistogram() - Stores the buckets of a histogram, e.g. merged from a
+   *                  LatencyRecorder
+   */
+  void SetHistogram(const LatencyHistogram &histogram) {
+    assert(histogram.GetBucketNum() <= MAX_HISTOGRAM_BUCKET_NUM);
+
+    histogram_precision_bits = histogram.GetPrecisionBits();
+    histogram_max_value = histogram.GetMaxValue();
+    histogram_bucket_num = histogram.GetBucketNum();
+    histogram_min = histogram.GetMin();
+    histogram_max = histogram.GetMax();
+    for(uint64_t index = 0;index < histogram_bucket_num;index++) {
+      histogram_count_list[index] = histogram.GetCount(index);
+    }
+
+    return;
+  }
+
+  /*
+   * GetHistogram() - Rebuilds the histogram stored by the child, or returns
+   *                  an empty one if the child did not store any
+   */
+  LatencyHistogram GetHistogram() const {
+    LatencyHistogram histogram{};
+    if(histogram_bucket_num != 0UL) {
+      bool ret = histogram.Load(histogram_precision_bits,
+                                histogram_max_value,
+                                histogram_count_list,
+                                histogram_bucket_num,
+                                histogram_min,
+                                histogram_max);
+      assert(ret == true);
+      (void)ret;
+    }
+
+    return histogram;
+  }
+
+  /*
+   * SetCacheMeter() - Stores readings of a stopped CacheMeter
+   */
+  void SetCacheMeter(CacheMeter *meter_p) {
+    std::pair<long long, long long> l1 = meter_p->GetL1CacheUtilization();
+    std::pair<long long, long long> l3 = meter_p->GetL3CacheUtilization();
+
+    l1_access = l1.first;
+    l1_miss = l1.second;
+    l3_access = l3.first;
+    l3_miss = l3.second;
+
+    return;
+  }
+};
+
+/*
+ * class ForkRunner - Runs every configuration and repetition in its own
+ *                    child process
+ *
+ * Structures under test may leak or corrupt global state, and allocator
+ * state or a warm page cache left by one configuration affects the next one
+ * in the same process. Here each run gets a fresh copy of the parent's
+ * address space by fork(). Before forking, the parent maps one
+ * MAP_SHARED | MAP_ANONYMOUS region with a Result slot for every run; the
+ * child fills in its slot and leaves with _exit(), so neither destructors
+ * nor atexit handlers (e.g. the Python interpreter) run in the child.
+ *
+ * Runs are executed one at a time, repetitions interleaved across
+ * configurations like ScalingSweep. A run fails if the child is killed by a
+ * signal, exits with non-zero status or exits before the functor returns;
+ * results of failed runs are skipped by GetValueList().
+ *
+ * StartThreads() works in children; since the thread pool belongs to the
+ * parent, children spawn fresh threads for each call.
+ *
+ * Usage:
+ *   ForkRunner<> runner{};
+ *   for(uint64_t num_threads : thread_num_list) {
+ *     runner.AddConfig(std::to_string(num_threads),
+ *                      [num_threads](uint64_t, ForkResult *result_p) {
+ *       BwTree tree{};
+ *       result_p->SetThroughputReport(RunForDuration(num_threads, 5.0, ...));
+ *     });
+ *   }
+ *
+ *   runner.Run(3);
+ *   for(size_t config = 0;config < runner.GetConfigNum();config++) {
+ *     lc.AppendYValue(ScalingSweep::GetMedian(runner.GetValueList(config,
+ *       [](const ForkResult &r) {
+ *         return r.GetThroughputReport().GetThroughput() / 1e6;
+ *       })));
+ *   }
+ */
+template <typename Result = ForkResult>
+class ForkRunner {
+ public:
+  using ConfigFn = std::function<void(uint64_t, Result *)>;
+
+ private:
+  static_assert(std::is_trivially_copyable<Result>::value == true,
+                "Result must be trivially copyable to live in shared memory");
+
+  /*
+   * class Slot - Shared memory layout of one run
+   */
+  class Slot {
+   public:
+    Result result;
+    // Set by the child after the functor returns
+    bool finish_flag;
+  };
+
+  std::vector<std::string> name_list;
+  std::vector<ConfigFn> fn_list;
+
+  uint64_t repeat_num;
+
+  // The shared region of the last Run()
+  Slot *slot_list;
+  size_t region_size;
+
+  // Status from waitpid() of each run
+  std::vector<int> status_list;
+
+  /*
+   * Unmap() - Releases the shared region
+   */
+  void Unmap() {
+    if(slot_list != nullptr) {
+      munmap(slot_list, region_size);
+      slot_list = nullptr;
+    }
+
+    return;
+  }
+
+  /*
+   * GetSlot() - Returns the slot of a run
+   */
+  inline Slot &GetSlot(size_t config, uint64_t repeat) const {
+    return slot_list[config * repeat_num + repeat];
+  }
+
+  /*
+   * RunChild() - Forks a child to run a configuration and waits for it
+   */
+  void RunChild(size_t config, uint64_t repeat) {
+    Slot &slot = GetSlot(config, repeat);
+
+    // Otherwise buffered output is printed by both processes
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+    if(pid < 0) {
+      fprintf(stderr, "ERROR: fork() failed (%s)\n", strerror(errno));
+      exit(1);
+    } else if(pid == 0) {
+      fn_list[config](repeat, &slot.result);
+      slot.finish_flag = true;
+
+      fflush(stdout);
+      fflush(stderr);
+      _exit(0);
+    }
+
+    int status = 0;
+    while(waitpid(pid, &status, 0) < 0) {
+      assert(errno == EINTR);
+    }
+
+    status_list[config * repeat_num + repeat] = status;
+
+    return;
+  }
+
+ public:
+
+  /*
+   * Constructor
+   */
+  ForkRunner() :
+    name_list{},
+    fn_list{},
+    repeat_num{0UL},
+    slot_list{nullptr},
+    region_size{0UL},
+    status_list{} {
+    return;
+  }
+
+  /*
+   * Destructor - Unmaps results
+   */
+  ~ForkRunner() {
+    Unmap();
+
+    return;
+  }
+
+  ForkRunner(const ForkRunner &) = delete;
+  ForkRunner &operator=(const ForkRunner &) = delete;
+
+  /*
+   * AddConfig() - Adds a configuration
+   *
+   * fn is called as fn(repeat, result_p) in the child. The result slot is
+   * zero-initialized
+   */
+  void AddConfig(const std::string &name, const ConfigFn &fn) {
+    name_list.push_back(name);
+    fn_list.push_back(fn);
+
+    return;
+  }
+
+  /*
+   * Run() - Runs each configuration p_repeat_num times, each in a child
+   *
+   * Results of the previous Run() are discarded. Returns the number of
+   * failed runs
+   */
+  uint64_t Run(uint64_t p_repeat_num = 1UL) {
+    assert(p_repeat_num > 0UL);
+
+    Unmap();
+    repeat_num = p_repeat_num;
+    region_size = sizeof(Slot) * fn_list.size() * repeat_num;
+    status_list.assign(fn_list.size() * repeat_num, 0);
+
+    if(region_size == 0UL) {
+      return 0UL;
+    }
+
+    // Anonymous mappings are zero-filled
+    void *p = mmap(nullptr,
+                   region_size,
+                   PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS,
+                   -1,
+                   0);
+    if(p == MAP_FAILED) {
+      fprintf(stderr, "ERROR: mmap() failed (%s)\n", strerror(errno));
+      exit(1);
+    }
+
+    slot_list = static_cast<Slot *>(p);
+
+    uint64_t fail_num = 0UL;
+    for(uint64_t repeat = 0;repeat < repeat_num;repeat++) {
+      for(size_t config = 0;config < fn_list.size();config++) {
+        RunChild(config, repeat);
+
+        if(IsSuccess(config, repeat) == false) {
+          dbg_printf("%s: repeat %lu failed (status 0x%x)\n",
+                     name_list[config].c_str(),
+                     repeat,
+                     status_list[config * repeat_num + repeat]);
+          fail_num++;
+        }
+      }
+    }
+
+    return fail_num;
+  }
+
+  inline size_t GetConfigNum() const {
+    return fn_list.size();
+  }
+
+  inline const std::string &GetName(size_t config) const {
+    return name_list[config];
+  }
+
+  inline uint64_t GetRepeatNum() const {
+    return repeat_num;
+  }
+
+  /*
+   * IsSuccess() - Returns whether the child finished the run and exited
+   *               with status 0
+   */
+  bool IsSuccess(size_t config, uint64_t repeat) const {
+    int status = status_list[config * repeat_num + repeat];
+
+    return GetSlot(config, repeat).finish_flag == true &&
+           WIFEXITED(status) &&
+           WEXITSTATUS(status) == 0;
+  }
+
+  /*
+   * GetResult() - Returns the result written by the child of a run
+   */
+  inline const Result &GetResult(size_t config, uint64_t repeat) const {
+    return GetSlot(config, repeat).result;
+  }
+
+  /*
+   * GetValueList() - Returns fn(result) for each successful repetition of a
+   *                  configuration, e.g. for taking the median for a chart
+   */
+  template <typename Fn>
+  std::vector<double> GetValueList(size_t config, Fn &&fn) const {
+    std::vector<double> value_list{};
+    for(uint64_t repeat = 0;repeat < repeat_num;repeat++) {
+      if(IsSuccess(config, repeat) == true) {
+        value_list.push_back(fn(GetResult(config, repeat)));
+      }
+    }
+
+    return value_list;
+  }
+};
+
+#endif
@@ -0,0 +1,787 @@
+
+#pragma once
+
+#ifndef _LATENCY_HISTOGRAM_H
+#define _LATENCY_HISTOGRAM_H
+
+#include "test_suite.h"
+
+/*
+ * class LatencyHistogram - Log-linear histogram of integer values (e.g.
+ *                          cycles or nanoseconds) with bounded relative error
+ *
+ * This is the bucketing of HDR histograms. Values below 2^precision_bits
+ * have a bucket each. Above that, every power of two range [2^h, 2^(h+1))
+ * is cut into 2^precision_bits linear buckets of width 2^(h - precision_bits),
+ * so the width of a bucket is never more than 1 / 2^precision_bits of the
+ * values in it. With the default 7 bits the error is below 0.8%, and a
+ * histogram covering all 64-bit values has 7424 buckets.
+ *
+ * All memory is allocated in the constructor. Record() computes the bucket
+ * with a count-leading-zeros and a shift, and never allocates or takes a
+ * lock. A histogram is meant to be written by one thread; histograms of
+ * different threads are combined with Merge() after the threads finish.
+ *
+ * Values above max_value are counted in the bucket of max_value, although
+ * GetMax() still returns the exact largest value recorded
+ */
+class LatencyHistogram {
+ public:
+  static constexpr uint32_t DEFAULT_PRECISION_BITS = 7;
+  // Identifies data from Serialize()
+  static constexpr uint32_t SERIALIZE_MAGIC = 0x31474948U;
+
+ private:
+  uint32_t precision_bits;
+  uint64_t max_value;
+
+  std::vector<uint64_t> count_list;
+  uint64_t total_count;
+  uint64_t min;
+  uint64_t max;
+
+  /*
+   * GetMSB() - Returns the index of the most significant bit; value != 0
+   */
+  inline static uint32_t GetMSB(uint64_t value) {
+    return 63U - static_cast<uint32_t>(__builtin_clzll(value));
+  }
+
+  /*
+   * AppendVarint() - Appends an unsigned LEB128 integer
+   */
+  static void AppendVarint(std::string *data_p, uint64_t value) {
+    while(value >= 0x80UL) {
+      data_p->push_back(static_cast<char>((value & 0x7FUL) | 0x80UL));
+      value >>= 7;
+    }
+
+    data_p->push_back(static_cast<char>(value));
+
+    return;
+  }
+
+  /*
+   * ReadVarint() - Reads an unsigned LEB128 integer at *pos_p and advances
+   *                it; returns false if the data ends or is malformed
+   */
+  static bool ReadVarint(const std::string &data,
+                         size_t *pos_p,
+                         uint64_t *value_p) {
+    uint64_t value = 0UL;
+    for(uint32_t shift = 0;shift < 64;shift += 7) {
+      if(*pos_p >= data.size()) {
+        return false;
+      }
+
+      uint64_t byte = static_cast<uint8_t>(data[(*pos_p)++]);
+      value |= (byte & 0x7FUL) << shift;
+      if((byte & 0x80UL) == 0UL) {
+        *value_p = value;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+ public:
+
+  /*
+   * Constructor
+   *
+   * precision_bits is between 1 and 16. max_value only limits the number
+   * of buckets, i.e. the memory usage
+   */
+  LatencyHistogram(uint32_t p_precision_bits = DEFAULT_PRECISION_BITS,
+                   uint64_t p_max_value = UINT64_MAX) :
+    precision_bits{p_precision_bits},
+    max_value{p_max_value},
+    count_list{},
+    total_count{0UL},
+    min{UINT64_MAX},
+    max{0UL} {
+    assert(precision_bits >= 1U && precision_bits <= 16U);
+
+    count_list.resize(GetIndex(max_value) + 1UL, 0UL);
+
+    return;
+  }
+
+  inline uint32_t GetPrecisionBits() const {
+    return precision_bits;
+  }
+
+  inline uint64_t GetMaxValue() const {
+    return max_value;
+  }
+
+  /*
+   * GetBucketNum() - Returns the number of buckets
+   */
+  inline uint64_t GetBucketNum() const {
+    return count_list.size();
+  }
+
+  /*
+   * GetIndex() - Returns the bucket of a value, ignoring max_value
+   */
+  inline uint64_t GetIndex(uint64_t value) const {
+    uint64_t sub_bucket_num = 1UL << precision_bits;
+    if(value < sub_bucket_num) {
+      return value;
+    }
+
+    // (value >> shift) is in [sub_bucket_num, 2 * sub_bucket_num)
+    uint32_t shift = GetMSB(value) - precision_bits;
+
+    return (shift + 1UL) * sub_bucket_num + \
+           ((value >> shift) - sub_bucket_num);
+  }
+
+  /*
+   * GetLowerBound() - Returns the smallest value in a bucket
+   */
+  inline uint64_t GetLowerBound(uint64_t index) const {
+    uint64_t sub_bucket_num = 1UL << precision_bits;
+    if(index < sub_bucket_num) {
+      return index;
+    }
+
+    uint64_t shift = index / sub_bucket_num - 1UL;
+
+    return (sub_bucket_num + index % sub_bucket_num) << shift;
+  }
+
+  /*
+   * GetUpperBound() - Returns the largest value in a bucket
+   */
+  inline uint64_t GetUpperBound(uint64_t index) const {
+    uint64_t sub_bucket_num = 1UL << precision_bits;
+    if(index < sub_bucket_num) {
+      return index;
+    }
+
+    uint64_t shift = index / sub_bucket_num - 1UL;
+
+    return GetLowerBound(index) + ((1UL << shift) - 1UL);
+  }
+
+  /*
+   * Record() - Adds count occurrences of a value
+   */
+  inline void Record(uint64_t value, uint64_t count = 1UL) {
+    uint64_t index = GetIndex(value < max_value ? value : max_value);
+    count_list[index] += count;
+    total_count += count;
+
+    if(value < min) {
+      min = value;
+    }
+
+    if(value > max) {
+      max = value;
+    }
+
+    return;
+  }
+
+  /*
+   * Reset() - Removes all values
+   */
+  void Reset() {
+    std::fill(count_list.begin(), count_list.end(), 0UL);
+    total_count = 0UL;
+    min = UINT64_MAX;
+    max = 0UL;
+
+    return;
+  }
+
+  /*
+   * Merge() - Adds all values of another histogram of the same precision
+   *           and max_value
+   */
+  void Merge(const LatencyHistogram &other) {
+    assert(precision_bits == other.precision_bits);
+    assert(max_value == other.max_value);
+
+    for(uint64_t index = 0;index < GetBucketNum();index++) {
+      count_list[index] += other.count_list[index];
+    }
+
+    total_count += other.total_count;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+
+    return;
+  }
+
+  inline uint64_t GetCount(uint64_t index) const {
+    return count_list[index];
+  }
+
+  inline uint64_t GetTotalCount() const {
+    return total_count;
+  }
+
+  /*
+   * GetMin() - Returns the smallest value, or 0 if empty
+   */
+  inline uint64_t GetMin() const {
+    return total_count == 0UL ? 0UL : min;
+  }
+
+  inline uint64_t GetMax() const {
+    return max;
+  }
+
+  /*
+   * GetMean() - Returns the mean, using the middle of each bucket
+   */
+  double GetMean() const {
+    if(total_count == 0UL) {
+      return 0.0;
+    }
+
+    double sum = 0.0;
+    for(uint64_t index = 0;index < GetBucketNum();index++) {
+      if(count_list[index] != 0UL) {
+        double mid = GetLowerBound(index) + \
+                     (GetUpperBound(index) - GetLowerBound(index)) / 2.0;
+        sum += mid * count_list[index];
+      }
+    }
+
+    return sum / total_count;
+  }
+
+  /*
+   * GetPercentile() - Returns the value below or at which percentile% of
+   *                   the values are
+   *
+   * The result is the largest value of the bucket, but never larger than
+   * GetMax(), and it is 0 if the histogram is empty
+   */
+  uint64_t GetPercentile(double percentile) const {
+    if(total_count == 0UL) {
+      return 0UL;
+    }
+
+    uint64_t target = \
+      static_cast<uint64_t>(std::ceil(percentile / 100.0 * total_count));
+    target = std::max<uint64_t>(std::min(target, total_count), 1UL);
+
+    uint64_t seen = 0UL;
+    for(uint64_t index = 0;index < GetBucketNum();index++) {
+      seen += count_list[index];
+      if(seen >= target) {
+        return std::min(GetUpperBound(index), max);
+      }
+    }
+
+    return max;
+  }
+
+  /*
+   * Serialize() - Returns a compact binary form of the histogram
+   *
+   * Only non-empty buckets are stored, as varint encoded pairs of index
+   * delta and count
+   */
+  std::string Serialize() const {
+    std::string data{};
+    AppendVarint(&data, SERIALIZE_MAGIC);
+    AppendVarint(&data, precision_bits);
+    AppendVarint(&data, max_value);
+    AppendVarint(&data, min);
+    AppendVarint(&data, max);
+
+    uint64_t last_index = 0UL;
+    for(uint64_t index = 0;index < GetBucketNum();index++) {
+      if(count_list[index] != 0UL) {
+        AppendVarint(&data, index - last_index);
+        AppendVarint(&data, count_list[index]);
+        last_index = index;
+      }
+    }
+
+    return data;
+  }
+
+  /*
+   * Deserialize() - Replaces the histogram with one from Serialize()
+   *
+   * Returns false if the data is not valid, in which case the histogram is
+   * not changed
+   */
+  bool Deserialize(const std::string &data) {
+    size_t pos = 0UL;
+    uint64_t magic, p_precision_bits, p_max_value, p_min, p_max;
+    if(ReadVarint(data, &pos, &magic) == false ||
+       magic != SERIALIZE_MAGIC ||
+       ReadVarint(data, &pos, &p_precision_bits) == false ||
+       p_precision_bits < 1UL || p_precision_bits > 16UL ||
+       ReadVarint(data, &pos, &p_max_value) == false ||
+       ReadVarint(data, &pos, &p_min) == false ||
+       ReadVarint(data, &pos, &p_max) == false) {
+      return false;
+    }
+
+    LatencyHistogram histogram{static_cast<uint32_t>(p_precision_bits),
+                               p_max_value};
+    uint64_t index = 0UL;
+    while(pos < data.size()) {
+      uint64_t delta, count;
+      if(ReadVarint(data, &pos, &delta) == false ||
+         ReadVarint(data, &pos, &count) == false) {
+        return false;
+      }
+
+      index += delta;
+      if(index >= histogram.GetBucketNum()) {
+        return false;
+      }
+
+      histogram.count_list[index] += count;
+      histogram.total_count += count;
+    }
+
+    histogram.min = p_min;
+    histogram.max = p_max;
+    *this = std::move(histogram);
+
+    return true;
+  }
+
+  /*
+   * Load() - Replaces the histogram with raw bucket counts, e.g. copied out
+   *          of a fixed-size buffer in shared memory
+   *
+   * min and max are those of GetMin() and GetMax(). Returns false if
+   * bucket_num does not match the precision and max_value, in which case
+   * the histogram is not changed
+   */
+  bool Load(uint32_t p_precision_bits,
+            uint64_t p_max_value,
+            const uint64_t *count_p,
+            uint64_t bucket_num,
+            uint64_t p_min,
+            uint64_t p_max) {
+    if(p_precision_bits < 1U || p_precision_bits > 16U) {
+      return false;
+    }
+
+    LatencyHistogram histogram{p_precision_bits, p_max_value};
+    if(bucket_num != histogram.GetBucketNum()) {
+      return false;
+    }
+
+    for(uint64_t index = 0;index < bucket_num;index++) {
+      histogram.count_list[index] = count_p[index];
+      histogram.total_count += count_p[index];
+    }
+
+    if(histogram.total_count != 0UL) {
+      histogram.min = p_min;
+      histogram.max = p_max;
+    }
+
+    *this = std::move(histogram);
+
+    return true;
+  }
+
+  /*
+   * Print() - Prints count, min, mean, percentiles and max
+   */
+  void Print(const char *unit = "ns") const {
+    dbg_printf("%lu values; min %lu %s; mean %.1f %s; p50 %lu %s; "
+               "p99 %lu %s; p99.9 %lu %s; p99.99 %lu %s; max %lu %s\n",
+               GetTotalCount(),
+               GetMin(), unit,
+               GetMean(), unit,
+               GetPercentile(50.0), unit,
+               GetPercentile(99.0), unit,
+               GetPercentile(99.9), unit,
+               GetPercentile(99.99), unit,
+               GetMax(), unit);
+
+    return;
+  }
+};
+
+/*
+ * class LatencyRecorder - One LatencyHistogram per thread
+ *
+ * Each thread records into its own histogram on its own cache lines, so
+ * recording needs no synchronization. GetMerged() combines all of them and
+ * must be called after the threads finish, e.g. after StartThreads()
+ * returns:
+ *
+ *   LatencyRecorder recorder{num_threads};
+ *   StartThreads(num_threads, [&](uint64_t thread_id) {
+ *     CycleTimer timer{false};
+ *     for(...) {
+ *       timer.Start();
+ *       ...
+ *       timer.Stop();
+ *       recorder.Record(thread_id, timer.GetCycles());
+ *     }
+ *   });
+ *
+ *   recorder.GetMerged().Print("cycles");
+ */
+class LatencyRecorder {
+ private:
+  PaddedArray<LatencyHistogram> histogram_list;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  LatencyRecorder(
+    uint64_t thread_num,
+    uint32_t precision_bits = LatencyHistogram::DEFAULT_PRECISION_BITS,
+    uint64_t max_value = UINT64_MAX) :
+    histogram_list{thread_num} {
+    for(uint64_t thread_id = 0;thread_id < thread_num;thread_id++) {
+      histogram_list[thread_id] = LatencyHistogram{precision_bits, max_value};
+    }
+
+    return;
+  }
+
+  inline uint64_t GetThreadNum() const {
+    return histogram_list.GetCount();
+  }
+
+  /*
+   * Record() - Records a value of a thread; only called by that thread
+   */
+  inline void Record(uint64_t thread_id, uint64_t value) {
+    histogram_list[thread_id].Record(value);
+
+    return;
+  }
+
+  inline LatencyHistogram &GetHistogram(uint64_t thread_id) {
+    return histogram_list[thread_id];
+  }
+
+  inline const LatencyHistogram &GetHistogram(uint64_t thread_id) const {
+    return histogram_list[thread_id];
+  }
+
+  /*
+   * GetMerged() - Returns the histogram of all threads
+   */
+  LatencyHistogram GetMerged() const {
+    LatencyHistogram merged{histogram_list[0].GetPrecisionBits(),
+                            histogram_list[0].GetMaxValue()};
+    for(uint64_t thread_id = 0;thread_id < GetThreadNum();thread_id++) {
+      merged.Merge(histogram_list[thread_id]);
+    }
+
+    return merged;
+  }
+
+  /*
+   * Reset() - Removes all values of all threads
+   */
+  void Reset() {
+    for(uint64_t thread_id = 0;thread_id < GetThreadNum();thread_id++) {
+      histogram_list[thread_id].Reset();
+    }
+
+    return;
+  }
+};
+
+/*
+ * class SampledLatencyRecorder - Times one out of every sample_interval
+ *                                operations into a LatencyRecorder
+ *
+ * Timing an operation costs a Start()/Stop() pair of CycleTimer plus a
+ * Record(), which is comparable to the operation itself when it is short.
+ * Here each thread keeps a countdown on its own cache line, and only the
+ * operation that brings it to zero is timed, so the others pay for one
+ * decrement and a branch. The recorded values are cycles, minus the cycles
+ * of timing an empty region (see ClockOverhead).
+ *
+ * With fixed sampling every sample_interval-th operation is timed. That
+ * could alias with periodic behavior of the workload (e.g. a node split
+ * every N inserts), so with randomized sampling the next countdown is drawn
+ * uniformly from [1, 2 * sample_interval - 1] instead, which keeps the same
+ * rate on average.
+ *
+ * The cost of the timed and untimed paths is measured once in the
+ * constructor, such that the overhead of a run could be estimated from the
+ * number of operations and samples, and reported next to its throughput:
+ *
+ *   SampledLatencyRecorder recorder{num_threads, 100};
+ *   ThroughputReport report = \
+ *     RunForDuration(num_threads, 5.0, [&](uint64_t thread_id) {
+ *       recorder.Run(thread_id, [&]() { ... });
+ *     });
+ *
+ *   report.Print();
+ *   recorder.Print(report.GetInterval());
+ */
+class SampledLatencyRecorder {
+ private:
+  /*
+   * class ThreadState - Sampling state of one thread
+   */
+  class ThreadState {
+   public:
+    uint64_t countdown;
+    uint64_t op_num;
+    uint64_t sample_num;
+    // xorshift64 state for randomized intervals
+    uint64_t random_state;
+  };
+
+  LatencyRecorder recorder;
+  PaddedArray<ThreadState> state_list;
+  uint64_t sample_interval;
+  bool randomized_flag;
+
+  // Cycles of one timed and one untimed operation, excluding the operation
+  double timed_cycles;
+  double untimed_cycles;
+
+  /*
+   * GetNextCountdown() - Returns the number of operations until the next
+   *                      sample
+   */
+  inline uint64_t GetNextCountdown(ThreadState *state_p) const {
+    if(randomized_flag == false || sample_interval == 1UL) {
+      return sample_interval;
+    }
+
+    uint64_t x = state_p->random_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    state_p->random_state = x;
+
+    return 1UL + x % (2UL * sample_interval - 1UL);
+  }
+
+  /*
+   * MeasurePathCost() - Measures the cost of the timed and untimed paths
+   *                     with a trivial operation on thread 0, minus the cost
+   *                     of calling it in a loop
+   */
+  void MeasurePathCost() {
+    static constexpr uint64_t ITER_NUM = 100000UL;
+
+    ThreadState saved = state_list[0];
+    uint64_t saved_interval = sample_interval;
+
+    // The loop itself, which is not part of the overhead. The fence keeps
+    // the compiler from collapsing the loops
+    uint64_t call_num = 0UL;
+    auto fn = [&call_num]() {
+      call_num++;
+      std::atomic_signal_fence(std::memory_order_seq_cst);
+    };
+
+    CycleTimer timer{true};
+    for(uint64_t i = 0;i < ITER_NUM;i++) {
+      fn();
+    }
+
+    timer.Stop();
+    double loop_cycles = static_cast<double>(timer.GetCycles()) / ITER_NUM;
+
+    // Every operation is timed
+    sample_interval = 1UL;
+    state_list[0].countdown = 1UL;
+    timer.Start();
+    for(uint64_t i = 0;i < ITER_NUM;i++) {
+      Run(0, fn);
+    }
+
+    timer.Stop();
+    timed_cycles = static_cast<double>(timer.GetCycles()) / ITER_NUM - \
+                   loop_cycles;
+
+    // No operation is timed
+    sample_interval = UINT64_MAX;
+    state_list[0].countdown = UINT64_MAX;
+    timer.Start();
+    for(uint64_t i = 0;i < ITER_NUM;i++) {
+      Run(0, fn);
+    }
+
+    timer.Stop();
+    untimed_cycles = std::max(
+      static_cast<double>(timer.GetCycles()) / ITER_NUM - loop_cycles, 0.0);
+
+    sample_interval = saved_interval;
+    state_list[0] = saved;
+    recorder.Reset();
+
+    return;
+  }
+
+ public:
+
+  /*
+   * Constructor
+   *
+   * sample_interval is the average number of operations per sample
+   */
+  SampledLatencyRecorder(
+    uint64_t thread_num,
+    uint64_t p_sample_interval,
+    bool p_randomized_flag = true,
+    uint32_t precision_bits = LatencyHistogram::DEFAULT_PRECISION_BITS) :
+    recorder{thread_num, precision_bits},
+    state_list{thread_num},
+    sample_interval{p_sample_interval},
+    randomized_flag{p_randomized_flag},
+    timed_cycles{0.0},
+    untimed_cycles{0.0} {
+    assert(sample_interval > 0UL);
+
+    for(uint64_t thread_id = 0;thread_id < thread_num;thread_id++) {
+      ThreadState &state = state_list[thread_id];
+      state.random_state = SimpleInt64Random<>{}(thread_id, 0x5EED) | 1UL;
+      state.countdown = GetNextCountdown(&state);
+    }
+
+    MeasurePathCost();
+
+    return;
+  }
+
+  inline uint64_t GetThreadNum() const {
+    return state_list.GetCount();
+  }
+
+  inline uint64_t GetSampleInterval() const {
+    return sample_interval;
+  }
+
+  /*
+   * Run() - Calls fn() as one operation of a thread, and times it if it is
+   *         sampled; only called by that thread
+   */
+  template <typename Fn>
+  inline void Run(uint64_t thread_id, Fn &&fn) {
+    ThreadState &state = state_list[thread_id];
+    state.op_num++;
+
+    if(likely(--state.countdown != 0UL)) {
+      fn();
+      return;
+    }
+
+    CycleTimer timer{true, true};
+    fn();
+    timer.Stop();
+
+    recorder.Record(thread_id, timer.GetCycles());
+    state.sample_num++;
+    state.countdown = GetNextCountdown(&state);
+
+    return;
+  }
+
+  /*
+   * GetMerged() - Returns the histogram of samples of all threads, in cycles
+   */
+  inline LatencyHistogram GetMerged() const {
+    return recorder.GetMerged();
+  }
+
+  /*
+   * GetOpNum() - Returns operations run by all threads
+   */
+  uint64_t GetOpNum() const {
+    uint64_t total = 0UL;
+    for(uint64_t thread_id = 0;thread_id < GetThreadNum();thread_id++) {
+      total += state_list[thread_id].op_num;
+    }
+
+    return total;
+  }
+
+  /*
+   * GetSampleNum() - Returns operations timed by all threads
+   */
+  uint64_t GetSampleNum() const {
+    uint64_t total = 0UL;
+    for(uint64_t thread_id = 0;thread_id < GetThreadNum();thread_id++) {
+      total += state_list[thread_id].sample_num;
+    }
+
+    return total;
+  }
+
+  /*
+   * GetTimedCycles() - Returns the measured cost of a timed empty operation
+   */
+  inline double GetTimedCycles() const {
+    return timed_cycles;
+  }
+
+  /*
+   * GetUntimedCycles() - Returns the measured cost of an untimed empty
+   *                      operation
+   */
+  inline double GetUntimedCycles() const {
+    return untimed_cycles;
+  }
+
+  /*
+   * GetOverheadSeconds() - Returns the estimated CPU time all threads spent
+   *                        on sampling and timing
+   */
+  double GetOverheadSeconds() const {
+    uint64_t sample_num = GetSampleNum();
+    double cycles = sample_num * timed_cycles + \
+                    (GetOpNum() - sample_num) * untimed_cycles;
+
+    return CycleClock::CyclesToNs(static_cast<uint64_t>(cycles)) / 1e9;
+  }
+
+  /*
+   * GetOverheadRatio() - Returns the estimated fraction of the CPU time of
+   *                      a run of the given length spent on sampling
+   */
+  double GetOverheadRatio(double interval) const {
+    if(interval <= 0.0) {
+      return 0.0;
+    }
+
+    return GetOverheadSeconds() / (interval * GetThreadNum());
+  }
+
+  /*
+   * Print() - Prints the latency distribution and the estimated overhead of
+   *           a run of the given length in seconds
+   */
+  void Print(double interval) const {
+    dbg_printf("%lu of %lu operations sampled (%s 1 in %lu); "
+               "%.1f cycles per timed and %.1f cycles per untimed "
+               "operation; estimated overhead %.2f%%\n",
+               GetSampleNum(),
+               GetOpNum(),
+               randomized_flag == true ? "randomized" : "fixed",
+               sample_interval,
+               timed_cycles,
+               untimed_cycles,
+               GetOverheadRatio(interval) * 100.0);
+
+    GetMerged().Print("cycles");
+
+    return;
+  }
+};
+
+#endif
@@ -0,0 +1,413 @@
+
+#pragma once
+
+#ifndef _MPMC_QUEUE_H
+#define _MPMC_QUEUE_H
+
+#include "test_suite.h"
+
+/*
+ * class MPMCQueue - Bounded lock-free multi-producer multi-consumer queue
+ *
+ * This is Dmitry Vyukov's bounded MPMC queue. Every cell has a sequence
+ * number which tells whose turn it is: a cell at position pos is free for
+ * the producer that claims pos if sequence == pos, and holds an item for
+ * the consumer that claims pos if sequence == pos + 1. Producers and
+ * consumers claim positions with a CAS on their own counter, so they only
+ * contend with their own kind, and after claiming a position they do not
+ * wait for anybody.
+ *
+ * Batched operations claim several consecutive positions with one CAS.
+ * Before the CAS, they count how many cells from the current position are
+ * ready; since no other thread could use these cells for this lap before
+ * the position is claimed, the cells are still ready after the CAS.
+ *
+ * T must be default constructible and copy assignable
+ */
+template <typename T>
+class MPMCQueue {
+ private:
+  /*
+   * class Cell - One slot of the ring
+   */
+  class Cell {
+   public:
+    std::atomic<uint64_t> sequence;
+    T data;
+  };
+
+  // Producers write enqueue_pos and consumers write dequeue_pos; keep them
+  // a cache line apart. We use padding instead of alignas, since queues
+  // could be allocated with new, which does not respect extended alignment
+  // before C++17
+  char head_padding[CACHE_LINE_SIZE];
+  std::atomic<uint64_t> enqueue_pos;
+  char enqueue_padding[CACHE_LINE_SIZE];
+  std::atomic<uint64_t> dequeue_pos;
+  char dequeue_padding[CACHE_LINE_SIZE];
+
+  std::unique_ptr<Cell[]> cell_list;
+  uint64_t mask;
+
+  /*
+   * GetCell() - Returns the cell of a position
+   */
+  inline Cell &GetCell(uint64_t pos) const {
+    return cell_list[pos & mask];
+  }
+
+ public:
+
+  /*
+   * Constructor - Capacity is rounded up to a power of two
+   */
+  MPMCQueue(uint64_t capacity) :
+    head_padding{},
+    enqueue_pos{0UL},
+    enqueue_padding{},
+    dequeue_pos{0UL},
+    dequeue_padding{},
+    cell_list{},
+    mask{0UL} {
+    uint64_t size = 2UL;
+    while(size < capacity) {
+      size *= 2UL;
+    }
+
+    cell_list.reset(new Cell[size]);
+    mask = size - 1UL;
+
+    for(uint64_t i = 0;i < size;i++) {
+      cell_list[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    return;
+  }
+
+  MPMCQueue(const MPMCQueue &) = delete;
+  MPMCQueue &operator=(const MPMCQueue &) = delete;
+
+  /*
+   * GetCapacity() - Returns the number of cells
+   */
+  inline uint64_t GetCapacity() const {
+    return mask + 1UL;
+  }
+
+  /*
+   * Enqueue() - Appends an item; returns false if the queue is full
+   */
+  bool Enqueue(const T &item) {
+    uint64_t pos = enqueue_pos.load(std::memory_order_relaxed);
+
+    while(true) {
+      Cell &cell = GetCell(pos);
+      uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+      int64_t diff = static_cast<int64_t>(sequence - pos);
+
+      if(diff == 0) {
+        if(enqueue_pos.compare_exchange_weak(pos, pos + 1UL,
+                                             std::memory_order_relaxed)) {
+          cell.data = item;
+          cell.sequence.store(pos + 1UL, std::memory_order_release);
+
+          return true;
+        }
+      } else if(diff < 0) {
+        // The cell still holds an item of the previous lap
+        return false;
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+
+    assert(false);
+    return false;
+  }
+
+  /*
+   * Dequeue() - Removes the oldest item; returns false if the queue is empty
+   */
+  bool Dequeue(T *item_p) {
+    uint64_t pos = dequeue_pos.load(std::memory_order_relaxed);
+
+    while(true) {
+      Cell &cell = GetCell(pos);
+      uint64_t sequence = cell.sequence.load(std::memory_order_acquire);
+      int64_t diff = static_cast<int64_t>(sequence - (pos + 1UL));
+
+      if(diff == 0) {
+        if(dequeue_pos.compare_exchange_weak(pos, pos + 1UL,
+                                             std::memory_order_relaxed)) {
+          *item_p = cell.data;
+          cell.sequence.store(pos + mask + 1UL, std::memory_order_release);
+
+          return true;
+        }
+      } else if(diff < 0) {
+        // The producer of this cell has not finished
+        return false;
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+
+    assert(false);
+    return false;
+  }
+
+  /*
+   * EnqueueBatch() - Appends up to count items with one CAS
+   *
+   * Returns the number of items appended, which is less than count if the
+   * queue does not have enough free cells
+   */
+  size_t EnqueueBatch(const T *item_p, size_t count) {
+    uint64_t pos = enqueue_pos.load(std::memory_order_relaxed);
+
+    while(true) {
+      size_t ready = 0UL;
+      while(ready < count &&
+            GetCell(pos + ready).sequence.load(std::memory_order_acquire) == \
+              pos + ready) {
+        ready++;
+      }
+
+      if(ready == 0UL) {
+        uint64_t sequence = \
+          GetCell(pos).sequence.load(std::memory_order_acquire);
+        if(static_cast<int64_t>(sequence - pos) < 0) {
+          return 0UL;
+        }
+
+        // Another producer claimed pos
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+        continue;
+      }
+
+      if(enqueue_pos.compare_exchange_weak(pos, pos + ready,
+                                           std::memory_order_relaxed)) {
+        for(size_t i = 0;i < ready;i++) {
+          Cell &cell = GetCell(pos + i);
+          cell.data = item_p[i];
+          cell.sequence.store(pos + i + 1UL, std::memory_order_release);
+        }
+
+        return ready;
+      }
+    }
+
+    assert(false);
+    return 0UL;
+  }
+
+  /*
+   * DequeueBatch() - Removes up to count oldest items with one CAS
+   *
+   * Returns the number of items removed
+   */
+  size_t DequeueBatch(T *item_p, size_t count) {
+    uint64_t pos = dequeue_pos.load(std::memory_order_relaxed);
+
+    while(true) {
+      size_t ready = 0UL;
+      while(ready < count &&
+            GetCell(pos + ready).sequence.load(std::memory_order_acquire) == \
+              pos + ready + 1UL) {
+        ready++;
+      }
+
+      if(ready == 0UL) {
+        uint64_t sequence = \
+          GetCell(pos).sequence.load(std::memory_order_acquire);
+        if(static_cast<int64_t>(sequence - (pos + 1UL)) < 0) {
+          return 0UL;
+        }
+
+        // Another consumer claimed pos
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+        continue;
+      }
+
+      if(dequeue_pos.compare_exchange_weak(pos, pos + ready,
+                                           std::memory_order_relaxed)) {
+        for(size_t i = 0;i < ready;i++) {
+          Cell &cell = GetCell(pos + i);
+          item_p[i] = cell.data;
+          cell.sequence.store(pos + i + mask + 1UL,
+                              std::memory_order_release);
+        }
+
+        return ready;
+      }
+    }
+
+    assert(false);
+    return 0UL;
+  }
+};
+
+/*
+ * class ProducerConsumerReport - Items moved by each thread of a
+ *                                producer-consumer run
+ */
+class ProducerConsumerReport {
+ private:
+  uint64_t producer_num;
+  // Items produced by producers, or consumed by consumers, by thread ID
+  std::vector<uint64_t> item_num_list;
+  double interval;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  ProducerConsumerReport(uint64_t p_producer_num,
+                         const std::vector<uint64_t> &p_item_num_list,
+                         double p_interval) :
+    producer_num{p_producer_num},
+    item_num_list{p_item_num_list},
+    interval{p_interval} {
+    return;
+  }
+
+  inline uint64_t GetItemNum(uint64_t thread_id) const {
+    return item_num_list[thread_id];
+  }
+
+  inline double GetInterval() const {
+    return interval;
+  }
+
+  /*
+   * GetProducedNum() - Returns the total number of items produced
+   */
+  uint64_t GetProducedNum() const {
+    return std::accumulate(item_num_list.begin(),
+                           item_num_list.begin() + producer_num,
+                           0UL);
+  }
+
+  /*
+   * GetConsumedNum() - Returns the total number of items consumed
+   */
+  uint64_t GetConsumedNum() const {
+    return std::accumulate(item_num_list.begin() + producer_num,
+                           item_num_list.end(),
+                           0UL);
+  }
+
+  /*
+   * GetThroughput() - Returns items per second through the queue
+   */
+  inline double GetThroughput() const {
+    return GetConsumedNum() / interval;
+  }
+
+  /*
+   * Print() - Prints item counts and throughput
+   */
+  void Print() const {
+    dbg_printf("%lu producers; %lu consumers; %lu items in %f s; "
+               "%f MItems/sec\n",
+               producer_num,
+               item_num_list.size() - producer_num,
+               GetConsumedNum(),
+               interval,
+               GetThroughput() / 1e6);
+
+    return;
+  }
+};
+
+/*
+ * StartThreadsProducerConsumer() - Runs producers and consumers connected
+ *                                  by a queue on StartThreads() threads
+ *
+ * Threads [0, producer_num) are producers and the rest are consumers. A
+ * producer calls producer_fn(thread_id, item_p, batch_size), which writes
+ * up to batch_size items and returns the number written; the producer
+ * stops once it returns 0. A consumer calls consumer_fn(thread_id, item)
+ * for each item it dequeues, and stops once all producers have stopped and
+ * the queue is empty. Items are moved with batched operations; threads
+ * that find the queue full or empty back off with SpinPause()
+ */
+template <typename T, typename ProducerFn, typename ConsumerFn>
+ProducerConsumerReport StartThreadsProducerConsumer(
+  MPMCQueue<T> *queue_p,
+  uint64_t producer_num,
+  uint64_t consumer_num,
+  size_t batch_size,
+  ProducerFn &&producer_fn,
+  ConsumerFn &&consumer_fn) {
+  assert(producer_num > 0UL && consumer_num > 0UL);
+  assert(batch_size > 0UL);
+
+  uint64_t num_threads = producer_num + consumer_num;
+  PaddedArray<uint64_t> item_num_array{num_threads};
+  std::atomic<uint64_t> finished_producer_num{0UL};
+
+  Timer timer{true};
+  StartThreads(num_threads, [&](uint64_t thread_id) {
+    std::vector<T> batch(batch_size);
+    uint64_t &item_num = item_num_array[thread_id];
+
+    if(thread_id < producer_num) {
+      while(true) {
+        size_t count = producer_fn(thread_id, batch.data(), batch_size);
+        if(count == 0UL) {
+          break;
+        }
+
+        size_t sent = 0UL;
+        for(uint64_t i = 0;sent < count;i++) {
+          size_t ret = queue_p->EnqueueBatch(batch.data() + sent, count - sent);
+          if(ret == 0UL) {
+            SpinPause(i);
+          }
+
+          sent += ret;
+        }
+
+        item_num += count;
+      }
+
+      finished_producer_num.fetch_add(1UL, std::memory_order_release);
+      return;
+    }
+
+    for(uint64_t i = 0;;i++) {
+      // Read this before trying, such that an empty queue after all
+      // producers have finished is really empty
+      bool finished = \
+        finished_producer_num.load(std::memory_order_acquire) == producer_num;
+
+      size_t count = queue_p->DequeueBatch(batch.data(), batch_size);
+      for(size_t j = 0;j < count;j++) {
+        consumer_fn(thread_id, batch[j]);
+      }
+
+      item_num += count;
+
+      if(count > 0UL) {
+        i = 0;
+      } else if(finished == true) {
+        break;
+      } else {
+        SpinPause(i);
+      }
+    }
+  });
+
+  double interval = timer.Stop();
+
+  std::vector<uint64_t> item_num_list{};
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    item_num_list.push_back(item_num_array[thread_id]);
+  }
+
+  return ProducerConsumerReport{producer_num, item_num_list, interval};
+}
+
+#endif
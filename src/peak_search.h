@@ -0,0 +1,269 @@
+
+#pragma once
+
+#ifndef _PEAK_SEARCH_H
+#define _PEAK_SEARCH_H
+
+#include <iterator>
+
+#include "bench_driver.h"
+#include "trial_stats.h"
+
+/*
+ * class PeakSearch - Finds the thread count with the highest throughput
+ *                    without sweeping every thread count
+ *
+ * The search has two stages:
+ *   1. Coarse: measure 1, 2, 4, ... threads until the maximum thread count
+ *      is reached, or the throughput is significantly lower than the best
+ *      seen so far (i.e. we are past the knee and throughput has collapsed)
+ *   2. Refine: repeatedly probe the midpoints between the best point and its
+ *      nearest measured neighbors on both sides, until the neighbors are
+ *      within the resolution of the best point
+ *
+ * Each point is measured at least min_repeat times, and more (up to
+ * max_repeat) until the 95% confidence interval of the mean is within
+ * tolerance of the mean. Two points are only considered different if their
+ * confidence intervals do not overlap; otherwise we prefer the smaller
+ * thread count.
+ */
+class PeakSearch {
+ public:
+  /*
+   * class Point - Measurements at one thread count
+   */
+  class Point {
+   public:
+    uint64_t thread_num;
+    std::vector<double> sample_list;
+    // Mean throughput in ops/sec and the half width of its 95% CI
+    double mean;
+    double half_width;
+  };
+
+ private:
+  uint64_t max_thread_num;
+  double tolerance;
+  uint64_t min_repeat;
+  uint64_t max_repeat;
+  uint64_t resolution;
+
+  // All measured points sorted by thread count
+  std::map<uint64_t, Point> point_map;
+
+  // The best point found so far
+  uint64_t best_thread_num;
+
+  /*
+   * UpdateStat() - Recomputes mean and confidence interval of a point
+   */
+  static void UpdateStat(Point *point_p) {
+    const std::vector<double> &sample_list = point_p->sample_list;
+
+    point_p->mean = TrialStats::GetMean(sample_list);
+    point_p->half_width = \
+      TrialStats::GetStudentT95(sample_list.size() - 1UL) * \
+      TrialStats::GetStddev(sample_list) / std::sqrt(sample_list.size());
+
+    return;
+  }
+
+  /*
+   * Measure() - Measures a thread count until it is stable, or returns the
+   *             cached result
+   */
+  template <typename Fn>
+  const Point &Measure(uint64_t thread_num, Fn &fn) {
+    auto it = point_map.find(thread_num);
+    if(it != point_map.end()) {
+      return it->second;
+    }
+
+    Point &point = point_map[thread_num];
+    point.thread_num = thread_num;
+
+    while(point.sample_list.size() < max_repeat) {
+      point.sample_list.push_back(fn(thread_num));
+      UpdateStat(&point);
+
+      if(point.sample_list.size() >= min_repeat &&
+         point.half_width <= tolerance * point.mean) {
+        break;
+      }
+    }
+
+    dbg_printf("%lu threads: %f MOps/sec +/- %.2f%% (%lu runs)\n",
+               thread_num,
+               point.mean / 1e6,
+               point.mean > 0.0 ? point.half_width / point.mean * 100.0 : 0.0,
+               point.sample_list.size());
+
+    return point;
+  }
+
+  /*
+   * IsBetter() - Returns true if point a is significantly better than b
+   */
+  static bool IsBetter(const Point &a, const Point &b) {
+    return a.mean - a.half_width > b.mean + b.half_width;
+  }
+
+  /*
+   * Offer() - Makes a point the best one if it is better, or if it is not
+   *           worse and uses fewer threads
+   */
+  void Offer(const Point &point) {
+    const Point &best = point_map[best_thread_num];
+    if(IsBetter(point, best) == true) {
+      best_thread_num = point.thread_num;
+    } else if(IsBetter(best, point) == false &&
+              point.thread_num < best_thread_num) {
+      best_thread_num = point.thread_num;
+    }
+
+    return;
+  }
+
+ public:
+
+  /*
+   * Constructor
+   */
+  PeakSearch(uint64_t p_max_thread_num = GetCoreNum(),
+             double p_tolerance = 0.05,
+             uint64_t p_min_repeat = 3UL,
+             uint64_t p_max_repeat = 10UL,
+             uint64_t p_resolution = 1UL) :
+    max_thread_num{p_max_thread_num},
+    tolerance{p_tolerance},
+    min_repeat{p_min_repeat},
+    max_repeat{p_max_repeat},
+    resolution{p_resolution},
+    point_map{},
+    best_thread_num{1UL} {
+    assert(max_thread_num > 0UL);
+    assert(min_repeat > 0UL && min_repeat <= max_repeat);
+    assert(resolution > 0UL);
+
+    return;
+  }
+
+  /*
+   * Run() - Searches for the optimal thread count and returns it
+   *
+   * fn is called as fn(num_threads) and returns the throughput in ops/sec
+   * of one run at that thread count
+   */
+  template <typename Fn>
+  uint64_t Run(Fn &&fn) {
+    point_map.clear();
+    best_thread_num = 1UL;
+
+    // Coarse stage
+    Measure(1UL, fn);
+    for(uint64_t thread_num = 2UL;;thread_num *= 2UL) {
+      thread_num = std::min(thread_num, max_thread_num);
+      if(thread_num == 1UL) {
+        break;
+      }
+
+      const Point &point = Measure(thread_num, fn);
+      bool collapsed = IsBetter(point_map[best_thread_num], point);
+      Offer(point);
+
+      if(collapsed == true || thread_num == max_thread_num) {
+        break;
+      }
+    }
+
+    // Refine stage. Each iteration probes at most one point on each side
+    // of the best one and stops once there is nothing left to probe
+    while(true) {
+      auto it = point_map.find(best_thread_num);
+      std::vector<uint64_t> probe_list{};
+
+      if(it != point_map.begin()) {
+        uint64_t left = std::prev(it)->first;
+        if(best_thread_num - left > resolution) {
+          probe_list.push_back(left + (best_thread_num - left) / 2UL);
+        }
+      }
+
+      if(std::next(it) != point_map.end()) {
+        uint64_t right = std::next(it)->first;
+        if(right - best_thread_num > resolution) {
+          probe_list.push_back(best_thread_num + 
+                               (right - best_thread_num) / 2UL);
+        }
+      }
+
+      if(probe_list.size() == 0UL) {
+        break;
+      }
+
+      for(uint64_t thread_num : probe_list) {
+        Offer(Measure(thread_num, fn));
+      }
+    }
+
+    return best_thread_num;
+  }
+
+  /*
+   * RunForDuration() - Searches using ::RunForDuration() with a
+   *                    per-operation functor, called as op_fn(thread_id)
+   */
+  template <typename Fn>
+  uint64_t RunForDuration(double seconds, Fn &&op_fn) {
+    return Run([seconds, &op_fn](uint64_t num_threads) {
+      return ::RunForDuration(num_threads, seconds, op_fn).GetThroughput();
+    });
+  }
+
+  /*
+   * GetOptimum() - Returns the thread count with the highest throughput
+   */
+  inline uint64_t GetOptimum() const {
+    return best_thread_num;
+  }
+
+  /*
+   * GetPeakThroughput() - Returns the mean throughput at the optimum
+   */
+  double GetPeakThroughput() const {
+    return point_map.at(best_thread_num).mean;
+  }
+
+  /*
+   * GetCurve() - Returns all measured points sorted by thread count
+   */
+  std::vector<Point> GetCurve() const {
+    std::vector<Point> curve{};
+    for(const auto &item : point_map) {
+      curve.push_back(item.second);
+    }
+
+    return curve;
+  }
+
+  /*
+   * Print() - Prints the sampled curve and the optimum
+   */
+  void Print() const {
+    for(const auto &item : point_map) {
+      dbg_printf("%c %3lu threads: %f MOps/sec +/- %f\n",
+                 item.first == best_thread_num ? '*' : ' ',
+                 item.first,
+                 item.second.mean / 1e6,
+                 item.second.half_width / 1e6);
+    }
+
+    dbg_printf("Optimum: %lu threads (%lu points measured)\n",
+               best_thread_num,
+               point_map.size());
+
+    return;
+  }
+};
+
+#endif
@@ -1162,6 +1162,20 @@ class BarChart {
     return;
   }
 
+  /*
+   * GetGroupCount() - Returns the number of bar groups appended so far
+   */
+  inline size_t GetGroupCount() const {
+    return group_list.size();
+  }
+
+  /*
+   * GetBarNameCount() - Returns the number of bar names appended so far
+   */
+  inline size_t GetBarNameCount() const {
+    return bar_name_list.size();
+  }
+
   /*
    * AppendError() - Appends a list of errors into the last bar group
    * 
@@ -1584,7 +1598,7 @@ class LineChart {
    the nearest .5 and then returned
    */
   double GetYUpperLimit() {
-    double max;
+    double max = 0.0;
     bool first_time = true;
     
     // For every point in every line compute the maximum
@@ -1605,7 +1619,7 @@ class LineChart {
     max *= param.y_limit_ratio;
     
     // And then round to the nearest 0.5
-    return 20.0;//RoundUpToPoint5(max);
+    return RoundUpToPoint5(max);
   }
   
   /*
@@ -1727,10 +1741,17 @@ class LineChart {
   template <typename T>
   void AppendXValue(T value) {
     x_list.push_back(static_cast<double>(value));
-    
-    return; 
+
+    return;
   }
-  
+
+  /*
+   * GetXValueCount() - Returns the number of X values appended so far
+   */
+  inline size_t GetXValueCount() const {
+    return x_list.size();
+  }
+
   /*
    * AppendYValueList() - This function appends a new array into Y list
    *
@@ -1925,7 +1946,14 @@ class LineChart {
     }
 
 
-    buffer.Append("ax.set_xlim(0, 21)\n");
+    // Leave 5% of space after the last X value, which is one unit for
+    // thread counts up to 20, and still works for fractional X values
+    if(x_list.size() == 0UL) {
+      buffer.Append("ax.set_xlim(0, 21)\n");
+    } else {
+      double x_upper_limit = *std::max_element(x_list.begin(), x_list.end());
+      buffer.Printf("ax.set_xlim(0, %f)\n", x_upper_limit * 1.05);
+    }
 
     // If we need to draw grid as the background then just set the grids
     if(draw_x_grid_flag == true) {
@@ -0,0 +1,455 @@
+
+#pragma once
+
+#ifndef _PRNG_H
+#define _PRNG_H
+
+#include <cstdint>
+#include <cassert>
+#include <limits>
+#include <random>
+#include <thread>
+#include <functional>
+
+#include "common.h"
+
+/*
+ * This file defines small, fast pseudo random number generators for
+ * benchmarks:
+ *
+ *   SplitMix64         - 64 bit state; used to seed the others
+ *   Xoshiro256StarStar - 256 bit state; the default (FastRandom)
+ *   PCG64              - 128 bit LCG with a permuted output
+ *
+ * None of them is thread-safe, and none shares any state, so each thread
+ * should own its generator. GetStream(i) returns a copy of a generator that
+ * has jumped ahead i times, such that threads seeded from one master seed
+ * draw from non-overlapping parts of the sequence and a run could be
+ * reproduced from that seed:
+ *
+ *   FastRandom master{seed};
+ *   StartThreads(num_threads, [&](uint64_t thread_id) {
+ *     FastRandom rand = master.GetStream(thread_id);
+ *     ...
+ *   });
+ *
+ * All generators meet the UniformRandomBitGenerator requirements, so they
+ * also work with std::shuffle() and std distributions.
+ */
+
+/*
+ * RotateLeft() - Rotates a 64 bit value
+ */
+inline uint64_t RotateLeft(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+/*
+ * GetBoundedRandom() - Returns a value uniformly in [0, range) drawn from a
+ *                      64 bit generator
+ *
+ * This is Lemire's multiply-shift method: the high half of x * range is in
+ * [0, range), and the low half tells whether x falls into the few values
+ * that would make some results more likely than others, in which case x
+ * is drawn again. The threshold needs a division, but only when the low
+ * half is below range, which for small ranges almost never happens.
+ *
+ * range == 0 means the whole 64 bit range
+ */
+template <typename Engine>
+inline uint64_t GetBoundedRandom(Engine *engine_p, uint64_t range) {
+  uint64_t x = (*engine_p)();
+  if(unlikely(range == 0UL)) {
+    return x;
+  }
+
+  unsigned __int128 m = static_cast<unsigned __int128>(x) * range;
+  uint64_t low = static_cast<uint64_t>(m);
+  if(unlikely(low < range)) {
+    // 2^64 mod range
+    uint64_t threshold = (0UL - range) % range;
+    while(low < threshold) {
+      x = (*engine_p)();
+      m = static_cast<unsigned __int128>(x) * range;
+      low = static_cast<uint64_t>(m);
+    }
+  }
+
+  return static_cast<uint64_t>(m >> 64);
+}
+
+/*
+ * GetRandomDouble() - Returns a double uniformly in [0, 1) from the high
+ *                     53 bits of a 64 bit value
+ */
+inline double GetRandomDouble(uint64_t x) {
+  return (x >> 11) * (1.0 / (1UL << 53));
+}
+
+/*
+ * class SplitMix64 - Weyl sequence with a 64 bit mixing function
+ *
+ * Every seed, including 0, gives a good sequence, which is why it is used
+ * to expand one 64 bit seed into the larger state of other generators
+ */
+class SplitMix64 {
+ public:
+  using result_type = uint64_t;
+
+ private:
+  uint64_t state;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  SplitMix64(uint64_t seed) :
+    state{seed} {
+    return;
+  }
+
+  static constexpr uint64_t min() {
+    return 0UL;
+  }
+
+  static constexpr uint64_t max() {
+    return UINT64_MAX;
+  }
+
+  /*
+   * Next() - Returns the next 64 bit value
+   */
+  inline uint64_t Next() {
+    uint64_t z = (state += 0x9E3779B97F4A7C15UL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9UL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBUL;
+
+    return z ^ (z >> 31);
+  }
+
+  inline uint64_t operator()() {
+    return Next();
+  }
+
+  /*
+   * GetBounded() - Returns a value uniformly in [0, range)
+   */
+  inline uint64_t GetBounded(uint64_t range) {
+    return GetBoundedRandom(this, range);
+  }
+};
+
+/*
+ * class Xoshiro256StarStar - xoshiro256** by Blackman and Vigna
+ *
+ * The period is 2^256 - 1. Jump() advances the state by 2^128 values and
+ * LongJump() by 2^192, so up to 2^64 streams of 2^128 values each (or
+ * 2^64 groups of 2^64 such streams) never overlap
+ */
+class Xoshiro256StarStar {
+ public:
+  using result_type = uint64_t;
+
+ private:
+  uint64_t state[4];
+
+  /*
+   * JumpBy() - Advances the state by the polynomial in the table
+   */
+  void JumpBy(const uint64_t (&table)[4]) {
+    uint64_t s[4] = {0UL, 0UL, 0UL, 0UL};
+    for(int i = 0;i < 4;i++) {
+      for(int bit = 0;bit < 64;bit++) {
+        if((table[i] & (1UL << bit)) != 0UL) {
+          for(int j = 0;j < 4;j++) {
+            s[j] ^= state[j];
+          }
+        }
+
+        Next();
+      }
+    }
+
+    for(int j = 0;j < 4;j++) {
+      state[j] = s[j];
+    }
+
+    return;
+  }
+
+ public:
+
+  /*
+   * Constructor - Expands the seed with SplitMix64, as the state must not be
+   *               all zero
+   */
+  Xoshiro256StarStar(uint64_t seed) {
+    SplitMix64 seeder{seed};
+    for(int i = 0;i < 4;i++) {
+      state[i] = seeder.Next();
+    }
+
+    return;
+  }
+
+  /*
+   * Constructor - Sets the state directly; it must not be all zero
+   */
+  Xoshiro256StarStar(uint64_t s0, uint64_t s1, uint64_t s2, uint64_t s3) :
+    state{s0, s1, s2, s3} {
+    assert((s0 | s1 | s2 | s3) != 0UL);
+
+    return;
+  }
+
+  static constexpr uint64_t min() {
+    return 0UL;
+  }
+
+  static constexpr uint64_t max() {
+    return UINT64_MAX;
+  }
+
+  /*
+   * Next() - Returns the next 64 bit value
+   */
+  inline uint64_t Next() {
+    uint64_t result = RotateLeft(state[1] * 5UL, 7) * 9UL;
+    uint64_t t = state[1] << 17;
+
+    state[2] ^= state[0];
+    state[3] ^= state[1];
+    state[1] ^= state[2];
+    state[0] ^= state[3];
+    state[2] ^= t;
+    state[3] = RotateLeft(state[3], 45);
+
+    return result;
+  }
+
+  inline uint64_t operator()() {
+    return Next();
+  }
+
+  /*
+   * GetBounded() - Returns a value uniformly in [0, range)
+   */
+  inline uint64_t GetBounded(uint64_t range) {
+    return GetBoundedRandom(this, range);
+  }
+
+  /*
+   * GetDouble() - Returns a double uniformly in [0, 1)
+   */
+  inline double GetDouble() {
+    return GetRandomDouble(Next());
+  }
+
+  /*
+   * Jump() - Advances by 2^128 values
+   */
+  void Jump() {
+    static const uint64_t JUMP[4] = {
+      0x180EC6D33CFD0ABAUL, 0xD5A61266F0C9392CUL,
+      0xA9582618E03FC9AAUL, 0x39ABDC4529B1661CUL};
+    JumpBy(JUMP);
+
+    return;
+  }
+
+  /*
+   * LongJump() - Advances by 2^192 values
+   */
+  void LongJump() {
+    static const uint64_t LONG_JUMP[4] = {
+      0x76E15D3EFEFDCBBFUL, 0xC5004E441C522FB3UL,
+      0x77710069854EE241UL, 0x39109BB02ACBE635UL};
+    JumpBy(LONG_JUMP);
+
+    return;
+  }
+
+  /*
+   * GetStream() - Returns a copy that has jumped stream_id times
+   */
+  Xoshiro256StarStar GetStream(uint64_t stream_id) const {
+    Xoshiro256StarStar ret = *this;
+    for(uint64_t i = 0;i < stream_id;i++) {
+      ret.Jump();
+    }
+
+    return ret;
+  }
+};
+
+/*
+ * class PCG64 - PCG XSL RR 128/64 by O'Neill
+ *
+ * The state is a 128 bit LCG and the output is the xor of its halves,
+ * rotated by its top 6 bits. An LCG could advance by any distance in
+ * O(log distance) steps, so Jump() advances by 2^64 values and LongJump()
+ * by 2^96 (the period is 2^128). Different increments also give different
+ * sequences, which the two argument constructor uses
+ */
+class PCG64 {
+ public:
+  using result_type = uint64_t;
+
+ private:
+  unsigned __int128 state;
+  unsigned __int128 increment;
+
+  static constexpr unsigned __int128 MULTIPLIER = \
+    (static_cast<unsigned __int128>(0x2360ED051FC65DA4UL) << 64) | \
+    0x4385DF649FCCF645UL;
+
+  inline void Step() {
+    state = state * MULTIPLIER + increment;
+
+    return;
+  }
+
+ public:
+
+  /*
+   * Constructor - Seeds the state and chooses a sequence, as pcg64 in the
+   *               reference implementation does
+   */
+  PCG64(unsigned __int128 seed, unsigned __int128 sequence) :
+    state{0},
+    increment{(sequence << 1) | 1U} {
+    Step();
+    state += seed;
+    Step();
+
+    return;
+  }
+
+  /*
+   * Constructor - Expands a 64 bit seed with SplitMix64
+   */
+  PCG64(uint64_t seed) :
+    PCG64{0, 0} {
+    SplitMix64 seeder{seed};
+    unsigned __int128 s = seeder.Next();
+    s = (s << 64) | seeder.Next();
+    unsigned __int128 seq = seeder.Next();
+    seq = (seq << 64) | seeder.Next();
+    *this = PCG64{s, seq};
+
+    return;
+  }
+
+  static constexpr uint64_t min() {
+    return 0UL;
+  }
+
+  static constexpr uint64_t max() {
+    return UINT64_MAX;
+  }
+
+  /*
+   * Next() - Returns the next 64 bit value
+   */
+  inline uint64_t Next() {
+    Step();
+    uint64_t xsl = static_cast<uint64_t>(state >> 64) ^ \
+                   static_cast<uint64_t>(state);
+    int rot = static_cast<int>(state >> 122);
+
+    return (xsl >> rot) | (xsl << ((64 - rot) & 63));
+  }
+
+  inline uint64_t operator()() {
+    return Next();
+  }
+
+  /*
+   * GetBounded() - Returns a value uniformly in [0, range)
+   */
+  inline uint64_t GetBounded(uint64_t range) {
+    return GetBoundedRandom(this, range);
+  }
+
+  /*
+   * GetDouble() - Returns a double uniformly in [0, 1)
+   */
+  inline double GetDouble() {
+    return GetRandomDouble(Next());
+  }
+
+  /*
+   * Advance() - Advances by delta values, by composing the LCG step with
+   *             itself for each bit of delta
+   */
+  void Advance(unsigned __int128 delta) {
+    unsigned __int128 acc_mult = 1U;
+    unsigned __int128 acc_plus = 0U;
+    unsigned __int128 cur_mult = MULTIPLIER;
+    unsigned __int128 cur_plus = increment;
+    while(delta > 0U) {
+      if((delta & 1U) != 0U) {
+        acc_mult *= cur_mult;
+        acc_plus = acc_plus * cur_mult + cur_plus;
+      }
+
+      cur_plus = (cur_mult + 1U) * cur_plus;
+      cur_mult *= cur_mult;
+      delta >>= 1;
+    }
+
+    state = acc_mult * state + acc_plus;
+
+    return;
+  }
+
+  /*
+   * Jump() - Advances by 2^64 values
+   */
+  void Jump() {
+    Advance(static_cast<unsigned __int128>(1U) << 64);
+
+    return;
+  }
+
+  /*
+   * LongJump() - Advances by 2^96 values
+   */
+  void LongJump() {
+    Advance(static_cast<unsigned __int128>(1U) << 96);
+
+    return;
+  }
+
+  /*
+   * GetStream() - Returns a copy that has jumped stream_id times
+   */
+  PCG64 GetStream(uint64_t stream_id) const {
+    PCG64 ret = *this;
+    ret.Advance(static_cast<unsigned __int128>(stream_id) << 64);
+
+    return ret;
+  }
+};
+
+// The generator used when there is no reason to choose
+using FastRandom = Xoshiro256StarStar;
+
+/*
+ * GetRandomSeed() - Returns a seed that is different on every call
+ *
+ * Each thread reads std::random_device once and then draws from its own
+ * SplitMix64, so this is cheap and does not touch shared state after the
+ * first call on a thread
+ */
+inline uint64_t GetRandomSeed() {
+  static thread_local SplitMix64 seeder{
+    (static_cast<uint64_t>(std::random_device{}()) << 32) ^ \
+    std::random_device{}() ^ \
+    std::hash<std::thread::id>{}(std::this_thread::get_id())};
+
+  return seeder.Next();
+}
+
+#endif
@@ -0,0 +1,530 @@
+
+#pragma once
+
+#ifndef _RESULT_STORE_H
+#define _RESULT_STORE_H
+
+#include <fstream>
+#include <sstream>
+#include <sys/utsname.h>
+
+#include "trial_stats.h"
+
+/*
+ * class ResultRecord - Samples of one benchmark run, and what they were
+ *                      measured on
+ */
+class ResultRecord {
+ public:
+  std::string name;
+  // Parameters of the run, e.g. "threads=8,keys=1M"
+  std::string params;
+  std::string git_rev;
+  std::string machine;
+  // Seconds since the epoch
+  uint64_t timestamp;
+  std::vector<double> sample_list;
+  // Set if RegressionGate found the samples to be a regression; such
+  // records are kept for reference but are never a baseline
+  bool regression_flag;
+};
+
+/*
+ * class ResultStore - Append-only file of benchmark results
+ *
+ * Every record is one line of tab separated fields:
+ *
+ *   name  params  git revision  machine  timestamp  v1,v2,...  pass|fail
+ *
+ * Records are only ever appended, so the file could be kept between runs
+ * (or in CI cache) and still tells which revision produced which numbers.
+ * A baseline is the newest passing record with the same name and params,
+ * measured on the same machine, by another revision (or by an explicitly
+ * chosen revision); numbers from different machines are never compared,
+ * and a regression never becomes the baseline of the next run. Lines
+ * without the last field are from older versions and count as passing.
+ *
+ * The revision is taken from the environment variable RESULT_STORE_GIT_REV
+ * if it is set (CI usually checks out without .git), and from
+ * "git rev-parse HEAD" otherwise
+ */
+class ResultStore {
+ private:
+  std::string path;
+
+  /*
+   * Sanitize() - Replaces field and record separators in a field
+   */
+  static std::string Sanitize(const std::string &field) {
+    std::string ret = field;
+    for(char &c : ret) {
+      if(c == '\t' || c == '\n' || c == '\r') {
+        c = ' ';
+      }
+    }
+
+    return ret;
+  }
+
+  /*
+   * Split() - Splits a line by a separator
+   */
+  static std::vector<std::string> Split(const std::string &line, char sep) {
+    std::vector<std::string> field_list{};
+    std::string field{};
+    std::istringstream stream{line};
+    while(std::getline(stream, field, sep)) {
+      field_list.push_back(field);
+    }
+
+    // getline() drops a trailing empty field
+    if(line.empty() == false && line.back() == sep) {
+      field_list.push_back("");
+    }
+
+    return field_list;
+  }
+
+  /*
+   * ParseRecord() - Parses a line; returns false if it is malformed
+   */
+  static bool ParseRecord(const std::string &line, ResultRecord *record_p) {
+    std::vector<std::string> field_list = Split(line, '\t');
+    if(field_list.size() != 6UL && field_list.size() != 7UL) {
+      return false;
+    }
+
+    record_p->name = field_list[0];
+    record_p->params = field_list[1];
+    record_p->git_rev = field_list[2];
+    record_p->machine = field_list[3];
+
+    char *end_p = nullptr;
+    record_p->timestamp = strtoull(field_list[4].c_str(), &end_p, 10);
+    if(*end_p != '\0') {
+      return false;
+    }
+
+    record_p->sample_list.clear();
+    for(const std::string &value : Split(field_list[5], ',')) {
+      double sample = strtod(value.c_str(), &end_p);
+      if(value.empty() == true || *end_p != '\0') {
+        return false;
+      }
+
+      record_p->sample_list.push_back(sample);
+    }
+
+    record_p->regression_flag = false;
+    if(field_list.size() == 7UL) {
+      if(field_list[6] == "fail") {
+        record_p->regression_flag = true;
+      } else if(field_list[6] != "pass") {
+        return false;
+      }
+    }
+
+    return record_p->sample_list.empty() == false;
+  }
+
+ public:
+
+  /*
+   * Constructor - The file is created on the first Append()
+   */
+  ResultStore(const std::string &p_path) :
+    path{p_path} {
+    return;
+  }
+
+  inline const std::string &GetPath() const {
+    return path;
+  }
+
+  /*
+   * GetGitRevision() - Returns the revision being measured, or "unknown"
+   */
+  static std::string GetGitRevision() {
+    const char *env_p = getenv("RESULT_STORE_GIT_REV");
+    if(env_p != nullptr && env_p[0] != '\0') {
+      return Sanitize(env_p);
+    }
+
+    FILE *fp = popen("git rev-parse HEAD 2>/dev/null", "r");
+    if(fp == nullptr) {
+      return "unknown";
+    }
+
+    char buffer[128];
+    std::string rev{};
+    if(fgets(buffer, sizeof(buffer), fp) != nullptr) {
+      rev = buffer;
+    }
+
+    pclose(fp);
+
+    while(rev.empty() == false && isspace(rev.back())) {
+      rev.pop_back();
+    }
+
+    return rev.empty() == true ? "unknown" : Sanitize(rev);
+  }
+
+  /*
+   * GetMachineFingerprint() - Returns the CPU model, the number of cores
+   *                           and the kernel, e.g.
+   *                           "Intel(R) Xeon(R) Gold 6148 / 40 cores / 5.15.0"
+   */
+  static std::string GetMachineFingerprint() {
+    std::string model = "unknown CPU";
+    std::ifstream cpuinfo{"/proc/cpuinfo"};
+    std::string line{};
+    while(std::getline(cpuinfo, line)) {
+      if(line.compare(0, 10, "model name") == 0) {
+        size_t pos = line.find(':');
+        if(pos != std::string::npos) {
+          model = line.substr(line.find_first_not_of(' ', pos + 1));
+        }
+
+        break;
+      }
+    }
+
+    std::string kernel = "unknown kernel";
+    struct utsname name;
+    if(uname(&name) == 0) {
+      kernel = name.release;
+    }
+
+    return Sanitize(model + " / " + std::to_string(GetCoreNum()) + \
+                    " cores / " + kernel);
+  }
+
+  /*
+   * Append() - Appends a record; exits if the file could not be written
+   */
+  void Append(const ResultRecord &record) {
+    assert(record.sample_list.empty() == false);
+
+    std::string line = Sanitize(record.name) + "\t" + \
+                       Sanitize(record.params) + "\t" + \
+                       Sanitize(record.git_rev) + "\t" + \
+                       Sanitize(record.machine) + "\t" + \
+                       std::to_string(record.timestamp) + "\t";
+    for(size_t i = 0;i < record.sample_list.size();i++) {
+      char buffer[64];
+      snprintf(buffer, sizeof(buffer), "%s%.17g",
+               i == 0UL ? "" : ",",
+               record.sample_list[i]);
+      line += buffer;
+    }
+
+    line += record.regression_flag == true ? "\tfail\n" : "\tpass\n";
+
+    // The whole line is written at once in append mode, such that runs
+    // sharing the file do not interleave short lines
+    FILE *fp = fopen(path.c_str(), "a");
+    if(fp == nullptr || \
+       fwrite(line.data(), 1, line.size(), fp) != line.size()) {
+      fprintf(stderr, "ERROR: Could not append to %s\n", path.c_str());
+      exit(1);
+    }
+
+    fclose(fp);
+
+    return;
+  }
+
+  /*
+   * Append() - Appends samples of the current revision on this machine
+   */
+  void Append(const std::string &name,
+              const std::string &params,
+              const std::vector<double> &sample_list) {
+    Append(ResultRecord{name,
+                        params,
+                        GetGitRevision(),
+                        GetMachineFingerprint(),
+                        static_cast<uint64_t>(time(nullptr)),
+                        sample_list,
+                        false});
+
+    return;
+  }
+
+  /*
+   * Load() - Returns all records in the order they were appended
+   *
+   * A missing file has no records; malformed lines (e.g. one cut short by a
+   * crash) are skipped
+   */
+  std::vector<ResultRecord> Load() const {
+    std::vector<ResultRecord> record_list{};
+    std::ifstream file{path};
+    std::string line{};
+    while(std::getline(file, line)) {
+      ResultRecord record{};
+      if(ParseRecord(line, &record) == true) {
+        record_list.push_back(record);
+      }
+    }
+
+    return record_list;
+  }
+
+  /*
+   * FindBaseline() - Finds the newest passing record of name and params on a
+   *                  machine that was not measured with git_rev
+   *
+   * If baseline_rev is not empty only records of that revision are
+   * considered. If git_rev is "unknown" (no repository and no
+   * RESULT_STORE_GIT_REV) revisions cannot tell runs apart, so the newest
+   * passing record is used whatever its revision; otherwise every record
+   * would be excluded and nothing would ever be compared. Returns false if
+   * there is none
+   */
+  bool FindBaseline(const std::string &name,
+                    const std::string &params,
+                    const std::string &machine,
+                    const std::string &git_rev,
+                    ResultRecord *record_p,
+                    const std::string &baseline_rev = "") const {
+    bool known_rev = (Sanitize(git_rev) != "unknown");
+
+    std::vector<ResultRecord> record_list = Load();
+    for(auto it = record_list.rbegin();it != record_list.rend();it++) {
+      if(it->name == Sanitize(name) && \
+         it->params == Sanitize(params) && \
+         it->machine == Sanitize(machine) && \
+         (known_rev == false || it->git_rev != Sanitize(git_rev)) && \
+         (baseline_rev.empty() == true || \
+          it->git_rev == Sanitize(baseline_rev)) && \
+         it->regression_flag == false) {
+        *record_p = *it;
+        return true;
+      }
+    }
+
+    return false;
+  }
+};
+
+/*
+ * class RegressionGate - Compares benchmark results with their baselines and
+ *                        decides whether a change could be merged
+ *
+ * A result is a regression if both:
+ *   (1) its median is worse than the baseline median by more than
+ *       threshold (e.g. 0.05 for 5%), and
+ *   (2) a one-sided Mann-Whitney U test says the samples are worse than
+ *       the baseline samples with p-value below alpha.
+ * (1) ignores differences too small to matter, and (2) ignores differences
+ * that noise could explain, so a gate on a noisy machine needs more trials
+ * rather than a larger threshold.
+ *
+ * Results are stored whether or not they pass, but regressions are marked
+ * and never become a baseline. The baseline could also be pinned to one
+ * revision (e.g. the merge base of a pull request) with
+ * SetBaselineRevision() or the environment variable
+ * RESULT_STORE_BASELINE_REV.
+ *
+ * Usage, at the end of a benchmark's main():
+ *   ResultStore store{"results.tsv"};
+ *   RegressionGate gate{&store, 0.05};
+ *   gate.Check("BwTree Insert", "threads=8", throughput_list);
+ *   ...
+ *   gate.Print();
+ *   return gate.GetExitCode();
+ */
+class RegressionGate {
+ public:
+  static constexpr double DEFAULT_THRESHOLD = 0.05;
+  static constexpr double DEFAULT_ALPHA = 0.01;
+
+  /*
+   * class Result - Comparison of one benchmark with its baseline
+   */
+  class Result {
+   public:
+    std::string name;
+    std::string params;
+    // Empty if there is no baseline
+    std::string baseline_rev;
+    double baseline_median;
+    double current_median;
+    // Relative change of the median, positive if better
+    double change;
+    double p_value;
+    bool regression_flag;
+  };
+
+ private:
+  ResultStore *store_p;
+  double threshold;
+  double alpha;
+  std::string git_rev;
+  // Empty to compare with the newest passing revision
+  std::string baseline_rev;
+  std::string machine;
+
+  std::vector<Result> result_list;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  RegressionGate(ResultStore *p_store_p,
+                 double p_threshold = DEFAULT_THRESHOLD,
+                 double p_alpha = DEFAULT_ALPHA) :
+    store_p{p_store_p},
+    threshold{p_threshold},
+    alpha{p_alpha},
+    git_rev{ResultStore::GetGitRevision()},
+    baseline_rev{getenv("RESULT_STORE_BASELINE_REV") == nullptr ? \
+                 "" : getenv("RESULT_STORE_BASELINE_REV")},
+    machine{ResultStore::GetMachineFingerprint()},
+    result_list{} {
+    assert(threshold >= 0.0);
+    assert(alpha > 0.0 && alpha < 1.0);
+
+    return;
+  }
+
+  /*
+   * SetGitRevision() - Sets the revision results are recorded with
+   */
+  void SetGitRevision(const std::string &p_git_rev) {
+    git_rev = p_git_rev;
+
+    return;
+  }
+
+  /*
+   * SetBaselineRevision() - Compares only with results of one revision, or
+   *                         with the newest passing one if empty
+   */
+  void SetBaselineRevision(const std::string &p_baseline_rev) {
+    baseline_rev = p_baseline_rev;
+
+    return;
+  }
+
+  /*
+   * Check() - Compares samples with the baseline, appends them to the store
+   *           and returns the comparison
+   *
+   * higher_is_better is true for throughput and false for latency. Without
+   * a baseline the samples are only stored and it is not a regression.
+   * Samples of a regression are stored as failed
+   */
+  Result Check(const std::string &name,
+                const std::string &params,
+                const std::vector<double> &sample_list,
+                bool higher_is_better = true) {
+    assert(sample_list.empty() == false);
+
+    Result result{name, params, "", 0.0, TrialStats::GetMedian(sample_list),
+                  0.0, 1.0, false};
+
+    ResultRecord baseline{};
+    if(store_p->FindBaseline(name,
+                             params,
+                             machine,
+                             git_rev,
+                             &baseline,
+                             baseline_rev) == true) {
+      result.baseline_rev = baseline.git_rev;
+      result.baseline_median = TrialStats::GetMedian(baseline.sample_list);
+
+      if(result.baseline_median != 0.0) {
+        result.change = \
+          (result.current_median - result.baseline_median) / \
+          std::abs(result.baseline_median);
+        if(higher_is_better == false) {
+          result.change = -result.change;
+        }
+      }
+
+      MannWhitneyTest test{sample_list, baseline.sample_list};
+      result.p_value = higher_is_better == true ? \
+        test.GetPValueLess() : test.GetPValueGreater();
+      result.regression_flag = \
+        (result.change < -threshold && result.p_value < alpha);
+    }
+
+    store_p->Append(ResultRecord{name,
+                                 params,
+                                 git_rev,
+                                 machine,
+                                 static_cast<uint64_t>(time(nullptr)),
+                                 sample_list,
+                                 result.regression_flag});
+
+    result_list.push_back(result);
+
+    return result;
+  }
+
+  inline const std::vector<Result> &GetResultList() const {
+    return result_list;
+  }
+
+  /*
+   * GetRegressionNum() - Returns the number of regressions found
+   */
+  size_t GetRegressionNum() const {
+    size_t count = 0UL;
+    for(const Result &result : result_list) {
+      if(result.regression_flag == true) {
+        count++;
+      }
+    }
+
+    return count;
+  }
+
+  /*
+   * GetExitCode() - Returns 1 if any check is a regression, and 0 otherwise
+   */
+  inline int GetExitCode() const {
+    return GetRegressionNum() == 0UL ? 0 : 1;
+  }
+
+  /*
+   * Print() - Prints every comparison and a summary
+   */
+  void Print() const {
+    dbg_printf("Revision %s on %s\n", git_rev.c_str(), machine.c_str());
+    for(const Result &result : result_list) {
+      if(result.baseline_rev.empty() == true) {
+        dbg_printf("%s [%s]: median %f; no baseline\n",
+                   result.name.c_str(),
+                   result.params.c_str(),
+                   result.current_median);
+        continue;
+      }
+
+      dbg_printf("%s [%s]: median %f vs %f (%s); %+.2f%%; p = %.4f%s\n",
+                 result.name.c_str(),
+                 result.params.c_str(),
+                 result.current_median,
+                 result.baseline_median,
+                 result.baseline_rev.substr(0, 12).c_str(),
+                 result.change * 100.0,
+                 result.p_value,
+                 result.regression_flag == true ? "; REGRESSION" : "");
+    }
+
+    dbg_printf("%lu regressions in %lu benchmarks (threshold %.1f%%; "
+               "alpha %.3f)\n",
+               GetRegressionNum(),
+               result_list.size(),
+               threshold * 100.0,
+               alpha);
+
+    return;
+  }
+};
+
+#endif
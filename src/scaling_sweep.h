@@ -0,0 +1,189 @@
+
+#pragma once
+
+#ifndef _SCALING_SWEEP_H
+#define _SCALING_SWEEP_H
+
+#include "plot_suite.h"
+#include "bench_driver.h"
+#include "trial_stats.h"
+
+/*
+ * class ScalingSweep - Runs workloads over a list of thread counts and plots
+ *                      throughput against the number of threads
+ *
+ * Each workload variant becomes one line in the chart. Every point is run
+ * repeat_num times; repetitions are interleaved across thread counts (i.e.
+ * all points of repetition 0 run before any point of repetition 1), such
+ * that slow drift of the machine does not bias one end of the curve. The
+ * value of a point is the median of its repetitions, and exactly that value
+ * is what FillChart() puts into the chart.
+ *
+ * Usage:
+ *   ScalingSweep sweep{};
+ *   sweep.RunForDuration("BwTree", 5.0, [&](uint64_t thread_id) { ... });
+ *   sweep.RunForDuration("SkipList", 5.0, [&](uint64_t thread_id) { ... });
+ *
+ *   LineChart lc{};
+ *   sweep.FillChart(&lc);
+ *   lc.Draw("scaling.pdf");
+ */
+class ScalingSweep {
+ private:
+  std::vector<uint64_t> thread_num_list;
+  uint64_t repeat_num;
+
+  std::vector<std::string> name_list;
+
+  // Throughput in ops/sec indexed by [variant][point][repetition]
+  std::vector<std::vector<std::vector<double>>> sample_list_list;
+
+ public:
+
+  /*
+   * GetDefaultThreadNumList() - Returns powers of two up to max_thread_num,
+   *                             plus max_thread_num itself
+   */
+  static std::vector<uint64_t> GetDefaultThreadNumList(
+    uint64_t max_thread_num = GetCoreNum()) {
+    std::vector<uint64_t> result{};
+    for(uint64_t num = 1UL;num < max_thread_num;num *= 2UL) {
+      result.push_back(num);
+    }
+
+    result.push_back(max_thread_num);
+
+    return result;
+  }
+
+  /*
+   * GetMedian() - Returns the median of a list of values
+   *
+   * This is TrialStats::GetMedian(); both report the same value of a point
+   */
+  static double GetMedian(const std::vector<double> &value_list) {
+    return TrialStats::GetMedian(value_list);
+  }
+
+  /*
+   * Constructor
+   */
+  ScalingSweep(uint64_t p_repeat_num = 3UL,
+               const std::vector<uint64_t> &p_thread_num_list = \
+                 GetDefaultThreadNumList()) :
+    thread_num_list{p_thread_num_list},
+    repeat_num{p_repeat_num},
+    name_list{},
+    sample_list_list{} {
+    assert(thread_num_list.size() > 0UL);
+    assert(repeat_num > 0UL);
+
+    return;
+  }
+
+  /*
+   * Run() - Runs a workload variant on every thread count
+   *
+   * fn is called as fn(num_threads) and returns the throughput in ops/sec
+   * of one run at that thread count
+   */
+  template <typename Fn>
+  void Run(const std::string &name, Fn &&fn) {
+    name_list.push_back(name);
+    sample_list_list.emplace_back(thread_num_list.size());
+    std::vector<std::vector<double>> &sample_list = sample_list_list.back();
+
+    for(uint64_t repeat = 0;repeat < repeat_num;repeat++) {
+      for(size_t i = 0;i < thread_num_list.size();i++) {
+        double throughput = fn(thread_num_list[i]);
+        sample_list[i].push_back(throughput);
+
+        dbg_printf("%s: %lu threads; repeat %lu; %f MOps/sec\n",
+                   name.c_str(),
+                   thread_num_list[i],
+                   repeat,
+                   throughput / 1e6);
+      }
+    }
+
+    return;
+  }
+
+  /*
+   * RunForDuration() - Runs a per-operation functor with ::RunForDuration()
+   *                    for the given number of seconds at each point
+   *
+   * op_fn is called as op_fn(thread_id)
+   */
+  template <typename Fn>
+  void RunForDuration(const std::string &name, double seconds, Fn &&op_fn) {
+    Run(name, [seconds, &op_fn](uint64_t num_threads) {
+      return ::RunForDuration(num_threads, seconds, op_fn).GetThroughput();
+    });
+
+    return;
+  }
+
+  inline const std::vector<uint64_t> &GetThreadNumList() const {
+    return thread_num_list;
+  }
+
+  inline const std::vector<std::string> &GetNameList() const {
+    return name_list;
+  }
+
+  /*
+   * GetSampleList() - Returns throughput of all repetitions of a point
+   */
+  inline const std::vector<double> &GetSampleList(size_t variant,
+                                                  size_t point) const {
+    return sample_list_list[variant][point];
+  }
+
+  /*
+   * GetThroughput() - Returns the reported throughput of a point in ops/sec
+   */
+  double GetThroughput(size_t variant, size_t point) const {
+    return GetMedian(GetSampleList(variant, point));
+  }
+
+  /*
+   * FillChart() - Appends thread counts as X values and one line per variant
+   *               in MOps/sec, and sets axis labels
+   */
+  void FillChart(LineChart *chart_p) const {
+    chart_p->AppendXValueList(thread_num_list);
+
+    for(size_t variant = 0;variant < name_list.size();variant++) {
+      chart_p->NewYValueList();
+      for(size_t point = 0;point < thread_num_list.size();point++) {
+        chart_p->AppendYValue(GetThroughput(variant, point) / 1e6);
+      }
+
+      chart_p->AppendLineName(name_list[variant]);
+    }
+
+    chart_p->SetXAxisLabel("Number of Threads");
+    chart_p->SetYAxisLabel("Throughput (MOps/Sec)");
+
+    return;
+  }
+
+  /*
+   * Print() - Prints the median throughput of every point
+   */
+  void Print() const {
+    for(size_t variant = 0;variant < name_list.size();variant++) {
+      for(size_t point = 0;point < thread_num_list.size();point++) {
+        dbg_printf("%s: %lu threads; %f MOps/sec\n",
+                   name_list[variant].c_str(),
+                   thread_num_list[point],
+                   GetThroughput(variant, point) / 1e6);
+      }
+    }
+
+    return;
+  }
+};
+
+#endif
@@ -0,0 +1,429 @@
+
+#pragma once
+
+#ifndef _SCOPE_PROFILER_H
+#define _SCOPE_PROFILER_H
+
+#include "test_suite.h"
+
+/*
+ * PROFILE_SCOPE(name) - Times the rest of the enclosing scope as a region
+ *                       called name, nested under the region it runs in
+ *
+ * name must be a string literal (or otherwise outlive the profiler). This
+ * expands to nothing unless USE_PROFILE_SCOPE is defined before including
+ * this file, so it could stay in benchmark code at no cost:
+ *
+ *   #define USE_PROFILE_SCOPE
+ *   #include "scope_profiler.h"
+ *
+ *   void Insert(...) {
+ *     PROFILE_SCOPE("Insert");
+ *     ...
+ *     {
+ *       PROFILE_SCOPE("Split");
+ *       ...
+ *     }
+ *   }
+ *
+ *   ScopeProfiler::Print();
+ */
+#ifdef USE_PROFILE_SCOPE
+#define PROFILE_SCOPE_CONCAT2(a, b) a##b
+#define PROFILE_SCOPE_CONCAT(a, b) PROFILE_SCOPE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name) \
+  ProfileScope PROFILE_SCOPE_CONCAT(_profile_scope_, __LINE__){name}
+#else
+#define PROFILE_SCOPE(name) do {} while(0)
+#endif
+
+/*
+ * class ScopeProfiler - Per-thread call trees of profiled regions, and the
+ *                       report that merges them
+ *
+ * Every thread that enters a region gets its own flat array of nodes, one
+ * per distinct path of region names, where each node links to its parent,
+ * its first child and its next sibling. Entering a region searches the
+ * children of the current node for the name (comparing pointers first, as
+ * names are usually the same literal), and adds a node the first time the
+ * path is seen; nothing is shared with other threads, so there is no
+ * synchronization except when a thread enters its first region.
+ *
+ * Time is measured in TSC cycles with ReadCycle(), i.e. without fences,
+ * which is accurate enough for regions that are summed over many calls
+ * and keeps an empty scope cheap. The report merges the trees of all
+ * threads by path, and prints for each region the number of calls,
+ * inclusive time, exclusive time (i.e. not in any child region) and the
+ * inclusive time of each thread.
+ *
+ * Print() and Reset() must not run while any thread is inside a region
+ */
+class ScopeProfiler {
+ public:
+  // Index of the root node, which is not a region
+  static constexpr int32_t ROOT = 0;
+  static constexpr int32_t NONE = -1;
+
+  /*
+   * class Node - One path of region names on one thread
+   */
+  class Node {
+   public:
+    const char *name;
+    int32_t parent;
+    int32_t first_child;
+    int32_t next_sibling;
+
+    uint64_t call_num;
+    uint64_t cycles;
+  };
+
+  /*
+   * class ThreadProfile - The tree of one thread
+   */
+  class ThreadProfile {
+   public:
+    std::vector<Node> node_list;
+    int32_t current;
+
+    /*
+     * Constructor - Creates the root
+     */
+    ThreadProfile() :
+      node_list{},
+      current{ROOT} {
+      node_list.reserve(256);
+      node_list.push_back(Node{"", NONE, NONE, NONE, 0UL, 0UL});
+
+      return;
+    }
+
+    /*
+     * Enter() - Moves to the child of the current node with the name, and
+     *           returns its index
+     */
+    inline int32_t Enter(const char *name) {
+      int32_t index = node_list[current].first_child;
+      while(index != NONE) {
+        const Node &node = node_list[index];
+        if(node.name == name || strcmp(node.name, name) == 0) {
+          current = index;
+          return index;
+        }
+
+        index = node.next_sibling;
+      }
+
+      // First time on this path
+      index = static_cast<int32_t>(node_list.size());
+      node_list.push_back(Node{name,
+                               current,
+                               NONE,
+                               node_list[current].first_child,
+                               0UL,
+                               0UL});
+      node_list[current].first_child = index;
+      current = index;
+
+      return index;
+    }
+
+    /*
+     * Exit() - Adds a call to the node and moves back to its parent
+     */
+    inline void Exit(int32_t index, uint64_t cycles) {
+      Node &node = node_list[index];
+      node.call_num++;
+      node.cycles += cycles;
+      current = node.parent;
+
+      return;
+    }
+  };
+
+ private:
+  /*
+   * class Registry - All thread profiles; they live until the process exits
+   *                  since a thread could exit before the report
+   */
+  class Registry {
+   public:
+    std::mutex lock;
+    std::vector<std::unique_ptr<ThreadProfile>> profile_list;
+  };
+
+  /*
+   * class ReportNode - One path in the merged tree
+   */
+  class ReportNode {
+   public:
+    std::string name;
+    uint64_t call_num;
+    uint64_t cycles;
+    // Inclusive cycles of each thread
+    std::vector<uint64_t> thread_cycles_list;
+    std::vector<size_t> child_list;
+  };
+
+  static Registry &GetRegistry() {
+    static Registry registry;
+
+    return registry;
+  }
+
+  /*
+   * MergeNode() - Adds a thread's subtree to the merged tree
+   */
+  static void MergeNode(const ThreadProfile &profile,
+                        int32_t index,
+                        size_t thread_index,
+                        size_t report_index,
+                        std::vector<ReportNode> *report_list_p) {
+    std::vector<ReportNode> &report_list = *report_list_p;
+    const Node &node = profile.node_list[index];
+    report_list[report_index].call_num += node.call_num;
+    report_list[report_index].cycles += node.cycles;
+    report_list[report_index].thread_cycles_list[thread_index] += node.cycles;
+
+    for(int32_t child = node.first_child;
+        child != NONE;
+        child = profile.node_list[child].next_sibling) {
+      const char *name = profile.node_list[child].name;
+
+      size_t child_report_index = report_list.size();
+      for(size_t i : report_list[report_index].child_list) {
+        if(report_list[i].name == name) {
+          child_report_index = i;
+          break;
+        }
+      }
+
+      if(child_report_index == report_list.size()) {
+        report_list.push_back(ReportNode{
+          name,
+          0UL,
+          0UL,
+          std::vector<uint64_t>(
+            report_list[report_index].thread_cycles_list.size(), 0UL),
+          {}});
+        report_list[report_index].child_list.push_back(child_report_index);
+      }
+
+      MergeNode(profile, child, thread_index, child_report_index, report_list_p);
+    }
+
+    return;
+  }
+
+  /*
+   * PrintNode() - Prints a node of the merged tree and its children,
+   *               with the most expensive child first
+   */
+  static void PrintNode(const std::vector<ReportNode> &report_list,
+                        size_t index,
+                        int depth,
+                        uint64_t total_cycles) {
+    const ReportNode &node = report_list[index];
+    uint64_t child_cycles = 0UL;
+    for(size_t child : node.child_list) {
+      child_cycles += report_list[child].cycles;
+    }
+
+    uint64_t exclusive_cycles = \
+      node.cycles > child_cycles ? node.cycles - child_cycles : 0UL;
+
+    dbg_printf("%*s%s: %lu calls; inclusive %.3f ms (%.1f%%); "
+               "exclusive %.3f ms; %.1f ns per call\n",
+               depth * 2, "",
+               node.name.c_str(),
+               node.call_num,
+               CycleClock::CyclesToNs(node.cycles) / 1e6,
+               total_cycles == 0UL ? 0.0 : 100.0 * node.cycles / total_cycles,
+               CycleClock::CyclesToNs(exclusive_cycles) / 1e6,
+               node.call_num == 0UL ? \
+                 0.0 : CycleClock::CyclesToNs(node.cycles) / node.call_num);
+
+    if(node.thread_cycles_list.size() > 1UL) {
+      std::string line{};
+      for(size_t i = 0;i < node.thread_cycles_list.size();i++) {
+        char buffer[64];
+        snprintf(buffer, sizeof(buffer), " #%lu %.3f",
+                 i, CycleClock::CyclesToNs(node.thread_cycles_list[i]) / 1e6);
+        line += buffer;
+      }
+
+      dbg_printf("%*s  per thread (ms):%s\n",
+                 depth * 2, "",
+                 line.c_str());
+    }
+
+    std::vector<size_t> child_list = node.child_list;
+    std::sort(child_list.begin(), child_list.end(), [&](size_t a, size_t b) {
+      return report_list[a].cycles > report_list[b].cycles;
+    });
+
+    for(size_t child : child_list) {
+      PrintNode(report_list, child, depth + 1, total_cycles);
+    }
+
+    return;
+  }
+
+ public:
+
+  /*
+   * GetThreadProfile() - Returns the profile of the calling thread,
+   *                      registering it on first call
+   */
+  static ThreadProfile *GetThreadProfile() {
+    static thread_local ThreadProfile *profile_p = nullptr;
+    if(unlikely(profile_p == nullptr)) {
+      Registry &registry = GetRegistry();
+      std::lock_guard<std::mutex> guard{registry.lock};
+      registry.profile_list.emplace_back(new ThreadProfile{});
+      profile_p = registry.profile_list.back().get();
+    }
+
+    return profile_p;
+  }
+
+  /*
+   * GetThreadNum() - Returns the number of threads that entered a region
+   */
+  static size_t GetThreadNum() {
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> guard{registry.lock};
+
+    return registry.profile_list.size();
+  }
+
+  /*
+   * GetTotal() - Returns calls and inclusive cycles of a path over all
+   *              threads, e.g. {"Insert", "Split"}
+   */
+  static std::pair<uint64_t, uint64_t> GetTotal(
+    const std::vector<std::string> &path) {
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> guard{registry.lock};
+
+    std::pair<uint64_t, uint64_t> total{0UL, 0UL};
+    for(const std::unique_ptr<ThreadProfile> &profile_p : registry.profile_list) {
+      const std::vector<Node> &node_list = profile_p->node_list;
+      int32_t index = ROOT;
+      for(const std::string &name : path) {
+        int32_t child = node_list[index].first_child;
+        while(child != NONE && node_list[child].name != name) {
+          child = node_list[child].next_sibling;
+        }
+
+        index = child;
+        if(index == NONE) {
+          break;
+        }
+      }
+
+      if(index != NONE) {
+        total.first += node_list[index].call_num;
+        total.second += node_list[index].cycles;
+      }
+    }
+
+    return total;
+  }
+
+  /*
+   * Print() - Prints the merged call tree
+   */
+  static void Print() {
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> guard{registry.lock};
+
+    size_t thread_num = registry.profile_list.size();
+    if(thread_num == 0UL) {
+      dbg_printf("No profiled region\n");
+      return;
+    }
+
+    std::vector<ReportNode> report_list{};
+    report_list.push_back(ReportNode{
+      "", 0UL, 0UL, std::vector<uint64_t>(thread_num, 0UL), {}});
+    for(size_t i = 0;i < thread_num;i++) {
+      MergeNode(*registry.profile_list[i], ROOT, i, 0UL, &report_list);
+    }
+
+    // The root has no time of its own; use the sum of top level regions
+    uint64_t total_cycles = 0UL;
+    for(size_t child : report_list[0].child_list) {
+      total_cycles += report_list[child].cycles;
+    }
+
+    dbg_printf("%lu threads; %.3f ms in top level regions\n",
+               thread_num,
+               CycleClock::CyclesToNs(total_cycles) / 1e6);
+
+    std::vector<size_t> child_list = report_list[0].child_list;
+    std::sort(child_list.begin(), child_list.end(), [&](size_t a, size_t b) {
+      return report_list[a].cycles > report_list[b].cycles;
+    });
+
+    for(size_t child : child_list) {
+      PrintNode(report_list, child, 0, total_cycles);
+    }
+
+    return;
+  }
+
+  /*
+   * Reset() - Sets all counters to zero; paths are kept
+   */
+  static void Reset() {
+    Registry &registry = GetRegistry();
+    std::lock_guard<std::mutex> guard{registry.lock};
+
+    for(std::unique_ptr<ThreadProfile> &profile_p : registry.profile_list) {
+      for(Node &node : profile_p->node_list) {
+        node.call_num = 0UL;
+        node.cycles = 0UL;
+      }
+    }
+
+    return;
+  }
+};
+
+/*
+ * class ProfileScope - Enters a region when constructed and exits it when
+ *                      destroyed; used by PROFILE_SCOPE()
+ */
+class ProfileScope {
+ private:
+  ScopeProfiler::ThreadProfile *profile_p;
+  int32_t index;
+  uint64_t start;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  inline ProfileScope(const char *name) :
+    profile_p{ScopeProfiler::GetThreadProfile()},
+    index{profile_p->Enter(name)},
+    start{ReadCycle()} {
+    return;
+  }
+
+  /*
+   * Destructor
+   */
+  inline ~ProfileScope() {
+    profile_p->Exit(index, ReadCycle() - start);
+
+    return;
+  }
+
+  ProfileScope(const ProfileScope &) = delete;
+  ProfileScope &operator=(const ProfileScope &) = delete;
+};
+
+#endif
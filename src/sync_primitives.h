@@ -0,0 +1,462 @@
+
+#pragma once
+
+#ifndef _SYNC_PRIMITIVES_H
+#define _SYNC_PRIMITIVES_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <climits>
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "common.h"
+
+/*
+ * SpinPause() - Called in the i-th iteration of a spin loop
+ *
+ * Most of the time this is just a PAUSE instruction, but every once in a
+ * while we yield the processor, such that the thread we are waiting for could
+ * run if there are more threads than cores
+ */
+inline void SpinPause(uint64_t i) {
+  static constexpr uint64_t YIELD_INTERVAL = 1UL << 8;
+
+  if((i % YIELD_INTERVAL) == (YIELD_INTERVAL - 1)) {
+    std::this_thread::yield();
+  } else {
+    cpu_pause();
+  }
+
+  return;
+}
+
+/*
+ * class SpinBarrier - Reusable centralized spinning barrier
+ *
+ * The last thread arriving at the barrier resets the counter and flips the
+ * generation number, which releases all spinning threads at once. The
+ * generation number plays the role of the sense flag in a sense-reversing
+ * barrier, so the barrier could be reused right after it is released without
+ * re-initialization.
+ *
+ * The counter and the generation number are on different cache lines, such
+ * that spinning threads are not disturbed by arriving threads
+ */
+class SpinBarrier {
+ private:
+  alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> arrived_num;
+  alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> generation;
+
+  // Number of threads that must arrive before all of them are released
+  uint64_t thread_num;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  SpinBarrier(uint64_t p_thread_num) :
+    arrived_num{0UL},
+    generation{0UL},
+    thread_num{p_thread_num} {
+    assert(thread_num > 0UL);
+
+    return;
+  }
+
+  SpinBarrier(const SpinBarrier &) = delete;
+  SpinBarrier &operator=(const SpinBarrier &) = delete;
+
+  /*
+   * Wait() - Blocks until thread_num threads have called this function
+   *
+   * Returns true for exactly one thread in each round (the last one to
+   * arrive), which could be used to elect a thread for serial work
+   */
+  bool Wait() {
+    uint64_t current = generation.load(std::memory_order_acquire);
+    uint64_t arrived = \
+      arrived_num.fetch_add(1UL, std::memory_order_acq_rel) + 1UL;
+
+    if(arrived == thread_num) {
+      arrived_num.store(0UL, std::memory_order_relaxed);
+      generation.store(current + 1UL, std::memory_order_release);
+
+      return true;
+    }
+
+    uint64_t i = 0UL;
+    while(generation.load(std::memory_order_acquire) == current) {
+      SpinPause(i++);
+    }
+
+    return false;
+  }
+
+  /*
+   * GetThreadNum() - Returns the number of threads synchronized
+   */
+  inline uint64_t GetThreadNum() const {
+    return thread_num;
+  }
+};
+
+/*
+ * class SenseReversingBarrier - Centralized barrier with a global sense flag
+ *                               and a per-thread local sense
+ *
+ * Each thread flips its local sense before arriving, and waits until the
+ * global sense equals its local sense. The last thread to arrive resets the
+ * counter and flips the global sense. The local sense is owned by the
+ * caller, which keeps the barrier free of per-thread storage
+ */
+class SenseReversingBarrier {
+ private:
+  alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> arrived_num;
+  alignas(CACHE_LINE_SIZE) std::atomic<bool> sense;
+
+  uint64_t thread_num;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  SenseReversingBarrier(uint64_t p_thread_num) :
+    arrived_num{0UL},
+    sense{false},
+    thread_num{p_thread_num} {
+    assert(thread_num > 0UL);
+
+    return;
+  }
+
+  SenseReversingBarrier(const SenseReversingBarrier &) = delete;
+  SenseReversingBarrier &operator=(const SenseReversingBarrier &) = delete;
+
+  /*
+   * Wait() - Blocks until thread_num threads have called this function
+   *
+   * local_sense_p points to a flag private to the calling thread, which
+   * must be initialized to false. Returns true for the last thread to arrive
+   */
+  bool Wait(bool *local_sense_p) {
+    bool local_sense = !*local_sense_p;
+    *local_sense_p = local_sense;
+
+    uint64_t arrived = \
+      arrived_num.fetch_add(1UL, std::memory_order_acq_rel) + 1UL;
+    if(arrived == thread_num) {
+      arrived_num.store(0UL, std::memory_order_relaxed);
+      sense.store(local_sense, std::memory_order_release);
+
+      return true;
+    }
+
+    uint64_t i = 0UL;
+    while(sense.load(std::memory_order_acquire) != local_sense) {
+      SpinPause(i++);
+    }
+
+    return false;
+  }
+
+  inline uint64_t GetThreadNum() const {
+    return thread_num;
+  }
+};
+
+/*
+ * class CombiningTreeBarrier - Barrier whose arrival counters form a tree
+ *
+ * With a single counter, all threads of a large machine hammer one cache
+ * line when they arrive. Here threads arrive at leaf nodes of fan_in
+ * threads each; the last thread to arrive at a node moves on to its
+ * parent, and the last thread to arrive at the root flips the global sense
+ * to release everybody. Each counter only sees fan_in arrivals.
+ *
+ * Nodes are padded to a cache line each rather than aligned, since they
+ * live in a std::vector
+ */
+class CombiningTreeBarrier {
+ private:
+  /*
+   * class Node - One arrival counter
+   */
+  class Node {
+   public:
+    std::atomic<uint64_t> arrived_num;
+    // Number of arrivals that complete this node
+    uint64_t child_num;
+    // Index of the parent node, or the node itself for the root
+    size_t parent;
+    char padding[CACHE_LINE_SIZE];
+
+    Node(uint64_t p_child_num, size_t p_parent) :
+      arrived_num{0UL},
+      child_num{p_child_num},
+      parent{p_parent},
+      padding{} {
+      return;
+    }
+
+    Node(const Node &other) :
+      arrived_num{other.arrived_num.load()},
+      child_num{other.child_num},
+      parent{other.parent},
+      padding{} {
+      return;
+    }
+  };
+
+  std::vector<Node> node_list;
+  alignas(CACHE_LINE_SIZE) std::atomic<bool> sense;
+
+  uint64_t thread_num;
+  uint64_t fan_in;
+
+ public:
+
+  /*
+   * Constructor - Builds the tree bottom up
+   */
+  CombiningTreeBarrier(uint64_t p_thread_num, uint64_t p_fan_in = 4UL) :
+    node_list{},
+    sense{false},
+    thread_num{p_thread_num},
+    fan_in{p_fan_in} {
+    assert(thread_num > 0UL);
+    assert(fan_in > 1UL);
+
+    // Node i of a level has children [i * fan_in, (i + 1) * fan_in) of the
+    // level below; the first level's children are threads
+    size_t level_begin = 0UL;
+    uint64_t child_num = thread_num;
+    do {
+      uint64_t level_size = (child_num + fan_in - 1UL) / fan_in;
+      size_t next_begin = level_begin + level_size;
+
+      for(uint64_t i = 0;i < level_size;i++) {
+        uint64_t count = std::min(fan_in, child_num - i * fan_in);
+        size_t parent = (level_size == 1UL) ? \
+          level_begin : next_begin + i / fan_in;
+        node_list.emplace_back(count, parent);
+      }
+
+      level_begin = next_begin;
+      child_num = level_size;
+    } while(child_num > 1UL);
+
+    return;
+  }
+
+  CombiningTreeBarrier(const CombiningTreeBarrier &) = delete;
+  CombiningTreeBarrier &operator=(const CombiningTreeBarrier &) = delete;
+
+  /*
+   * Wait() - Blocks until thread_num threads have called this function
+   *
+   * thread_id must be unique in [0, thread_num). local_sense_p is the same
+   * as in SenseReversingBarrier::Wait(). Returns true for the thread that
+   * completed the root
+   */
+  bool Wait(uint64_t thread_id, bool *local_sense_p) {
+    assert(thread_id < thread_num);
+
+    bool local_sense = !*local_sense_p;
+    *local_sense_p = local_sense;
+
+    size_t index = thread_id / fan_in;
+    while(true) {
+      Node &node = node_list[index];
+      uint64_t arrived = \
+        node.arrived_num.fetch_add(1UL, std::memory_order_acq_rel) + 1UL;
+      if(arrived != node.child_num) {
+        break;
+      }
+
+      // Nobody else arrives at this node in this round
+      node.arrived_num.store(0UL, std::memory_order_relaxed);
+      if(node.parent == index) {
+        sense.store(local_sense, std::memory_order_release);
+        return true;
+      }
+
+      index = node.parent;
+    }
+
+    uint64_t i = 0UL;
+    while(sense.load(std::memory_order_acquire) != local_sense) {
+      SpinPause(i++);
+    }
+
+    return false;
+  }
+
+  inline uint64_t GetThreadNum() const {
+    return thread_num;
+  }
+
+  /*
+   * GetNodeNum() - Returns the number of nodes in the tree
+   */
+  inline size_t GetNodeNum() const {
+    return node_list.size();
+  }
+};
+
+/*
+ * class FutexWord - A 32-bit word that threads could wait on by spinning
+ *                   first and then sleeping in the kernel
+ *
+ * Spinning is cheaper when the wait is short, while sleeping does not take
+ * the CPU from the thread we are waiting for. Wait() spins for a while and
+ * then calls futex(FUTEX_WAIT). Sleepers are counted, such that Wake()
+ * only makes the system call if somebody may be sleeping.
+ *
+ * This is not aligned to a cache line, so that it could be embedded in
+ * objects allocated with new
+ */
+class FutexWord {
+ public:
+  // Number of spins before sleeping
+  static constexpr uint64_t DEFAULT_SPIN_COUNT = 1UL << 12;
+
+ private:
+  std::atomic<uint32_t> value;
+  std::atomic<uint32_t> sleeper_num;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  FutexWord(uint32_t p_value = 0U) :
+    value{p_value},
+    sleeper_num{0U} {
+    static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                  "futex requires a plain 32-bit word");
+
+    return;
+  }
+
+  FutexWord(const FutexWord &) = delete;
+  FutexWord &operator=(const FutexWord &) = delete;
+
+  inline std::atomic<uint32_t> &GetValue() {
+    return value;
+  }
+
+  /*
+   * Wait() - Returns once the value is no longer old_value
+   */
+  void Wait(uint32_t old_value, uint64_t spin_count = DEFAULT_SPIN_COUNT) {
+    for(uint64_t i = 0;i < spin_count;i++) {
+      if(value.load(std::memory_order_acquire) != old_value) {
+        return;
+      }
+
+      SpinPause(i);
+    }
+
+    // The sleeper count must be visible before we check the value for the
+    // last time, otherwise a waker could change it and skip the wake up
+    sleeper_num.fetch_add(1U, std::memory_order_seq_cst);
+    while(value.load(std::memory_order_seq_cst) == old_value) {
+      // Returns immediately if the value has changed
+      syscall(SYS_futex,
+              reinterpret_cast<uint32_t *>(&value),
+              FUTEX_WAIT_PRIVATE,
+              old_value,
+              nullptr,
+              nullptr,
+              0);
+    }
+
+    sleeper_num.fetch_sub(1U, std::memory_order_relaxed);
+
+    return;
+  }
+
+  /*
+   * Wake() - Wakes up all sleepers; called after changing the value
+   */
+  void Wake() {
+    if(sleeper_num.load(std::memory_order_seq_cst) != 0U) {
+      syscall(SYS_futex,
+              reinterpret_cast<uint32_t *>(&value),
+              FUTEX_WAKE_PRIVATE,
+              INT_MAX,
+              nullptr,
+              nullptr,
+              0);
+    }
+
+    return;
+  }
+};
+
+/*
+ * class CountdownLatch - Releases waiters once the count reaches zero
+ *
+ * Unlike a barrier, the latch is used once, and threads counting down do
+ * not have to wait. Waiters use FutexWord, so a long wait (e.g. for a
+ * loading phase) does not burn CPU
+ */
+class CountdownLatch {
+ private:
+  std::atomic<uint64_t> count;
+  // Becomes 1 when count reaches zero
+  FutexWord done;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  CountdownLatch(uint64_t p_count) :
+    count{p_count},
+    done{p_count == 0UL ? 1U : 0U} {
+    return;
+  }
+
+  CountdownLatch(const CountdownLatch &) = delete;
+  CountdownLatch &operator=(const CountdownLatch &) = delete;
+
+  /*
+   * CountDown() - Decreases the count, and releases waiters if it reaches 0
+   */
+  void CountDown(uint64_t delta = 1UL) {
+    uint64_t old_count = count.fetch_sub(delta, std::memory_order_acq_rel);
+    assert(old_count >= delta);
+
+    if(old_count == delta) {
+      done.GetValue().store(1U, std::memory_order_seq_cst);
+      done.Wake();
+    }
+
+    return;
+  }
+
+  /*
+   * TryWait() - Returns whether the count has reached zero
+   */
+  inline bool TryWait() {
+    return done.GetValue().load(std::memory_order_acquire) == 1U;
+  }
+
+  /*
+   * Wait() - Blocks until the count reaches zero
+   */
+  void Wait(uint64_t spin_count = FutexWord::DEFAULT_SPIN_COUNT) {
+    done.Wait(0U, spin_count);
+
+    return;
+  }
+};
+
+#endif
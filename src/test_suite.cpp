@@ -21,6 +21,23 @@ void PrintTestName(const char *name) {
   return;
 }
 
+/*
+ * PrintRunHeader() - Prints the machine and timer calibration, such that
+ *                    results from different machines could be compared
+ *
+ * This also runs TSC and clock overhead calibration, which should be done
+ * before any measurement
+ */
+void PrintRunHeader() {
+  dbg_printf("%lu cores; invariant TSC %s; TSC %.3f GHz\n",
+             GetCoreNum(),
+             CycleClock::IsInvariant() == true ? "yes" : "no",
+             CycleClock::GetCyclesPerNs());
+  ClockOverhead::Print();
+
+  return;
+}
+
 /*
  * SleepFor() - Sleeps in the main thread
  */
@@ -48,17 +65,53 @@ int GetThreadAffinity() {
 
 /*
  * PinToCore() - Pin the current calling thread to a particular core
+ *
+ * Returns false if the core does not exist or is not allowed for this
+ * process (e.g. under taskset or a cgroup cpuset), in which case the
+ * thread stays where it could run before
  */
-void PinToCore(size_t core_id) {
+bool PinToCore(size_t core_id) {
+  if(core_id >= CPU_SETSIZE) {
+    return false;
+  }
+
   cpu_set_t cpu_set;
   CPU_ZERO(&cpu_set);
   CPU_SET(core_id, &cpu_set);
 
   int ret = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
-  assert(ret == 0);
-  (void)ret;
 
-  return;
+  return ret == 0;
+}
+
+/*
+ * GetAllowedCoreList() - Returns the cores this process may run on, in
+ *                        ascending order
+ *
+ * This is the affinity mask of the process, which could be smaller than
+ * GetCoreNum() under taskset, cgroups or in containers. If the mask could
+ * not be read, all cores are returned
+ */
+std::vector<int> GetAllowedCoreList() {
+  std::vector<int> core_list{};
+
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  if(sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0) {
+    for(int core_id = 0;core_id < CPU_SETSIZE;core_id++) {
+      if(CPU_ISSET(core_id, &cpu_set)) {
+        core_list.push_back(core_id);
+      }
+    }
+  }
+
+  if(core_list.empty() == true) {
+    for(uint64_t core_id = 0;core_id < GetCoreNum();core_id++) {
+      core_list.push_back(static_cast<int>(core_id));
+    }
+  }
+
+  return core_list;
 }
 
 /*
@@ -7,6 +7,7 @@
 #include <random>
 
 #include <sched.h>
+#include <unistd.h>
 #include <map>
 #include <cmath>
 #include <cstring>
@@ -21,12 +22,23 @@
 #include <thread>
 #include <cstdint>
 #include <iostream>
+#include <chrono>
+#include <mutex>
+#include <memory>
+#include <numeric>
+#include <functional>
+#include <condition_variable>
+#include <algorithm>
+#include <new>
 
 // This header defines endian swap and byte ordering on the host
 // architecture
 #include <endian.h>
 
 #include "common.h" 
+#include "sync_primitives.h"
+#include "cycle_timer.h"
+#include "prng.h"
 
 // Print a given name as test name
 void PrintTestName(const char *name);
@@ -34,28 +46,985 @@ void PrintTestName(const char *name);
 #define _PrintTestName() { PrintTestName(__FUNCTION__); }
 
 void SleepFor(uint64_t sleep_ms); 
+void PrintRunHeader();
 int GetThreadAffinity();
-void PinToCore(size_t core_id);
+bool PinToCore(size_t core_id);
 uint64_t GetCoreNum();
+std::vector<int> GetAllowedCoreList();
+
+/*
+ * GetSteadyClockNs() - Returns a monotonic timestamp in nanoseconds
+ *
+ * The epoch is unspecified, so only differences are meaningful
+ */
+inline uint64_t GetSteadyClockNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+ * class PaddedArray - Fixed size array where each element occupies its own
+ *                     cache line(s)
+ *
+ * This is used for per-thread data that is written frequently by its owner
+ * and read by others. Storage is allocated with cache line alignment, since 
+ * operator new does not respect over-aligned types before C++17
+ */
+template <typename T>
+class PaddedArray {
+ private:
+  class alignas(CACHE_LINE_SIZE) Element {
+   public:
+    T value;
+  };
+  
+  Element *data_p;
+  size_t count;
+  
+ public:
+  
+  /*
+   * Constructor - Allocates and value-initializes count elements
+   */
+  PaddedArray(size_t p_count) :
+    data_p{nullptr},
+    count{p_count} {
+    void *p = nullptr;
+    int ret = posix_memalign(&p, 
+                             CACHE_LINE_SIZE, 
+                             sizeof(Element) * (count == 0UL ? 1UL : count));
+    if(ret != 0) {
+      throw std::bad_alloc{};
+    }
+    
+    data_p = static_cast<Element *>(p);
+    for(size_t i = 0;i < count;i++) {
+      new (data_p + i) Element{};
+    }
+    
+    return;
+  }
+  
+  /*
+   * Destructor
+   */
+  ~PaddedArray() {
+    for(size_t i = 0;i < count;i++) {
+      data_p[i].~Element();
+    }
+    
+    free(data_p);
+    
+    return;
+  }
+  
+  PaddedArray(const PaddedArray &) = delete;
+  PaddedArray &operator=(const PaddedArray &) = delete;
+  
+  inline T &operator[](size_t index) {
+    assert(index < count);
+    return data_p[index].value;
+  }
+  
+  inline const T &operator[](size_t index) const {
+    assert(index < count);
+    return data_p[index].value;
+  }
+  
+  /*
+   * GetCount() - Returns the number of elements
+   */
+  inline size_t GetCount() const {
+    return count;
+  }
+};
+ 
+/*
+ * class ThreadCounterArray - One operation counter per thread, each on its
+ *                            own cache line
+ *
+ * Each counter has exactly one writer (the owner thread), so increments are
+ * done with a relaxed load and store instead of an atomic RMW. Other threads
+ * (e.g. a sampler) could read the counters at any time with relaxed loads and
+ * never cause the owner's cache line to bounce except for that read
+ */
+class ThreadCounterArray {
+ private:
+  PaddedArray<std::atomic<uint64_t>> counter_list;
+
+ public:
+
+  /*
+   * Constructor - All counters start at 0
+   */
+  ThreadCounterArray(uint64_t thread_num) :
+    counter_list{thread_num} {
+    Reset();
+
+    return;
+  }
+
+  /*
+   * Add() - Adds to the counter of a thread; only called by that thread
+   */
+  inline void Add(uint64_t thread_id, uint64_t delta = 1UL) {
+    std::atomic<uint64_t> &counter = counter_list[thread_id];
+    counter.store(counter.load(std::memory_order_relaxed) + delta,
+                  std::memory_order_relaxed);
+
+    return;
+  }
+
+  /*
+   * Get() - Returns the counter of a thread
+   */
+  inline uint64_t Get(uint64_t thread_id) const {
+    return counter_list[thread_id].load(std::memory_order_relaxed);
+  }
+
+  /*
+   * GetThreadNum() - Returns the number of counters
+   */
+  inline uint64_t GetThreadNum() const {
+    return counter_list.GetCount();
+  }
+
+  /*
+   * GetTotal() - Returns the sum of all counters
+   */
+  uint64_t GetTotal() const {
+    uint64_t total = 0UL;
+    for(uint64_t thread_id = 0;thread_id < GetThreadNum();thread_id++) {
+      total += Get(thread_id);
+    }
+
+    return total;
+  }
+
+  /*
+   * GetSnapshot() - Returns the values of all counters
+   */
+  std::vector<uint64_t> GetSnapshot() const {
+    std::vector<uint64_t> snapshot{};
+    for(uint64_t thread_id = 0;thread_id < GetThreadNum();thread_id++) {
+      snapshot.push_back(Get(thread_id));
+    }
+
+    return snapshot;
+  }
+
+  /*
+   * Reset() - Sets all counters to 0; must not run concurrently with Add()
+   */
+  void Reset() {
+    for(uint64_t thread_id = 0;thread_id < GetThreadNum();thread_id++) {
+      counter_list[thread_id].store(0UL, std::memory_order_relaxed);
+    }
+
+    return;
+  }
+};
+
+/*
+ * class ThreadPool - A group of pinned worker threads that survive across runs
+ *
+ * Creating and joining threads for every data point of a benchmark costs
+ * thread creation, stack faulting and scheduler placement each time, which is
+ * in the order of milliseconds. This class keeps the workers alive between
+ * runs: after a run finishes they spin for a short while and then park on a
+ * condition variable until the next run is dispatched. Since the same worker
+ * executes the same thread ID across runs, its stack and TLB entries are 
+ * still warm when the next phase starts.
+ *
+ * Worker i is pinned to the (i % n)-th of the n cores the process is allowed
+ * to run on (see GetAllowedCoreList()) when it is created, unless a 
+ * different placement is given to the run by RunOnCores(), which only lasts
+ * for that run. A worker that could not be pinned keeps running unpinned.
+ *
+ * Runs are serialized. If a run is requested from inside a worker (i.e. nested
+ * StartThreads()) or while another thread is using the pool, we fall back to
+ * spawning fresh threads instead of deadlocking.
+ */
+class ThreadPool {
+ private:
+  /*
+   * class WorkerSlot - Per-worker dispatch state
+   *
+   * Each slot is allocated separately, and we only wake up the workers that
+   * participate in a run, so that idle workers stay parked
+   */
+  class WorkerSlot {
+   public:
+    // The latest phase this worker should execute
+    std::atomic<uint64_t> phase;
+    std::mutex mutex;
+    std::condition_variable cv;
+    
+    // The core this worker should be pinned to. The worker re-pins itself
+    // at the beginning of the next run if this changes
+    std::atomic<int> core_id;
+    
+    // Whether the worker is actually pinned to core_id
+    std::atomic<bool> pinned_flag;
+    
+    WorkerSlot(int p_core_id) :
+      phase{0UL},
+      core_id{p_core_id},
+      pinned_flag{false}
+    {}
+  };
+  
+  /*
+   * class RunState - State of the current run shared by the workers and the
+   *                  dispatching thread
+   *
+   * This is allocated separately such that it could be leaked instead of
+   * destroyed while a run is still in flight (see Abandon())
+   */
+  class RunState {
+   public:
+    // Function called by worker i with its thread ID is task_list[i]; each
+    // one holds its own copy of the caller's functor and arguments
+    std::vector<std::function<void(uint64_t)>> task_list;
+    
+    // The last worker to finish a run notifies the dispatching thread
+    std::mutex finish_mutex;
+    std::condition_variable finish_cv;
+  };
+  
+  // Number of spins on the phase variable before parking the thread
+  static constexpr uint64_t SPIN_COUNT = 1UL << 16;
+  
+  std::vector<std::thread> thread_list;
+  std::vector<std::unique_ptr<WorkerSlot>> slot_list;
+  
+  // Cores the process may run on, for the default placement
+  std::vector<int> allowed_core_list;
+  
+  std::unique_ptr<RunState> run_state_p;
+  
+  // Current phase number; bumped for every run
+  uint64_t current_phase;
+  
+  // Number of workers in the current run and number of them that have
+  // finished the task
+  uint64_t active_thread_num;
+  std::atomic<uint64_t> finished_num;
+  
+  // Set when the pool is being destroyed
+  std::atomic<bool> exit_flag;
+  
+  // Number of spins before parking. This is zero when the workers and the
+  // dispatching thread could not all run at the same time, in which case
+  // spinning only delays the thread we are waiting for
+  std::atomic<uint64_t> spin_count;
+  
+  // Serializes runs from different threads
+  std::mutex run_mutex;
+  
+  // Process that owns the workers. A forked child inherits the pool object
+  // but none of the threads, so it must not use them
+  pid_t owner_pid;
+  
+  /*
+   * IsWorkerThread() - Returns a reference to the thread local flag that
+   *                    identifies pool workers
+   */
+  static bool &IsWorkerThread() {
+    static thread_local bool is_worker = false;
+    return is_worker;
+  }
+  
+  /*
+   * WaitForPhase() - Spins and then parks until the slot's phase advances
+   *                  beyond the given one. Returns the new phase
+   */
+  uint64_t WaitForPhase(WorkerSlot *slot_p, uint64_t seen_phase) {
+    uint64_t spin = spin_count.load(std::memory_order_relaxed);
+    for(uint64_t i = 0;i < spin;i++) {
+      uint64_t phase = slot_p->phase.load(std::memory_order_acquire);
+      if(phase != seen_phase) {
+        return phase;
+      }
+      
+      SpinPause(i);
+    }
+    
+    std::unique_lock<std::mutex> lock{slot_p->mutex};
+    slot_p->cv.wait(lock, [slot_p, seen_phase]() {
+      return slot_p->phase.load(std::memory_order_acquire) != seen_phase;
+    });
+    
+    return slot_p->phase.load(std::memory_order_acquire);
+  }
+  
+  /*
+   * WorkerLoop() - The body of worker threads
+   *
+   * The slot is passed as an argument since slot_list may grow while the 
+   * worker is starting. The run state is passed for the same reason as it
+   * may be released by Abandon()
+   */
+  void WorkerLoop(uint64_t thread_id, 
+                  WorkerSlot *slot_p, 
+                  RunState *state_p) {
+    IsWorkerThread() = true;
+    
+    // Failing to pin is not an error here; the worker then runs unpinned 
+    // and RunOn() reports it to the caller
+    int pinned_core = slot_p->core_id.load(std::memory_order_relaxed);
+    slot_p->pinned_flag.store(PinToCore(pinned_core), 
+                              std::memory_order_relaxed);
+    
+    // Slots are created with phase 0; do not read it here since the first
+    // run may have been dispatched before the thread starts
+    uint64_t seen_phase = 0UL;
+    
+    while(true) {
+      seen_phase = WaitForPhase(slot_p, seen_phase);
+      if(exit_flag.load(std::memory_order_acquire) == true) {
+        break;
+      }
+      
+      // Read this before reporting completion, since the dispatching thread
+      // may start the next run as soon as the last worker finishes
+      uint64_t active = active_thread_num;
+      
+      int core_id = slot_p->core_id.load(std::memory_order_relaxed);
+      if(core_id != pinned_core) {
+        slot_p->pinned_flag.store(PinToCore(core_id), 
+                                  std::memory_order_relaxed);
+        pinned_core = core_id;
+      }
+      
+      state_p->task_list[thread_id](thread_id);
+      
+      // The last worker to finish wakes up the dispatching thread
+      uint64_t finished = \
+        finished_num.fetch_add(1UL, std::memory_order_acq_rel) + 1UL;
+      if(finished == active) {
+        std::lock_guard<std::mutex> lock{state_p->finish_mutex};
+        state_p->finish_cv.notify_one();
+      }
+    }
+    
+    return;
+  }
+  
+  /*
+   * Wake() - Advances the phase of a worker and wakes it up if parked
+   */
+  void Wake(uint64_t thread_id) {
+    WorkerSlot *slot_p = slot_list[thread_id].get();
+    {
+      std::lock_guard<std::mutex> lock{slot_p->mutex};
+      slot_p->phase.store(current_phase, std::memory_order_release);
+    }
+    
+    slot_p->cv.notify_one();
+    
+    return;
+  }
+  
+  /*
+   * Dispatch() - Runs the current task on workers [0, num_threads) and
+   *              waits for all of them to finish
+   */
+  void Dispatch(uint64_t num_threads) {
+    active_thread_num = num_threads;
+    finished_num.store(0UL, std::memory_order_relaxed);
+    current_phase++;
+    
+    for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+      Wake(thread_id);
+    }
+    
+    uint64_t spin = spin_count.load(std::memory_order_relaxed);
+    for(uint64_t i = 0;i < spin;i++) {
+      if(finished_num.load(std::memory_order_acquire) == num_threads) {
+        return;
+      }
+      
+      SpinPause(i);
+    }
+    
+    std::unique_lock<std::mutex> lock{run_state_p->finish_mutex};
+    run_state_p->finish_cv.wait(lock, [this, num_threads]() {
+      return finished_num.load(std::memory_order_acquire) == num_threads;
+    });
+    
+    return;
+  }
+  
+  /*
+   * GetCoreForThread() - Returns the core a worker is pinned to by default
+   */
+  int GetCoreForThread(uint64_t thread_id) const {
+    return allowed_core_list[thread_id % allowed_core_list.size()];
+  }
+  
+  /*
+   * Reserve() - Makes sure that there are at least num_threads workers
+   *
+   * This must be called with run_mutex held
+   */
+  void Reserve(uint64_t num_threads) {
+    uint64_t core_num = allowed_core_list.size();
+    
+    for(uint64_t thread_id = thread_list.size();
+        thread_id < num_threads;
+        thread_id++) {
+      WorkerSlot *slot_p = new WorkerSlot{GetCoreForThread(thread_id)};
+      
+      slot_list.emplace_back(slot_p);
+      thread_list.emplace_back(&ThreadPool::WorkerLoop, 
+                               this, 
+                               thread_id, 
+                               slot_p,
+                               run_state_p.get());
+    }
+    
+    spin_count.store((thread_list.size() < core_num) ? SPIN_COUNT : 0UL,
+                     std::memory_order_relaxed);
+    
+    return;
+  }
+  
+  /*
+   * RunOn() - Runs fn(thread_id, args...) on workers [0, num_threads)
+   *
+   * Worker i is pinned to (*core_list_p)[i], or to its default core if
+   * core_list_p is nullptr. Slots are only written while run_mutex is held,
+   * so a placement never leaks into another run. Returns the number of 
+   * threads that could not be pinned and ran unpinned instead
+   */
+  template <typename Fn, typename... Args>
+  uint64_t RunOn(uint64_t num_threads, 
+                 const std::vector<int> *core_list_p, 
+                 Fn &&fn, 
+                 Args &&... args) {
+    if(num_threads == 0UL) {
+      return 0UL;
+    }
+    
+    std::unique_lock<std::mutex> lock{run_mutex, std::defer_lock};
+    if(IsWorkerThread() == true || 
+       getpid() != owner_pid ||
+       lock.try_lock() == false) {
+      if(core_list_p == nullptr) {
+        RunUnpooled(num_threads, fn, args...);
+        return 0UL;
+      }
+      
+      return RunUnpooledOnCores(*core_list_p, fn, args...);
+    }
+    
+    Reserve(num_threads);
+    for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+      int core_id = (core_list_p == nullptr) ? \
+        GetCoreForThread(thread_id) : (*core_list_p)[thread_id];
+      slot_list[thread_id]->core_id.store(core_id, std::memory_order_relaxed);
+    }
+    
+    // Every worker gets its own copy of fn and args, as std::thread (and
+    // therefore the fallback) does, so functors with state do not race
+    auto task = [fn, args...](uint64_t thread_id) mutable {
+      fn(thread_id, args...);
+    };
+    
+    run_state_p->task_list.assign(num_threads, task);
+    
+    Dispatch(num_threads);
+    
+    // Do not keep the copies after the run
+    run_state_p->task_list.clear();
+    
+    uint64_t unpinned_num = 0UL;
+    for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+      if(slot_list[thread_id]->pinned_flag.load(
+           std::memory_order_relaxed) == false) {
+        unpinned_num++;
+      }
+    }
+    
+    return unpinned_num;
+  }
+  
+  /*
+   * Abandon() - Forgets the workers without joining them
+   *
+   * Slots and the run state are leaked, since workers or the dispatching 
+   * thread may still use them, and destroying a condition variable that has
+   * waiters blocks forever. Thread objects are leaked too: destroying a 
+   * joinable one terminates the process, and detach() fails in a forked 
+   * child where the threads do not exist
+   */
+  void Abandon() {
+    for(uint64_t thread_id = 0;thread_id < slot_list.size();thread_id++) {
+      slot_list[thread_id].release();
+    }
+    
+    std::vector<std::thread> *leaked_list_p = \
+      new std::vector<std::thread>{std::move(thread_list)};
+    (void)leaked_list_p;
+    
+    run_state_p.release();
+    
+    return;
+  }
+  
+ public:
+  
+  /*
+   * Constructor - Starts the given number of workers
+   */
+  ThreadPool(uint64_t num_threads = 0UL) :
+    allowed_core_list{GetAllowedCoreList()},
+    run_state_p{new RunState{}},
+    current_phase{0UL},
+    active_thread_num{0UL},
+    finished_num{0UL},
+    exit_flag{false},
+    spin_count{0UL},
+    owner_pid{getpid()} {
+    Reserve(num_threads);
+    
+    return;
+  }
+  
+  /*
+   * Destructor - Wakes up all workers and joins them
+   *
+   * Workers are only forgotten if they could not be joined: in a forked
+   * child they do not exist, and while a run is in flight (e.g. exit() 
+   * called by a worker or during StartThreads()) at least one of them never
+   * returns, which may well be the calling thread
+   */
+  ~ThreadPool() {
+    std::unique_lock<std::mutex> lock{run_mutex, std::defer_lock};
+    if(getpid() != owner_pid || 
+       IsWorkerThread() == true ||
+       lock.try_lock() == false) {
+      Abandon();
+      return;
+    }
+    
+    exit_flag.store(true, std::memory_order_release);
+    current_phase++;
+    
+    for(uint64_t thread_id = 0;thread_id < thread_list.size();thread_id++) {
+      Wake(thread_id);
+    }
+    
+    for(std::thread &t : thread_list) {
+      t.join();
+    }
+    
+    return;
+  }
+  
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  
+  /*
+   * GetDefault() - Returns the pool used by StartThreads()
+   *
+   * The pool starts empty and grows to the largest thread count requested
+   */
+  static ThreadPool &GetDefault() {
+    static ThreadPool pool{};
+    return pool;
+  }
+  
+  /*
+   * GetThreadNum() - Returns the number of workers in the pool
+   */
+  inline uint64_t GetThreadNum() const {
+    return thread_list.size();
+  }
+  
+  /*
+   * Run() - Calls fn(thread_id, args...) on workers 0 to num_threads - 1 and
+   *         returns after all of them have finished
+   *
+   * Like std::thread, each worker calls its own copy of fn with its own 
+   * copies of args; pass pointers or std::ref() to share state. Nested runs, concurrent runs and runs in a forked child fall back to 
+   * RunUnpooled()
+   */
+  template <typename Fn, typename... Args>
+  void Run(uint64_t num_threads, Fn &&fn, Args &&... args) {
+    RunOn(num_threads, nullptr, fn, args...);
+    
+    return;
+  }
+  
+  /*
+   * RunOnCores() - Same as Run(), but worker i is pinned to core_list[i] and
+   *                there is one worker per element
+   *
+   * The placement only applies to this run; the next Run() moves workers
+   * back to the default placement. Fallback threads are pinned the same way
+   * (see RunUnpooledOnCores()). Returns the number of threads that could 
+   * not be pinned to their core
+   */
+  template <typename Fn, typename... Args>
+  uint64_t RunOnCores(const std::vector<int> &core_list, 
+                      Fn &&fn, 
+                      Args &&... args) {
+    return RunOn(core_list.size(), &core_list, fn, args...);
+  }
+  
+  /*
+   * RunUnpooled() - Spawns a fresh thread for each thread ID and joins them
+   *
+   * This is how threads were launched before the pool is introduced
+   */
+  template <typename Fn, typename... Args>
+  static void RunUnpooled(uint64_t num_threads, Fn &&fn, Args &&... args) {
+    std::vector<std::thread> thread_list;
+  
+    // Launch a group of threads
+    for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+      thread_list.push_back(std::thread(fn, thread_id, args...));
+    }
+  
+    // Join the threads with the main thread
+    for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+      thread_list[thread_id].join();
+    }
+    
+    return;
+  }
+  
+  /*
+   * RunUnpooledOnCores() - Same as RunUnpooled(), but thread i pins itself
+   *                        to core_list[i] before calling fn
+   *
+   * Returns the number of threads that could not be pinned
+   */
+  template <typename Fn, typename... Args>
+  static uint64_t RunUnpooledOnCores(const std::vector<int> &core_list, 
+                                     Fn &&fn, 
+                                     Args &&... args) {
+    std::vector<std::thread> thread_list;
+    std::atomic<uint64_t> unpinned_num{0UL};
+    
+    // fn and args are copied into each thread, as std::thread does
+    for(uint64_t thread_id = 0;thread_id < core_list.size();thread_id++) {
+      int core_id = core_list[thread_id];
+      thread_list.push_back(std::thread(
+        [core_id, &unpinned_num](typename std::decay<Fn>::type thread_fn,
+                                 uint64_t id,
+                                 typename std::decay<Args>::type... 
+                                   thread_args) {
+          if(PinToCore(core_id) == false) {
+            unpinned_num.fetch_add(1UL, std::memory_order_relaxed);
+          }
+          
+          thread_fn(id, thread_args...);
+        }, fn, thread_id, args...));
+    }
+    
+    for(std::thread &t : thread_list) {
+      t.join();
+    }
+    
+    return unpinned_num.load();
+  }
+};
  
-// Template function to launch threads
-// This does not define anything but to specify a template so it is
-// OK to put it here
+/*
+ * StartThreads() - Launches fn(thread_id, args...) on num_threads threads
+ *                  and waits for them to finish
+ *
+ * Threads are taken from the default ThreadPool, so calling this repeatedly
+ * does not create new threads
+ */
 template <typename Fn, typename... Args>
 void StartThreads(uint64_t num_threads, Fn &&fn, Args &&... args) {
-  std::vector<std::thread> thread_list;
+  ThreadPool::GetDefault().Run(num_threads, 
+                               std::forward<Fn>(fn), 
+                               std::forward<Args>(args)...);
+  
+  return;
+}
 
-  // Launch a group of threads
-  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
-    thread_list.push_back(std::thread(fn, thread_id, args...));
+/*
+ * StartThreadsOnCores() - Launches one thread on each core in the list
+ *
+ * Thread i is pinned to core_list[i] for this call only; later 
+ * StartThreads() calls use the default placement again, so phases that 
+ * should share a placement must each be started with it. An empty list is
+ * an error, since it would silently run nothing. Threads that could not be
+ * pinned (e.g. the core is outside the affinity mask) still run, but a
+ * warning is printed since the measurement is not what was asked for
+ */
+template <typename Fn, typename... Args>
+void StartThreadsOnCores(const std::vector<int> &core_list, 
+                         Fn &&fn, 
+                         Args &&... args) {
+  if(core_list.empty() == true) {
+    fprintf(stderr, "ERROR: StartThreadsOnCores() with no cores\n");
+    exit(1);
+  }
+  
+  uint64_t unpinned_num = \
+    ThreadPool::GetDefault().RunOnCores(core_list, 
+                                        std::forward<Fn>(fn), 
+                                        std::forward<Args>(args)...);
+  if(unpinned_num != 0UL) {
+    fprintf(stderr, 
+            "WARNING: %lu of %lu threads could not be pinned to their core"
+            " and ran unpinned\n",
+            unpinned_num, 
+            core_list.size());
+  }
+  
+  return;
+}
+
+/*
+ * class LaunchReport - Per-thread release and finish timestamps of a 
+ *                      synchronized launch
+ *
+ * Timestamps are in nanoseconds from GetSteadyClockNs(). Start skew is the
+ * time between the first and the last thread being released from the 
+ * barrier; finish skew is the time between the first and the last thread
+ * finishing. The overlap window is the interval during which all threads
+ * were running, i.e. from the last release to the first finish
+ */
+class LaunchReport {
+ private:
+  std::vector<uint64_t> start_list;
+  std::vector<uint64_t> finish_list;
+  
+  // Operations of each thread counted in the overlap window, and the length
+  // of that window in nanoseconds (0 if there is none)
+  std::vector<uint64_t> window_op_list;
+  uint64_t window_ns;
+  
+ public:
+  
+  /*
+   * Constructor
+   */
+  LaunchReport(const std::vector<uint64_t> &p_start_list,
+               const std::vector<uint64_t> &p_finish_list,
+               const std::vector<uint64_t> &p_window_op_list,
+               uint64_t p_window_ns) :
+    start_list{p_start_list},
+    finish_list{p_finish_list},
+    window_op_list{p_window_op_list},
+    window_ns{p_window_ns} {
+    assert(start_list.size() == finish_list.size());
+    assert(start_list.size() == window_op_list.size());
+    assert(start_list.size() > 0UL);
+    
+    return;
+  }
+  
+  /*
+   * GetThreadNum() - Returns the number of threads launched
+   */
+  inline uint64_t GetThreadNum() const {
+    return start_list.size();
+  }
+  
+  inline const std::vector<uint64_t> &GetStartList() const {
+    return start_list;
+  }
+  
+  inline const std::vector<uint64_t> &GetFinishList() const {
+    return finish_list;
+  }
+  
+  /*
+   * GetThreadInterval() - Returns the number of seconds a thread has run
+   */
+  inline double GetThreadInterval(uint64_t thread_id) const {
+    return (finish_list[thread_id] - start_list[thread_id]) / 1e9;
+  }
+  
+  /*
+   * GetStartSkew() - Returns the difference between the latest and the
+   *                  earliest release time in seconds
+   */
+  double GetStartSkew() const {
+    auto it = std::minmax_element(start_list.begin(), start_list.end());
+    return (*it.second - *it.first) / 1e9;
+  }
+  
+  /*
+   * GetFinishSkew() - Returns the difference between the latest and the 
+   *                   earliest finish time in seconds
+   */
+  double GetFinishSkew() const {
+    auto it = std::minmax_element(finish_list.begin(), finish_list.end());
+    return (*it.second - *it.first) / 1e9;
+  }
+  
+  /*
+   * GetTotalInterval() - Returns seconds between the first release and the
+   *                      last finish
+   */
+  double GetTotalInterval() const {
+    uint64_t first_start = \
+      *std::min_element(start_list.begin(), start_list.end());
+    uint64_t last_finish = \
+      *std::max_element(finish_list.begin(), finish_list.end());
+      
+    return (last_finish - first_start) / 1e9;
+  }
+  
+  /*
+   * GetOverlapInterval() - Returns seconds during which all threads were
+   *                        running, or 0 if there is no such window
+   */
+  double GetOverlapInterval() const {
+    uint64_t last_start = \
+      *std::max_element(start_list.begin(), start_list.end());
+    uint64_t first_finish = \
+      *std::min_element(finish_list.begin(), finish_list.end());
+    
+    if(first_finish <= last_start) {
+      return 0.0;
+    }
+    
+    return (first_finish - last_start) / 1e9;
+  }
+  
+  /*
+   * GetOverlapOpList() - Returns the number of operations each thread has
+   *                      counted in the overlap window
+   */
+  inline const std::vector<uint64_t> &GetOverlapOpList() const {
+    return window_op_list;
+  }
+  
+  /*
+   * GetOverlapThroughput() - Returns operations per second counted while all
+   *                          threads were running, or 0 if there is no such
+   *                          window
+   *
+   * Counters are read when the last thread is released and again when the 
+   * first thread finishes, so threads that started early or finished late
+   * do not inflate the result, unlike dividing total operations by the 
+   * total interval. Only launches given a ThreadCounterArray count 
+   * operations
+   */
+  double GetOverlapThroughput() const {
+    if(window_ns == 0UL) {
+      return 0.0;
+    }
+    
+    uint64_t total = \
+      std::accumulate(window_op_list.begin(), window_op_list.end(), 0UL);
+    
+    return total * 1e9 / window_ns;
+  }
+  
+  /*
+   * Print() - Prints skew and interval information
+   */
+  void Print() const {
+    dbg_printf("%lu threads; total %f s; overlap %f s; "
+               "start skew %f us; finish skew %f us\n",
+               GetThreadNum(),
+               GetTotalInterval(),
+               GetOverlapInterval(),
+               GetStartSkew() * 1e6,
+               GetFinishSkew() * 1e6);
+    
+    return;
   }
+};
 
-  // Join the threads with the main thread
+/*
+ * StartThreadsSynchronized() - Launches fn(thread_id, args...) on one thread
+ *                              per counter, which are released all at once
+ *
+ * Unlike StartThreads(), threads do not start executing fn as soon as they 
+ * are dispatched. Instead, every thread waits on a spin barrier, and then
+ * records its release time before calling fn. This prevents the first few
+ * threads from running uncontended while the rest are being woken up, and 
+ * the returned report tells how large the remaining skew is.
+ *
+ * fn counts its operations in *counter_array_p. The last thread released
+ * and the first thread finishing read all counters, which gives the 
+ * operations done while all threads were running
+ */
+template <typename Fn, typename... Args>
+LaunchReport StartThreadsSynchronized(ThreadCounterArray *counter_array_p,
+                                      Fn &&fn, 
+                                      Args &&... args) {
+  uint64_t num_threads = counter_array_p->GetThreadNum();
+  
+  // Each thread only writes its own timestamps, so make sure they do not 
+  // disturb each other when the run starts and ends
+  PaddedArray<std::pair<uint64_t, uint64_t>> time_list{num_threads};
+  SpinBarrier barrier{num_threads};
+  
+  // Counters and time at both ends of the overlap window
+  std::atomic<uint64_t> started_num{0UL};
+  std::atomic<uint64_t> finished_num{0UL};
+  std::vector<uint64_t> window_start_list{};
+  std::vector<uint64_t> window_finish_list{};
+  uint64_t window_start_ns = 0UL;
+  uint64_t window_finish_ns = 0UL;
+  
+  StartThreads(num_threads, [&](uint64_t thread_id) {
+    barrier.Wait();
+    time_list[thread_id].first = GetSteadyClockNs();
+    
+    if(started_num.fetch_add(1UL) + 1UL == num_threads) {
+      window_start_list = counter_array_p->GetSnapshot();
+      window_start_ns = GetSteadyClockNs();
+    }
+    
+    fn(thread_id, args...);
+    
+    time_list[thread_id].second = GetSteadyClockNs();
+    
+    if(finished_num.fetch_add(1UL) == 0UL) {
+      window_finish_ns = GetSteadyClockNs();
+      window_finish_list = counter_array_p->GetSnapshot();
+    }
+  });
+  
+  std::vector<uint64_t> start_list{};
+  std::vector<uint64_t> finish_list{};
   for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
-    thread_list[thread_id].join();
+    start_list.push_back(time_list[thread_id].first);
+    finish_list.push_back(time_list[thread_id].second);
   }
   
-  return;
+  // The first thread may finish before the last one is released
+  std::vector<uint64_t> window_op_list(num_threads, 0UL);
+  uint64_t window_ns = 0UL;
+  if(window_finish_ns > window_start_ns) {
+    for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+      window_op_list[thread_id] = \
+        window_finish_list[thread_id] - window_start_list[thread_id];
+    }
+    
+    window_ns = window_finish_ns - window_start_ns;
+  }
+  
+  return LaunchReport{start_list, finish_list, window_op_list, window_ns};
+}
+
+/*
+ * StartThreadsSynchronized() - Same as above, but operations are not counted
+ */
+template <typename Fn, typename... Args>
+LaunchReport StartThreadsSynchronized(uint64_t num_threads, 
+                                      Fn &&fn, 
+                                      Args &&... args) {
+  ThreadCounterArray counter_array{num_threads};
+  
+  return StartThreadsSynchronized(&counter_array, 
+                                  std::forward<Fn>(fn), 
+                                  std::forward<Args>(args)...);
 }
 
 /*
@@ -63,17 +1032,20 @@ void StartThreads(uint64_t num_threads, Fn &&fn, Args &&... args) {
  *
  * This generator is a template class letting users to choose the number
  *
- * Note that this object uses C++11 library generator which is slow, and super
- * non-scalable.
+ * Each object owns a FastRandom (xoshiro256**) seeded from GetRandomSeed(),
+ * or from the given seed, so objects are cheap to construct and draws on
+ * different threads share nothing. Numbers are unbiased (see
+ * GetBoundedRandom()). IntType could be any integer type up to 64 bits
  *
  * Note 2: lower and upper are both inclusive bounds
  */
 template <typename IntType>
 class Random {
  private:
-  std::random_device device;
-  std::default_random_engine engine;
-  std::uniform_int_distribution<IntType> dist;
+  FastRandom engine;
+  IntType lower;
+  // Number of values in [lower, upper]; 0 means all 2^64 values
+  uint64_t range;
 
  public:
   
@@ -83,17 +1055,21 @@ class Random {
    * Lower and upper are both inclusive bounds, which means the random number
    * is inside range defined by [lower, upper] instead of [lower, upper)
    */
-  Random(IntType lower, IntType upper) :
-    device{},
-    engine{device()},
-    dist{lower, upper}
-  {}
+  Random(IntType p_lower, IntType upper, uint64_t seed = GetRandomSeed()) :
+    engine{seed},
+    lower{p_lower},
+    range{static_cast<uint64_t>(upper) - static_cast<uint64_t>(p_lower) + 1UL} {
+    assert(p_lower <= upper);
+
+    return;
+  }
   
   /*
    * Get() - Get a random number of specified type
    */
   inline IntType Get() {
-    return dist(engine);
+    return static_cast<IntType>(static_cast<uint64_t>(lower) + \
+                                engine.GetBounded(range));
   }
   
   /*
@@ -106,11 +1082,17 @@ class Random {
 
 /*
  * class Timer - Measures time usage for testing purpose
+ *
+ * This uses steady_clock, which is monotonic, unlike system_clock that
+ * could jump when the wall clock is adjusted. For short regions use
+ * CycleTimer instead
  */
 class Timer {
  private:
-  std::chrono::time_point<std::chrono::system_clock> start;
-  std::chrono::time_point<std::chrono::system_clock> end;
+  std::chrono::time_point<std::chrono::steady_clock> start;
+  std::chrono::time_point<std::chrono::steady_clock> end;
+  // Seconds taken off every interval
+  double overhead;
   
  public: 
  
@@ -118,11 +1100,18 @@ class Timer {
    * Constructor
    *
    * It takes an argument, which denotes whether the timer should start 
-   * immediately. By default it is true
+   * immediately. By default it is true. If subtract_flag is set, the
+   * overhead of an empty region measured by ClockOverhead is taken off
+   * the interval
    */
-  Timer(bool start = true) : 
+  Timer(bool start = true, bool subtract_flag = false) : 
     start{},
-    end{} {
+    end{},
+    overhead{0.0} {
+    if(subtract_flag == true) {
+      overhead = ClockOverhead::Get().steady_clock_ns / 1e9;
+    }
+
     if(start == true) {
       Start();
     }
@@ -137,7 +1126,7 @@ class Timer {
    * restart
    */
   inline void Start() {
-    start = std::chrono::system_clock::now();
+    start = std::chrono::steady_clock::now();
     
     return;
   }
@@ -150,7 +1139,7 @@ class Timer {
    * the last Start() and this Stop()
    */
   inline double Stop() {
-    end = std::chrono::system_clock::now();
+    end = std::chrono::steady_clock::now();
     
     return GetInterval();
   }
@@ -161,7 +1150,7 @@ class Timer {
    */
   inline double GetInterval() const {
     std::chrono::duration<double> elapsed_seconds = end - start;
-    return elapsed_seconds.count();
+    return std::max(elapsed_seconds.count() - overhead, 0.0);
   }
 };
 
@@ -186,6 +1175,9 @@ class Timer {
  *
  * Please note that here upper is not inclusive (i.e. it will not appear as the 
  * random number)
+ *
+ * The modulo by a constant is compiled into multiplications; for bounds that
+ * are only known at runtime use RuntimeInt64Random below
  */
 template <uint64_t lower = 0UL, 
           uint64_t upper = UINT64_MAX>
@@ -199,6 +1191,13 @@ class SimpleInt64Random {
    * hashers are stored as a constant object
    */
   inline uint64_t operator()(uint64_t value, uint64_t salt) const {
+    return lower + Hash(value, salt) % (upper - lower);
+  }
+
+  /*
+   * Hash() - Hashes value and salt into 0 - UINT64_MAX
+   */
+  static inline uint64_t Hash(uint64_t value, uint64_t salt) {
     //
     // The following code segment is copied from MurmurHash3, and is used
     // as an answer on the Internet:
@@ -215,7 +1214,63 @@ class SimpleInt64Random {
     value *= 0xc4ceb9fe1a85ec53;
     value ^= value >> 33;
 
-    return lower + value % (upper - lower);
+    return value;
+  }
+};
+
+/*
+ * class RuntimeInt64Random - SimpleInt64Random with bounds given at runtime
+ *
+ * This hashes value and salt the same way as SimpleInt64Random, but the
+ * range is only known at runtime (e.g. the number of keys from Argv), so
+ * value % (upper - lower) would be a 64 bit division, which costs tens of
+ * cycles. Instead the hash is scaled into the range with a multiply-high:
+ * (hash * (upper - lower)) >> 64 takes the high 64 bits of the 128 bit
+ * product, which is one multiplication.
+ *
+ * Like the modulo, this is biased by at most (upper - lower) / 2^64, which
+ * does not matter for key generation; it picks different values than
+ * SimpleInt64Random for the same arguments, since the result depends on
+ * the high bits of the hash rather than the low bits.
+ *
+ * Please note that here upper is not inclusive (i.e. it will not appear as the 
+ * random number)
+ */
+class RuntimeInt64Random {
+ private:
+  uint64_t lower;
+  uint64_t range;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  RuntimeInt64Random(uint64_t p_lower = 0UL, uint64_t upper = UINT64_MAX) :
+    lower{p_lower},
+    range{upper - p_lower} {
+    assert(p_lower < upper);
+
+    return;
+  }
+
+  /*
+   * operator()() - Mimics function call
+   */
+  inline uint64_t operator()(uint64_t value, uint64_t salt) const {
+    unsigned __int128 product = \
+      static_cast<unsigned __int128>(SimpleInt64Random<>::Hash(value, salt)) * \
+      range;
+
+    return lower + static_cast<uint64_t>(product >> 64);
+  }
+
+  inline uint64_t GetLower() const {
+    return lower;
+  }
+
+  inline uint64_t GetUpper() const {
+    return lower + range;
   }
 };
 
@@ -708,8 +1763,12 @@ class CacheMeter {
   void Stop() {};
   void PrintL3CacheUtilization() {};
   void PrintL1CacheUtilization() {};
-  void GetL3CacheUtilization() {};
-  void GetL1CacheUtilization() {};
+  std::pair<long long, long long> GetL3CacheUtilization() {
+    return std::make_pair(0LL, 0LL);
+  };
+  std::pair<long long, long long> GetL1CacheUtilization() {
+    return std::make_pair(0LL, 0LL);
+  };
 };
 
 #else
@@ -951,8 +2010,12 @@ class Permutation {
   
   /*
    * Generate() - Generates a permutation and store them inside data
+   *
+   * The same seed gives the same permutation
    */
-  void Generate(size_t count, IntType start=IntType{0}) {
+  void Generate(size_t count,
+                IntType start=IntType{0},
+                uint64_t seed=GetRandomSeed()) {
     // Extend data vector to fill it with elements
     data.resize(count);  
 
@@ -960,15 +2023,14 @@ class Permutation {
     // start to start + count - 1
     std::iota(data.begin(), data.end(), start);
     
-    // The two arguments define a closed interval, NOT open interval
-    Random<IntType> rand{0, static_cast<IntType>(count) - 1};
-    
-    // Then swap all elements with a random position
-    for(size_t i = 0;i < count;i++) {
-      IntType random_key = rand();
+    // Fisher-Yates: swap each element with a random one at or before it,
+    // such that every permutation is equally likely
+    FastRandom rand{seed};
+    for(size_t i = count;i > 1;i--) {
+      size_t random_index = rand.GetBounded(i);
       
       // Swap two numbers
-      std::swap(data[i], data[random_key]);
+      std::swap(data[i - 1], data[random_index]);
     }
     
     return;
@@ -982,8 +2044,10 @@ class Permutation {
   /*
    * Constructor - Starts the generation process
    */
-  Permutation(size_t count, IntType start=IntType{0}) {
-    Generate(count, start);
+  Permutation(size_t count,
+              IntType start=IntType{0},
+              uint64_t seed=GetRandomSeed()) {
+    Generate(count, start, seed);
     
     return;
   }
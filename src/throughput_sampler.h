@@ -0,0 +1,362 @@
+
+#pragma once
+
+#ifndef _THROUGHPUT_SAMPLER_H
+#define _THROUGHPUT_SAMPLER_H
+
+#include "plot_suite.h"
+#include "bench_driver.h"
+
+/*
+ * class ThroughputSampler - Records throughput over time by periodically
+ *                           reading per-thread operation counters
+ *
+ * A background thread wakes up every interval and stores the sum of all
+ * counters, together with a timestamp, into a ring buffer that is allocated
+ * up front. Sampling never allocates memory or takes a lock, and workers
+ * never write anything except their own padded counter, so the cost to them
+ * is one cache line transfer per interval. If the ring is full the oldest
+ * samples are overwritten.
+ *
+ * Wake-ups are scheduled on absolute deadlines, such that a late wake-up
+ * does not shift every later sample. Throughput of an interval is always
+ * computed from the actual timestamps.
+ *
+ * Usage:
+ *   ThroughputSampler sampler{num_threads, 1.0};
+ *   sampler.Start();
+ *   RunForDuration(sampler.GetCounterArray(), 60.0, op_fn);
+ *   sampler.Stop();
+ *
+ *   sampler.DumpCSV("throughput.csv");
+ *   LineChart lc{};
+ *   sampler.FillChart(&lc, "BwTree");
+ *   lc.Draw("throughput.pdf");
+ */
+class ThroughputSampler {
+ public:
+  // Identifies files written by DumpBinary()
+  static constexpr uint64_t BINARY_MAGIC = 0x31504d4153505448UL;
+
+ private:
+  ThreadCounterArray counter_array;
+  uint64_t interval_ns;
+
+  // Ring of samples; sample i is stored at i % capacity
+  std::vector<uint64_t> timestamp_list;
+  std::vector<uint64_t> total_list;
+  uint64_t sample_num;
+
+  // Time of Start(); timestamps are relative to it
+  uint64_t start_ns;
+
+  std::thread sampler_thread;
+  std::atomic<bool> stop_flag;
+
+  /*
+   * TakeSample() - Appends the current total to the ring
+   */
+  inline void TakeSample() {
+    uint64_t index = sample_num % timestamp_list.size();
+    timestamp_list[index] = GetSteadyClockNs() - start_ns;
+    total_list[index] = counter_array.GetTotal();
+    sample_num++;
+
+    return;
+  }
+
+  /*
+   * SampleLoop() - Body of the sampler thread
+   */
+  void SampleLoop() {
+    std::chrono::steady_clock::time_point deadline = \
+      std::chrono::steady_clock::now();
+
+    while(stop_flag.load(std::memory_order_relaxed) == false) {
+      deadline += std::chrono::nanoseconds{interval_ns};
+      std::this_thread::sleep_until(deadline);
+
+      TakeSample();
+    }
+
+    return;
+  }
+
+ public:
+
+  /*
+   * Constructor
+   *
+   * capacity is the number of samples kept. Each sample is a timestamp and a
+   * total of 8 bytes each, allocated up front, so the default of 1M samples
+   * takes 16 MB and keeps about 17 minutes at 1 ms interval
+   */
+  ThroughputSampler(uint64_t thread_num,
+                    double p_interval_ms = 1.0,
+                    uint64_t capacity = 1UL << 20) :
+    counter_array{thread_num},
+    interval_ns{static_cast<uint64_t>(p_interval_ms * 1e6)},
+    timestamp_list(capacity, 0UL),
+    total_list(capacity, 0UL),
+    sample_num{0UL},
+    start_ns{0UL},
+    sampler_thread{},
+    stop_flag{true} {
+    assert(interval_ns > 0UL);
+    assert(capacity > 1UL);
+
+    return;
+  }
+
+  /*
+   * Destructor - Stops the sampler thread if it is still running
+   */
+  ~ThroughputSampler() {
+    Stop();
+
+    return;
+  }
+
+  ThroughputSampler(const ThroughputSampler &) = delete;
+  ThroughputSampler &operator=(const ThroughputSampler &) = delete;
+
+  /*
+   * GetCounterArray() - Returns counters that workers should add to
+   */
+  inline ThreadCounterArray *GetCounterArray() {
+    return &counter_array;
+  }
+
+  /*
+   * Add() - Counts operations of a thread; only called by that thread
+   */
+  inline void Add(uint64_t thread_id, uint64_t delta = 1UL) {
+    counter_array.Add(thread_id, delta);
+
+    return;
+  }
+
+  /*
+   * Start() - Clears previous samples and counters, and starts sampling
+   */
+  void Start() {
+    assert(sampler_thread.joinable() == false);
+
+    counter_array.Reset();
+    sample_num = 0UL;
+    start_ns = GetSteadyClockNs();
+    TakeSample();
+
+    stop_flag.store(false, std::memory_order_relaxed);
+    sampler_thread = std::thread{&ThroughputSampler::SampleLoop, this};
+
+    return;
+  }
+
+  /*
+   * Stop() - Stops sampling and takes a final sample
+   */
+  void Stop() {
+    if(sampler_thread.joinable() == false) {
+      return;
+    }
+
+    stop_flag.store(true, std::memory_order_relaxed);
+    sampler_thread.join();
+    TakeSample();
+
+    return;
+  }
+
+  /*
+   * StartThreads() - Samples while running StartThreads()
+   *
+   * fn is called as fn(thread_id, args...) once per thread, and should count
+   * its operations with Add()
+   */
+  template <typename Fn, typename... Args>
+  void StartThreads(Fn &&fn, Args &&... args) {
+    Start();
+    ::StartThreads(counter_array.GetThreadNum(), fn, args...);
+    Stop();
+
+    return;
+  }
+
+  /*
+   * RunForDuration() - Samples while running ::RunForDuration()
+   *
+   * op_fn is called as op_fn(thread_id, args...), and each call counts
+   */
+  template <typename Fn, typename... Args>
+  ThroughputReport RunForDuration(double seconds, Fn &&op_fn, Args &&... args) {
+    Start();
+    ThroughputReport report = \
+      ::RunForDuration(&counter_array, seconds, op_fn, args...);
+    Stop();
+
+    return report;
+  }
+
+  /*
+   * GetSampleNum() - Returns the number of samples in the ring
+   */
+  inline uint64_t GetSampleNum() const {
+    return std::min<uint64_t>(sample_num, timestamp_list.size());
+  }
+
+  /*
+   * GetDroppedNum() - Returns the number of samples overwritten
+   */
+  inline uint64_t GetDroppedNum() const {
+    return sample_num - GetSampleNum();
+  }
+
+  /*
+   * GetTimestamp() - Returns the time of the i-th sample in the ring in
+   *                  nanoseconds since Start()
+   */
+  inline uint64_t GetTimestamp(uint64_t i) const {
+    return timestamp_list[(GetDroppedNum() + i) % timestamp_list.size()];
+  }
+
+  /*
+   * GetTotal() - Returns the total operation count at the i-th sample
+   */
+  inline uint64_t GetTotal(uint64_t i) const {
+    return total_list[(GetDroppedNum() + i) % total_list.size()];
+  }
+
+  /*
+   * GetThroughput() - Returns throughput in ops/sec between sample i - 1
+   *                   and sample i
+   */
+  double GetThroughput(uint64_t i) const {
+    assert(i > 0UL && i < GetSampleNum());
+
+    uint64_t ns = GetTimestamp(i) - GetTimestamp(i - 1);
+    if(ns == 0UL) {
+      return 0.0;
+    }
+
+    return (GetTotal(i) - GetTotal(i - 1)) * 1e9 / ns;
+  }
+
+  /*
+   * DumpCSV() - Writes one line per interval with its end time in seconds,
+   *             the total operation count and the throughput in ops/sec
+   *
+   * Returns false if the file could not be written
+   */
+  bool DumpCSV(const std::string &file_name) const {
+    FILE *fp = fopen(file_name.c_str(), "w");
+    if(fp == nullptr) {
+      return false;
+    }
+
+    fprintf(fp, "time,ops,throughput\n");
+    for(uint64_t i = 1;i < GetSampleNum();i++) {
+      fprintf(fp, "%.6f,%lu,%.1f\n",
+              GetTimestamp(i) / 1e9,
+              GetTotal(i),
+              GetThroughput(i));
+    }
+
+    bool ret = (ferror(fp) == 0);
+    fclose(fp);
+
+    return ret;
+  }
+
+  /*
+   * DumpBinary() - Writes samples as raw 64-bit integers
+   *
+   * The layout is BINARY_MAGIC, the interval in ns, the number of samples,
+   * and then (timestamp, total) of each sample, all in native byte order.
+   * Returns false if the file could not be written
+   */
+  bool DumpBinary(const std::string &file_name) const {
+    FILE *fp = fopen(file_name.c_str(), "wb");
+    if(fp == nullptr) {
+      return false;
+    }
+
+    uint64_t header[3] = {BINARY_MAGIC, interval_ns, GetSampleNum()};
+    fwrite(header, sizeof(header), 1, fp);
+
+    for(uint64_t i = 0;i < GetSampleNum();i++) {
+      uint64_t sample[2] = {GetTimestamp(i), GetTotal(i)};
+      fwrite(sample, sizeof(sample), 1, fp);
+    }
+
+    bool ret = (ferror(fp) == 0);
+    fclose(fp);
+
+    return ret;
+  }
+
+  /*
+   * FillChart() - Appends time in seconds as X values and throughput in
+   *               MOps/sec as a new line, and sets axis labels
+   *
+   * At most max_point_num points are drawn; adjacent intervals are merged
+   * if there are more. Only the first line of a chart appends X values, so
+   * samplers drawn in the same chart must have the same number of points
+   */
+  void FillChart(LineChart *chart_p,
+                 const std::string &name,
+                 uint64_t max_point_num = 200UL) const {
+    assert(GetSampleNum() > 1UL);
+
+    uint64_t interval_num = GetSampleNum() - 1UL;
+    uint64_t step = (interval_num + max_point_num - 1UL) / max_point_num;
+    bool x_flag = chart_p->GetXValueCount() == 0UL;
+
+    chart_p->NewYValueList();
+    for(uint64_t i = step;i <= interval_num;i += step) {
+      uint64_t ns = GetTimestamp(i) - GetTimestamp(i - step);
+      uint64_t ops = GetTotal(i) - GetTotal(i - step);
+
+      if(x_flag == true) {
+        chart_p->AppendXValue(GetTimestamp(i) / 1e9);
+      }
+
+      chart_p->AppendYValue(ns == 0UL ? 0.0 : ops * 1e3 / ns);
+    }
+
+    chart_p->AppendLineName(name);
+    chart_p->SetXAxisLabel("Time (Sec)");
+    chart_p->SetYAxisLabel("Throughput (MOps/Sec)");
+
+    return;
+  }
+
+  /*
+   * Print() - Prints the number of samples and the throughput range
+   */
+  void Print() const {
+    if(GetSampleNum() < 2UL) {
+      dbg_printf("No complete interval sampled\n");
+      return;
+    }
+
+    double min = INFINITY;
+    double max = 0.0;
+    for(uint64_t i = 1;i < GetSampleNum();i++) {
+      min = std::min(min, GetThroughput(i));
+      max = std::max(max, GetThroughput(i));
+    }
+
+    dbg_printf("%lu samples (%lu dropped) every %f ms; "
+               "throughput min %f max %f MOps/sec\n",
+               GetSampleNum(),
+               GetDroppedNum(),
+               interval_ns / 1e6,
+               min / 1e6,
+               max / 1e6);
+
+    return;
+  }
+};
+
+#endif
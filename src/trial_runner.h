@@ -0,0 +1,243 @@
+
+#pragma once
+
+#ifndef _TRIAL_RUNNER_H
+#define _TRIAL_RUNNER_H
+
+#include "plot_suite.h"
+#include "trial_stats.h"
+
+/*
+ * class TrialRunner - Runs benchmark configurations repeatedly and turns
+ *                     the results into bars with error bars
+ *
+ * A configuration is one bar of a BarChart: it has a group (the X tick,
+ * e.g. "Insert Only") and a bar name (the legend, e.g. "BwTree"). Its
+ * functor returns one measurement per call, e.g. throughput in MOps/sec.
+ *
+ * With interleaving, trial k of every configuration runs before trial
+ * k + 1 of any configuration, such that slow drift of the machine (thermal
+ * throttling, background jobs) is spread over all configurations instead
+ * of penalizing the ones that happen to run last.
+ *
+ * Usage:
+ *   TrialRunner runner{10};
+ *   runner.AddTrial("Insert\\nOnly", "BwTree", [&]() { ... });
+ *   runner.AddTrial("Insert\\nOnly", "SkipList", [&]() { ... });
+ *   runner.Run();
+ *
+ *   BarChart bc{};
+ *   runner.FillChart(&bc, TrialRunner::ErrorMode::CONFIDENCE_INTERVAL);
+ *   bc.Draw("compare.pdf");
+ */
+class TrialRunner {
+ public:
+  /*
+   * enum class ErrorMode - What the error bars show around the mean
+   */
+  enum class ErrorMode {
+    STDDEV,
+    CONFIDENCE_INTERVAL,
+    MIN_MAX,
+  };
+
+ private:
+  /*
+   * class Config - One bar
+   */
+  class Config {
+   public:
+    std::string group_name;
+    std::string bar_name;
+    std::function<double()> fn;
+    std::vector<double> sample_list;
+  };
+
+  uint64_t trial_num;
+  bool interleave_flag;
+  double confidence;
+
+  std::vector<Config> config_list;
+
+  /*
+   * RunTrial() - Runs one trial of a configuration
+   */
+  void RunTrial(Config *config_p, uint64_t trial) {
+    double value = config_p->fn();
+    config_p->sample_list.push_back(value);
+
+    dbg_printf("%s / %s: trial %lu; %f\n",
+               config_p->group_name.c_str(),
+               config_p->bar_name.c_str(),
+               trial,
+               value);
+
+    return;
+  }
+
+  /*
+   * AppendUnique() - Appends a name unless it is already in the list
+   */
+  static void AppendUnique(std::vector<std::string> *name_list_p,
+                           const std::string &name) {
+    if(std::find(name_list_p->begin(), name_list_p->end(), name) == \
+       name_list_p->end()) {
+      name_list_p->push_back(name);
+    }
+
+    return;
+  }
+
+ public:
+
+  /*
+   * Constructor
+   */
+  TrialRunner(uint64_t p_trial_num,
+              bool p_interleave_flag = true,
+              double p_confidence = TrialStats::DEFAULT_CONFIDENCE) :
+    trial_num{p_trial_num},
+    interleave_flag{p_interleave_flag},
+    confidence{p_confidence},
+    config_list{} {
+    assert(trial_num > 0UL);
+
+    return;
+  }
+
+  /*
+   * AddTrial() - Adds a configuration; fn is called as fn() and returns the
+   *              value of one trial
+   */
+  void AddTrial(const std::string &group_name,
+                const std::string &bar_name,
+                std::function<double()> fn) {
+    config_list.push_back(Config{group_name, bar_name, fn, {}});
+
+    return;
+  }
+
+  /*
+   * Run() - Runs trial_num trials of every configuration added
+   */
+  void Run() {
+    if(interleave_flag == true) {
+      for(uint64_t trial = 0;trial < trial_num;trial++) {
+        for(Config &config : config_list) {
+          RunTrial(&config, trial);
+        }
+      }
+    } else {
+      for(Config &config : config_list) {
+        for(uint64_t trial = 0;trial < trial_num;trial++) {
+          RunTrial(&config, trial);
+        }
+      }
+    }
+
+    return;
+  }
+
+  /*
+   * GetGroupNameList() - Returns group names in the order they were added
+   */
+  std::vector<std::string> GetGroupNameList() const {
+    std::vector<std::string> name_list{};
+    for(const Config &config : config_list) {
+      AppendUnique(&name_list, config.group_name);
+    }
+
+    return name_list;
+  }
+
+  /*
+   * GetBarNameList() - Returns bar names in the order they were added
+   */
+  std::vector<std::string> GetBarNameList() const {
+    std::vector<std::string> name_list{};
+    for(const Config &config : config_list) {
+      AppendUnique(&name_list, config.bar_name);
+    }
+
+    return name_list;
+  }
+
+  /*
+   * GetStats() - Returns statistics of a configuration after Run()
+   *
+   * Throws if the configuration does not exist
+   */
+  TrialStats GetStats(const std::string &group_name,
+                      const std::string &bar_name) const {
+    for(const Config &config : config_list) {
+      if(config.group_name == group_name && config.bar_name == bar_name) {
+        return TrialStats{config.sample_list, confidence};
+      }
+    }
+
+    dbg_printf("No trial %s / %s\n", group_name.c_str(), bar_name.c_str());
+    throw "Trial does not exist";
+  }
+
+  /*
+   * FillChart() - Appends one bar group per group name with the mean of
+   *               each bar, and the error of each bar; sets bar names
+   *
+   * Every group must have every bar
+   */
+  void FillChart(BarChart *chart_p, ErrorMode mode) const {
+    std::vector<std::string> bar_name_list = GetBarNameList();
+
+    for(const std::string &group_name : GetGroupNameList()) {
+      std::vector<double> value_list{};
+      std::vector<std::pair<double, double>> error_list{};
+
+      for(const std::string &bar_name : bar_name_list) {
+        TrialStats stats = GetStats(group_name, bar_name);
+        double mean = stats.GetMean();
+        value_list.push_back(mean);
+
+        switch(mode) {
+          case ErrorMode::STDDEV:
+            error_list.push_back(std::make_pair(stats.GetStddev(),
+                                                stats.GetStddev()));
+            break;
+          case ErrorMode::CONFIDENCE_INTERVAL:
+            error_list.push_back(
+              std::make_pair(mean - stats.GetConfidenceInterval().first,
+                             stats.GetConfidenceInterval().second - mean));
+            break;
+          case ErrorMode::MIN_MAX:
+            error_list.push_back(std::make_pair(mean - stats.GetMin(),
+                                                stats.GetMax() - mean));
+            break;
+        }
+      }
+
+      chart_p->AppendBarGroup<double>(group_name, value_list);
+      chart_p->AppendError<double>(error_list);
+    }
+
+    for(const std::string &bar_name : bar_name_list) {
+      chart_p->AppendBarName(bar_name);
+    }
+
+    chart_p->SetDrawErrorFlag(true);
+
+    return;
+  }
+
+  /*
+   * Print() - Prints statistics of every configuration
+   */
+  void Print() const {
+    for(const Config &config : config_list) {
+      TrialStats{config.sample_list, confidence}.Print(
+        config.group_name + " / " + config.bar_name);
+    }
+
+    return;
+  }
+};
+
+#endif
@@ -0,0 +1,336 @@
+
+#pragma once
+
+#ifndef _TRIAL_STATS_H
+#define _TRIAL_STATS_H
+
+#include "test_suite.h"
+
+/*
+ * class TrialStats - Summary statistics of repeated measurements of one
+ *                    configuration
+ *
+ * The confidence interval is a percentile bootstrap of the mean: the
+ * samples are resampled with replacement resample_num times, and the
+ * interval is cut from the distribution of the resampled means. Unlike
+ * mean +/- t * stddev / sqrt(n) it does not assume the samples are normal,
+ * which throughput numbers with occasional slow runs usually are not.
+ *
+ * The bootstrap is seeded with a constant, such that the same samples
+ * always give the same interval
+ */
+class TrialStats {
+ public:
+  static constexpr double DEFAULT_CONFIDENCE = 0.95;
+  static constexpr uint64_t DEFAULT_RESAMPLE_NUM = 10000UL;
+
+ private:
+  std::vector<double> sample_list;
+
+  double mean;
+  double median;
+  double stddev;
+  double min;
+  double max;
+
+  double confidence;
+  double ci_lower;
+  double ci_upper;
+
+ public:
+
+  /*
+   * GetMedian() - Returns the median of a list of values
+   */
+  static double GetMedian(std::vector<double> value_list) {
+    assert(value_list.size() > 0UL);
+    std::sort(value_list.begin(), value_list.end());
+
+    size_t middle = value_list.size() / 2;
+    if(value_list.size() % 2 == 1UL) {
+      return value_list[middle];
+    }
+
+    return (value_list[middle - 1] + value_list[middle]) / 2.0;
+  }
+
+  /*
+   * GetMean() - Returns the mean of a list of values
+   */
+  static double GetMean(const std::vector<double> &value_list) {
+    assert(value_list.size() > 0UL);
+
+    return std::accumulate(value_list.begin(), value_list.end(), 0.0) / \
+           value_list.size();
+  }
+
+  /*
+   * GetStddev() - Returns the sample standard deviation, or 0 if there is
+   *               only one value
+   */
+  static double GetStddev(const std::vector<double> &value_list) {
+    if(value_list.size() < 2UL) {
+      return 0.0;
+    }
+
+    double mean = GetMean(value_list);
+    double sum = 0.0;
+    for(double value : value_list) {
+      sum += (value - mean) * (value - mean);
+    }
+
+    return std::sqrt(sum / (value_list.size() - 1UL));
+  }
+
+  /*
+   * GetStudentT95() - Returns the two-sided 95% critical value of Student's
+   *                   t distribution
+   */
+  static double GetStudentT95(uint64_t df) {
+    static const double table[] = {
+      12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+      2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+      2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+
+    if(df == 0UL) {
+      return INFINITY;
+    } else if(df <= sizeof(table) / sizeof(table[0])) {
+      return table[df - 1];
+    }
+
+    return 1.96;
+  }
+
+  /*
+   * GetBootstrapMeanList() - Returns the means of resample_num resamples,
+   *                          sorted
+   */
+  static std::vector<double> GetBootstrapMeanList(
+    const std::vector<double> &value_list,
+    uint64_t resample_num,
+    uint64_t seed = 0UL) {
+    assert(value_list.size() > 0UL);
+
+    FastRandom engine{seed};
+
+    std::vector<double> mean_list(resample_num);
+    for(uint64_t i = 0;i < resample_num;i++) {
+      double sum = 0.0;
+      for(size_t j = 0;j < value_list.size();j++) {
+        sum += value_list[engine.GetBounded(value_list.size())];
+      }
+
+      mean_list[i] = sum / value_list.size();
+    }
+
+    std::sort(mean_list.begin(), mean_list.end());
+
+    return mean_list;
+  }
+
+  /*
+   * Constructor - Computes all statistics of non-empty samples
+   */
+  TrialStats(const std::vector<double> &p_sample_list,
+             double p_confidence = DEFAULT_CONFIDENCE,
+             uint64_t resample_num = DEFAULT_RESAMPLE_NUM) :
+    sample_list{p_sample_list},
+    mean{GetMean(p_sample_list)},
+    median{GetMedian(p_sample_list)},
+    stddev{GetStddev(p_sample_list)},
+    min{*std::min_element(p_sample_list.begin(), p_sample_list.end())},
+    max{*std::max_element(p_sample_list.begin(), p_sample_list.end())},
+    confidence{p_confidence},
+    ci_lower{mean},
+    ci_upper{mean} {
+    assert(confidence > 0.0 && confidence < 1.0);
+    assert(resample_num > 0UL);
+
+    if(sample_list.size() > 1UL) {
+      std::vector<double> mean_list = \
+        GetBootstrapMeanList(sample_list, resample_num);
+      double tail = (1.0 - confidence) / 2.0;
+      ci_lower = mean_list[static_cast<size_t>(tail * (resample_num - 1))];
+      ci_upper = \
+        mean_list[static_cast<size_t>((1.0 - tail) * (resample_num - 1))];
+    }
+
+    return;
+  }
+
+  inline const std::vector<double> &GetSampleList() const {
+    return sample_list;
+  }
+
+  inline size_t GetSampleNum() const {
+    return sample_list.size();
+  }
+
+  inline double GetMean() const {
+    return mean;
+  }
+
+  inline double GetMedian() const {
+    return median;
+  }
+
+  inline double GetStddev() const {
+    return stddev;
+  }
+
+  inline double GetMin() const {
+    return min;
+  }
+
+  inline double GetMax() const {
+    return max;
+  }
+
+  inline double GetConfidence() const {
+    return confidence;
+  }
+
+  /*
+   * GetConfidenceInterval() - Returns the bootstrap interval of the mean
+   */
+  inline std::pair<double, double> GetConfidenceInterval() const {
+    return std::make_pair(ci_lower, ci_upper);
+  }
+
+  /*
+   * Print() - Prints all statistics with a name and a unit
+   */
+  void Print(const std::string &name, const char *unit = "") const {
+    dbg_printf("%s: %lu trials; mean %f%s; median %f%s; stddev %f%s; "
+               "%.0f%% CI [%f, %f]%s; min %f%s; max %f%s\n",
+               name.c_str(),
+               GetSampleNum(),
+               mean, unit,
+               median, unit,
+               stddev, unit,
+               confidence * 100.0,
+               ci_lower, ci_upper, unit,
+               min, unit,
+               max, unit);
+
+    return;
+  }
+};
+
+/*
+ * class MannWhitneyTest - Two-sample Mann-Whitney U test
+ *
+ * The test asks whether values of one sample tend to be larger than values
+ * of the other, using only their ranks, so a few outliers (e.g. a run
+ * disturbed by another process) do not decide the result. The p-value
+ * comes from the normal approximation of U with tie and continuity
+ * correction, which is reasonable from about 8 samples per side; with
+ * fewer samples it is only a rough guide
+ */
+class MannWhitneyTest {
+ private:
+  // U of the first sample, i.e. pairs where it is larger, counting ties
+  // as one half
+  double u;
+  double z;
+  size_t size_a;
+  size_t size_b;
+
+ public:
+
+  /*
+   * Constructor - Runs the test on two non-empty samples
+   */
+  MannWhitneyTest(const std::vector<double> &sample_a,
+                  const std::vector<double> &sample_b) :
+    u{0.0},
+    z{0.0},
+    size_a{sample_a.size()},
+    size_b{sample_b.size()} {
+    assert(size_a > 0UL && size_b > 0UL);
+
+    // Pairs of (value, from a)
+    std::vector<std::pair<double, bool>> value_list{};
+    for(double value : sample_a) {
+      value_list.push_back(std::make_pair(value, true));
+    }
+
+    for(double value : sample_b) {
+      value_list.push_back(std::make_pair(value, false));
+    }
+
+    std::sort(value_list.begin(), value_list.end());
+
+    // Rank sum of a, with tied values sharing their mean rank
+    double rank_sum_a = 0.0;
+    double tie_sum = 0.0;
+    size_t i = 0;
+    while(i < value_list.size()) {
+      size_t j = i;
+      while(j < value_list.size() && \
+            value_list[j].first == value_list[i].first) {
+        j++;
+      }
+
+      double mean_rank = (i + 1 + j) / 2.0;
+      for(size_t k = i;k < j;k++) {
+        if(value_list[k].second == true) {
+          rank_sum_a += mean_rank;
+        }
+      }
+
+      double tie_num = static_cast<double>(j - i);
+      tie_sum += tie_num * tie_num * tie_num - tie_num;
+      i = j;
+    }
+
+    u = rank_sum_a - size_a * (size_a + 1.0) / 2.0;
+
+    double n = static_cast<double>(size_a + size_b);
+    double mean_u = size_a * size_b / 2.0;
+    double var_u = size_a * size_b / 12.0 * \
+                   ((n + 1.0) - tie_sum / (n * (n - 1.0)));
+    if(var_u > 0.0) {
+      // Continuity correction towards the mean
+      double diff = u - mean_u;
+      diff -= (diff > 0.0 ? 0.5 : (diff < 0.0 ? -0.5 : 0.0));
+      z = diff / std::sqrt(var_u);
+    }
+
+    return;
+  }
+
+  inline double GetU() const {
+    return u;
+  }
+
+  inline double GetZ() const {
+    return z;
+  }
+
+  /*
+   * GetPValueGreater() - Returns the one-sided p-value of the hypothesis
+   *                      that values of a tend to be larger than values of b
+   */
+  inline double GetPValueGreater() const {
+    return 0.5 * std::erfc(z / std::sqrt(2.0));
+  }
+
+  /*
+   * GetPValueLess() - Returns the one-sided p-value of the hypothesis that
+   *                   values of a tend to be smaller than values of b
+   */
+  inline double GetPValueLess() const {
+    return 0.5 * std::erfc(-z / std::sqrt(2.0));
+  }
+
+  /*
+   * GetPValue() - Returns the two-sided p-value
+   */
+  inline double GetPValue() const {
+    return std::min(1.0, 2.0 * std::min(GetPValueGreater(), GetPValueLess()));
+  }
+};
+
+#endif
@@ -0,0 +1,347 @@
+
+#pragma once
+
+#ifndef _WORK_STEALING_H
+#define _WORK_STEALING_H
+
+#include "test_suite.h"
+
+/*
+ * class ChaseLevDeque - Bounded single-owner work-stealing deque
+ *
+ * The owner pushes and pops at the bottom end; any other thread could steal
+ * from the top end. This follows "Correct and Efficient Work-Stealing for
+ * Weak Memory Models" (Le et al., PPoPP 2013), except that the buffer does
+ * not grow; Push() fails if the deque is full.
+ *
+ * T must be trivially copyable, since items are stored in std::atomic<T>
+ */
+template <typename T>
+class ChaseLevDeque {
+ public:
+  /*
+   * enum class StealResult - Outcome of Steal()
+   *
+   *   SUCCESS - An item was stolen
+   *   EMPTY   - There was nothing to steal
+   *   ABORT   - Lost the race with another thief or the owner; the deque
+   *             might still have items
+   */
+  enum class StealResult {
+    SUCCESS,
+    EMPTY,
+    ABORT,
+  };
+
+ private:
+  // Thieves write top and the owner writes bottom; keep them a cache line
+  // apart. We use padding instead of alignas, since deques are allocated
+  // with new, which does not respect extended alignment before C++17
+  std::atomic<int64_t> top;
+  char top_padding[CACHE_LINE_SIZE];
+  std::atomic<int64_t> bottom;
+  char bottom_padding[CACHE_LINE_SIZE];
+
+  std::unique_ptr<std::atomic<T>[]> buffer;
+  int64_t mask;
+
+ public:
+
+  /*
+   * Constructor - Capacity is rounded up to a power of two
+   */
+  ChaseLevDeque(uint64_t capacity) :
+    top{0},
+    top_padding{},
+    bottom{0},
+    bottom_padding{},
+    buffer{},
+    mask{0} {
+    uint64_t size = 1UL;
+    while(size < capacity) {
+      size *= 2UL;
+    }
+
+    buffer.reset(new std::atomic<T>[size]);
+    mask = static_cast<int64_t>(size - 1UL);
+
+    return;
+  }
+
+  ChaseLevDeque(const ChaseLevDeque &) = delete;
+  ChaseLevDeque &operator=(const ChaseLevDeque &) = delete;
+
+  /*
+   * Push() - Pushes an item to the bottom; only called by the owner
+   *
+   * Returns false if the deque is full
+   */
+  bool Push(const T &item) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if(b - t > mask) {
+      return false;
+    }
+
+    buffer[b & mask].store(item, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+
+    return true;
+  }
+
+  /*
+   * Pop() - Pops an item from the bottom; only called by the owner
+   *
+   * Returns false if the deque is empty
+   */
+  bool Pop(T *item_p) {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+
+    if(t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return false;
+    }
+
+    *item_p = buffer[b & mask].load(std::memory_order_relaxed);
+    if(t < b) {
+      return true;
+    }
+
+    // This is the last item; race with thieves for it
+    bool ret = top.compare_exchange_strong(t, t + 1,
+                                           std::memory_order_seq_cst,
+                                           std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_relaxed);
+
+    return ret;
+  }
+
+  /*
+   * Steal() - Takes an item from the top; could be called by any thread
+   */
+  StealResult Steal(T *item_p) {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+
+    if(t >= b) {
+      return StealResult::EMPTY;
+    }
+
+    *item_p = buffer[t & mask].load(std::memory_order_relaxed);
+    if(top.compare_exchange_strong(t, t + 1,
+                                   std::memory_order_seq_cst,
+                                   std::memory_order_relaxed) == false) {
+      return StealResult::ABORT;
+    }
+
+    return StealResult::SUCCESS;
+  }
+
+  /*
+   * GetSize() - Returns the number of items; only exact if no thread is
+   *             modifying the deque
+   */
+  inline uint64_t GetSize() const {
+    int64_t size = bottom.load(std::memory_order_relaxed) -
+                   top.load(std::memory_order_relaxed);
+
+    return size > 0 ? static_cast<uint64_t>(size) : 0UL;
+  }
+};
+
+/*
+ * enum class PartitionMode - How StartThreadsPartitioned() assigns chunks
+ *
+ *   STATIC        - Each thread runs the chunks of its own contiguous slice
+ *                   of the key range, like slicing by thread_id
+ *   WORK_STEALING - Each thread starts with the same slice, but threads that
+ *                   run out of chunks steal from the others
+ */
+enum class PartitionMode {
+  STATIC,
+  WORK_STEALING,
+};
+
+/*
+ * class PartitionReport - Per-thread chunks and timing of a partitioned run
+ */
+class PartitionReport {
+ private:
+  LaunchReport launch_report;
+
+  // Number of chunks run by each thread, and how many of them were stolen
+  std::vector<uint64_t> chunk_num_list;
+  std::vector<uint64_t> steal_num_list;
+
+ public:
+
+  /*
+   * Constructor
+   */
+  PartitionReport(const LaunchReport &p_launch_report,
+                  const std::vector<uint64_t> &p_chunk_num_list,
+                  const std::vector<uint64_t> &p_steal_num_list) :
+    launch_report{p_launch_report},
+    chunk_num_list{p_chunk_num_list},
+    steal_num_list{p_steal_num_list} {
+    return;
+  }
+
+  inline const LaunchReport &GetLaunchReport() const {
+    return launch_report;
+  }
+
+  inline uint64_t GetChunkNum(uint64_t thread_id) const {
+    return chunk_num_list[thread_id];
+  }
+
+  inline uint64_t GetStealNum(uint64_t thread_id) const {
+    return steal_num_list[thread_id];
+  }
+
+  /*
+   * GetTotalStealNum() - Returns the number of chunks stolen by all threads
+   */
+  uint64_t GetTotalStealNum() const {
+    return std::accumulate(steal_num_list.begin(), steal_num_list.end(), 0UL);
+  }
+
+  /*
+   * GetTotalInterval() - Returns wall clock time from the first release to
+   *                      the last finish in seconds
+   */
+  inline double GetTotalInterval() const {
+    return launch_report.GetTotalInterval();
+  }
+
+  /*
+   * GetMeanThreadInterval() - Returns the average time a thread ran
+   *
+   * With perfect balancing this is equal to GetTotalInterval()
+   */
+  double GetMeanThreadInterval() const {
+    double sum = 0.0;
+    for(uint64_t i = 0;i < launch_report.GetThreadNum();i++) {
+      sum += launch_report.GetThreadInterval(i);
+    }
+
+    return sum / launch_report.GetThreadNum();
+  }
+
+  /*
+   * Print() - Prints timing and stealing summary
+   */
+  void Print() const {
+    dbg_printf("%lu threads; total %f s; mean thread %f s; "
+               "finish skew %f us; %lu chunks stolen\n",
+               launch_report.GetThreadNum(),
+               GetTotalInterval(),
+               GetMeanThreadInterval(),
+               launch_report.GetFinishSkew() * 1e6,
+               GetTotalStealNum());
+
+    return;
+  }
+};
+
+/*
+ * StartThreadsPartitioned() - Runs fn(thread_id, begin, end, args...) over
+ *                             key range [0, key_num) in chunks of chunk_size
+ *                             keys on num_threads threads
+ *
+ * Chunk indices are distributed to per-thread ChaseLevDeque in contiguous
+ * slices, pushed in reverse such that the owner runs its slice in key order
+ * and thieves take from the far end of it. In WORK_STEALING mode, a thread
+ * whose deque is empty sweeps the other deques starting from a random
+ * victim, and exits once a sweep finds all of them empty. Since chunks are
+ * never added after the launch, this means all chunks have been claimed.
+ *
+ * Threads are launched with StartThreadsSynchronized(), so the report tells
+ * how long each thread ran
+ */
+template <typename Fn, typename... Args>
+PartitionReport StartThreadsPartitioned(PartitionMode mode,
+                                        uint64_t num_threads,
+                                        uint64_t key_num,
+                                        uint64_t chunk_size,
+                                        Fn &&fn,
+                                        Args &&... args) {
+  assert(num_threads > 0UL);
+  assert(chunk_size > 0UL);
+
+  using Deque = ChaseLevDeque<uint64_t>;
+  uint64_t chunk_num = (key_num + chunk_size - 1UL) / chunk_size;
+
+  std::vector<std::unique_ptr<Deque>> deque_list{};
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    uint64_t first = chunk_num * thread_id / num_threads;
+    uint64_t last = chunk_num * (thread_id + 1UL) / num_threads;
+
+    deque_list.emplace_back(new Deque{last - first});
+    for(uint64_t chunk = last;chunk > first;chunk--) {
+      bool ret = deque_list.back()->Push(chunk - 1UL);
+      assert(ret == true);
+      (void)ret;
+    }
+  }
+
+  PaddedArray<uint64_t> chunk_num_array{num_threads};
+  PaddedArray<uint64_t> steal_num_array{num_threads};
+
+  auto run_chunk = [&](uint64_t thread_id, uint64_t chunk) {
+    uint64_t begin = chunk * chunk_size;
+    uint64_t end = std::min(begin + chunk_size, key_num);
+    fn(thread_id, begin, end, args...);
+    chunk_num_array[thread_id]++;
+  };
+
+  LaunchReport launch_report = \
+    StartThreadsSynchronized(num_threads, [&](uint64_t thread_id) {
+      uint64_t chunk = 0UL;
+      while(deque_list[thread_id]->Pop(&chunk) == true) {
+        run_chunk(thread_id, chunk);
+      }
+
+      if(mode != PartitionMode::WORK_STEALING) {
+        return;
+      }
+
+      uint64_t sweep = 0UL;
+      bool retry = true;
+      while(retry == true) {
+        retry = false;
+
+        uint64_t victim = \
+          SimpleInt64Random<>{}(sweep++, thread_id) % num_threads;
+        for(uint64_t i = 0;i < num_threads;i++) {
+          Deque &deque = *deque_list[(victim + i) % num_threads];
+          Deque::StealResult result = deque.Steal(&chunk);
+
+          if(result == Deque::StealResult::SUCCESS) {
+            run_chunk(thread_id, chunk);
+            steal_num_array[thread_id]++;
+            retry = true;
+            break;
+          } else if(result == Deque::StealResult::ABORT) {
+            retry = true;
+          }
+        }
+      }
+    });
+
+  std::vector<uint64_t> chunk_num_list{};
+  std::vector<uint64_t> steal_num_list{};
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    chunk_num_list.push_back(chunk_num_array[thread_id]);
+    steal_num_list.push_back(steal_num_array[thread_id]);
+  }
+
+  return PartitionReport{launch_report, chunk_num_list, steal_num_list};
+}
+
+#endif
@@ -0,0 +1,73 @@
+
+/*
+ * affinity_monitor_test.cpp - Tests migration and context switch monitor
+ */
+
+#include "affinity_monitor.h"
+
+/*
+ * TestAffinityMonitor() - Tests pooled workers, which are pinned
+ */
+void TestAffinityMonitor(uint64_t num_threads) {
+  _PrintTestName();
+
+  static constexpr uint64_t OP_NUM = 1000000UL;
+  std::vector<uint64_t> sum_list(num_threads, 0UL);
+  AffinityMonitor monitor{num_threads, 256};
+
+  StartThreadsMonitored(&monitor, [&](uint64_t thread_id) {
+    for(uint64_t i = 0;i < OP_NUM;i++) {
+      sum_list[thread_id] += SimpleInt64Random<>{}(i, thread_id);
+      monitor.Sample(thread_id);
+    }
+
+    // Sleeping is a voluntary context switch
+    SleepFor(1);
+  });
+
+  monitor.Print();
+
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    const AffinityMonitor::ThreadStat &stat = monitor.GetThreadStat(thread_id);
+    assert(stat.sample_num == OP_NUM / 256 + 2UL);
+    assert(stat.expected_cpu != AffinityMonitor::NO_CPU);
+    assert(stat.voluntary_switch_num > 0UL);
+    (void)stat;
+  }
+
+  assert(monitor.HasViolation() == false);
+
+  return;
+}
+
+/*
+ * TestAffinityViolation() - Tests whether running off the expected core is
+ *                           flagged
+ */
+void TestAffinityViolation() {
+  _PrintTestName();
+
+  // There is no such CPU, so every sample strays
+  AffinityMonitor monitor{2};
+  monitor.SetExpectedCoreList({static_cast<int>(GetCoreNum())});
+
+  StartThreadsMonitored(&monitor, [&monitor](uint64_t thread_id) {
+    monitor.Sample(thread_id);
+  });
+
+  monitor.Print();
+
+  assert(monitor.HasViolation() == true);
+  assert(monitor.GetThreadStat(0).stray_num == 2UL);
+  assert(monitor.GetThreadStat(1).stray_num == 0UL);
+
+  return;
+}
+
+int main() {
+  TestAffinityMonitor(GetCoreNum());
+  TestAffinityMonitor(GetCoreNum() * 2);
+  TestAffinityViolation();
+
+  return 0;
+}
@@ -0,0 +1,245 @@
+
+/*
+ * bench_driver_test.cpp - Tests benchmark drivers
+ */
+
+#include "bench_driver.h"
+
+/*
+ * TestThreadCounterArray() - Tests counters and their placement
+ */
+void TestThreadCounterArray() {
+  _PrintTestName();
+
+  ThreadCounterArray counter_array{4};
+  for(uint64_t thread_id = 0;thread_id < 4;thread_id++) {
+    counter_array.Add(thread_id, thread_id + 1);
+  }
+
+  assert(counter_array.Get(2) == 3UL);
+  assert(counter_array.GetTotal() == 10UL);
+
+  counter_array.Reset();
+  assert(counter_array.GetTotal() == 0UL);
+
+  // Counters must not share cache lines
+  PaddedArray<std::atomic<uint64_t>> padded{2};
+  uintptr_t first = reinterpret_cast<uintptr_t>(&padded[0]);
+  uintptr_t second = reinterpret_cast<uintptr_t>(&padded[1]);
+  assert(first % CACHE_LINE_SIZE == 0UL);
+  assert(second - first >= CACHE_LINE_SIZE);
+
+  return;
+}
+
+/*
+ * TestRunForDuration() - Tests time-bounded runs
+ */
+void TestRunForDuration(uint64_t num_threads, double seconds) {
+  _PrintTestName();
+
+  std::vector<uint64_t> sum_list(num_threads, 0UL);
+
+  ThroughputReport report = \
+    RunForDuration(num_threads, seconds, [&sum_list](uint64_t thread_id) {
+      sum_list[thread_id] += \
+        SimpleInt64Random<>{}(sum_list[thread_id], thread_id);
+    });
+
+  report.Print();
+
+  assert(report.GetThreadNum() == num_threads);
+  assert(report.GetInterval() >= seconds);
+  assert(report.GetTotalOps() > 0UL);
+
+  return;
+}
+
+/*
+ * TestRunOpenLoop() - Tests whether open-loop runs achieve the target rate
+ */
+void TestRunOpenLoop(uint64_t num_threads, ArrivalMode mode) {
+  _PrintTestName();
+
+  static constexpr double TARGET_RATE = 20000.0;
+  std::vector<uint64_t> sum_list(num_threads, 0UL);
+
+  OpenLoopReport report = \
+    RunOpenLoop(num_threads, TARGET_RATE, 0.5, mode,
+                [&sum_list](uint64_t thread_id) {
+      for(uint64_t i = 0;i < 100;i++) {
+        sum_list[thread_id] += SimpleInt64Random<>{}(i, thread_id);
+      }
+    });
+
+  report.Print();
+
+  assert(report.GetLatency(50.0) <= report.GetLatency(99.0));
+  assert(report.GetLatency(99.0) <= report.GetMaxLatency());
+
+  // Poisson arrivals only match the rate on average
+  double error = std::abs(report.GetAchievedRate() - TARGET_RATE);
+  assert(error / TARGET_RATE < 0.2);
+  (void)error;
+
+  return;
+}
+
+/*
+ * class TestState - Per-thread state that lives across phases
+ */
+class TestState {
+ public:
+  std::vector<uint64_t> key_list;
+  uint64_t next_index;
+  uint64_t checksum;
+};
+
+/*
+ * TestPhaseRunner() - Tests load / warmup / measure / verify phases
+ */
+void TestPhaseRunner(uint64_t num_threads) {
+  _PrintTestName();
+
+  static constexpr uint64_t KEY_NUM = 10000UL;
+  static constexpr uint64_t WARMUP_OPS = 5000UL;
+
+  PhaseRunner<TestState> runner{num_threads};
+
+  runner.AddPhase("load", PhaseLength::Once(),
+                  [&runner](uint64_t thread_id, TestState *state_p) {
+    for(uint64_t i = 0;i < KEY_NUM;i++) {
+      state_p->key_list.push_back(SimpleInt64Random<>{}(i, thread_id));
+    }
+
+    runner.AddOps(thread_id, KEY_NUM);
+  });
+
+  auto op_fn = [](uint64_t, TestState *state_p) {
+    state_p->checksum += state_p->key_list[state_p->next_index];
+    state_p->next_index = (state_p->next_index + 1) % KEY_NUM;
+  };
+
+  runner.AddPhase("warmup", PhaseLength::Ops(WARMUP_OPS), op_fn);
+  runner.AddPhase("measure", PhaseLength::Seconds(0.2), op_fn, true);
+  runner.AddPhase("verify", PhaseLength::Once(),
+                  [](uint64_t, TestState *state_p) {
+    assert(state_p->key_list.size() == KEY_NUM);
+    (void)state_p;
+  });
+
+  PhaseReport report = runner.Run();
+  report.Print();
+
+  assert(report.GetPhaseNum() == 4UL);
+  assert(report.GetPhase("load").GetTotalOps() == KEY_NUM * num_threads);
+  assert(report.GetPhase("warmup").GetTotalOps() == WARMUP_OPS * num_threads);
+  assert(report.GetPhase("measure").GetInterval() >= 0.2);
+
+  ThroughputReport measure = report.GetMeasureReport();
+  assert(measure.GetTotalOps() == report.GetPhase("measure").GetTotalOps());
+
+  // Total operations in warmup and measure must match per-thread state
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    assert(runner.GetThreadState(thread_id).next_index == 
+           (WARMUP_OPS + measure.GetOpCountList()[thread_id]) % KEY_NUM);
+  }
+
+  return;
+}
+
+/*
+ * TestSteadyStateDetector() - Tests detection on synthetic samples
+ */
+void TestSteadyStateDetector() {
+  _PrintTestName();
+
+  static constexpr uint64_t INTERVAL_NS = 1000000UL;
+  SteadyStateDetector detector{10, 0.02};
+
+  // Throughput ramps up from 100 to 1000 ops per interval
+  uint64_t now_ns = 0UL;
+  uint64_t total = 0UL;
+  for(uint64_t i = 0;i < 10;i++) {
+    bool steady = detector.AddSample(now_ns, total);
+    assert(steady == false);
+    (void)steady;
+
+    now_ns += INTERVAL_NS;
+    total += 100UL * (i + 1);
+  }
+
+  // Then it is flat; the window must be filled with flat intervals before
+  // we call it steady
+  uint64_t steady_index = 0UL;
+  for(uint64_t i = 0;i < 100;i++) {
+    if(detector.AddSample(now_ns, total) == true) {
+      steady_index = i;
+      break;
+    }
+
+    now_ns += INTERVAL_NS;
+    total += 1000UL;
+  }
+
+  assert(detector.IsSteady() == true);
+  assert(detector.GetCV() < 0.02);
+  assert(steady_index == 9UL);
+  (void)steady_index;
+
+  return;
+}
+
+/*
+ * TestSteadyStatePhase() - Tests whether warmup ends after throughput settles
+ */
+void TestSteadyStatePhase(uint64_t num_threads) {
+  _PrintTestName();
+
+  // Each operation gets cheaper until the cost settles after 0.1 seconds
+  uint64_t start_ns = GetSteadyClockNs();
+  std::vector<uint64_t> sum_list(num_threads, 0UL);
+  auto op_fn = [&](uint64_t thread_id, EmptyThreadState *) {
+    double elapsed = std::min((GetSteadyClockNs() - start_ns) / 1e9, 0.1);
+    uint64_t round = 10UL + static_cast<uint64_t>((0.1 - elapsed) * 2e4);
+    for(uint64_t i = 0;i < round;i++) {
+      sum_list[thread_id] += SimpleInt64Random<>{}(i, thread_id);
+    }
+  };
+
+  PhaseRunner<> runner{num_threads};
+  runner.AddPhase("warmup",
+                  PhaseLength::SteadyState(5.0, 0.1, 10UL, 5.0),
+                  op_fn);
+  runner.AddPhase("measure", PhaseLength::Seconds(0.1), op_fn, true);
+
+  PhaseReport report = runner.Run();
+  report.Print();
+
+  // Timing on a loaded machine is not reliable enough to assert that the
+  // steady state is detected, but it must not end before the ramp does
+  if(report.IsSteadyStateReached(0) == true) {
+    assert(report.GetWarmupInterval() >= 0.1);
+  }
+
+  assert(report.GetWarmupInterval() <= 5.5);
+  assert(report.GetPhase("measure").GetInterval() >= 0.1);
+
+  return;
+}
+
+int main() {
+  TestThreadCounterArray();
+  TestRunForDuration(GetCoreNum(), 0.2);
+  TestRunForDuration(GetCoreNum() * 2, 0.2);
+  TestRunOpenLoop(GetCoreNum(), ArrivalMode::FIXED_RATE);
+  TestRunOpenLoop(GetCoreNum(), ArrivalMode::POISSON);
+  TestRunOpenLoop(GetCoreNum() * 2, ArrivalMode::FIXED_RATE);
+  TestPhaseRunner(GetCoreNum());
+  TestPhaseRunner(GetCoreNum() * 2);
+  TestSteadyStateDetector();
+  TestSteadyStatePhase(GetCoreNum());
+  TestSteadyStatePhase(GetCoreNum() * 2);
+
+  return 0;
+}
@@ -0,0 +1,200 @@
+
+/*
+ * coroutine_test.cpp - Tests and benchmarks interleaved operations
+ */
+
+#include "coroutine.h"
+
+/*
+ * class CountOp - Yields step_num times and records the order it ran in
+ */
+class CountOp : public Coroutine {
+ private:
+  uint64_t slot_id;
+  uint64_t step_num;
+  std::vector<uint64_t> *trace_p;
+
+  // Must survive yields
+  uint64_t step;
+
+ public:
+
+  CountOp(uint64_t p_slot_id,
+          uint64_t p_step_num,
+          std::vector<uint64_t> *p_trace_p) :
+    slot_id{p_slot_id},
+    step_num{p_step_num},
+    trace_p{p_trace_p},
+    step{0UL} {
+    return;
+  }
+
+  CoroutineStatus Resume(uint64_t) {
+    CORO_BEGIN();
+
+    for(step = 0;step < step_num;step++) {
+      trace_p->push_back(slot_id);
+      CORO_YIELD();
+    }
+
+    CORO_END();
+  }
+};
+
+/*
+ * TestCoroutine() - Tests yield, restart and round-robin order
+ */
+void TestCoroutine() {
+  _PrintTestName();
+
+  std::vector<uint64_t> trace{};
+  CountOp op{0, 2, &trace};
+  assert(op.IsRunning() == false);
+  assert(op.Resume(0) == CoroutineStatus::SUSPENDED);
+  assert(op.IsRunning() == true);
+  assert(op.Resume(0) == CoroutineStatus::SUSPENDED);
+  assert(op.Resume(0) == CoroutineStatus::DONE);
+  assert(op.IsRunning() == false);
+  assert(trace.size() == 2UL);
+
+  // Starts over
+  assert(op.Resume(0) == CoroutineStatus::SUSPENDED);
+  assert(trace.size() == 3UL);
+
+  // Slot i yields i times, so it finishes in round i + 1; slot 0 finishes
+  // in every round
+  trace.clear();
+  CoroutineScheduler<CountOp> scheduler{
+    0, 3, [&trace](uint64_t, uint64_t slot_id) {
+      return CountOp{slot_id, slot_id, &trace};
+    }};
+
+  assert(scheduler.GetSlotNum() == 3UL);
+  assert(scheduler.Step() == 1UL);
+  assert((trace == std::vector<uint64_t>{1, 2}));
+  assert(scheduler.Step() == 2UL);
+  assert((trace == std::vector<uint64_t>{1, 2, 2}));
+  assert(scheduler.Drain() == 1UL);
+  assert(scheduler.GetSlot(2).IsRunning() == false);
+  assert(scheduler.Step() == 1UL);
+
+  return;
+}
+
+/*
+ * class ChaseOp - Follows a chain of random pointers through a large array
+ *
+ * Each hop is a likely cache miss, which is prefetched before yielding
+ */
+class ChaseOp : public Coroutine {
+ public:
+  static constexpr uint64_t HOP_NUM = 8UL;
+
+  /*
+   * class Node - One cache line
+   */
+  class Node {
+   public:
+    uint64_t next;
+    uint64_t padding[7];
+  };
+
+ private:
+  const Node *node_list;
+  uint64_t node_num;
+  uint64_t seed;
+
+  uint64_t hop;
+  uint64_t index;
+
+ public:
+
+  ChaseOp(const Node *p_node_list, uint64_t p_node_num, uint64_t p_seed) :
+    node_list{p_node_list},
+    node_num{p_node_num},
+    seed{p_seed},
+    hop{0UL},
+    index{0UL} {
+    return;
+  }
+
+  CoroutineStatus Resume(uint64_t thread_id) {
+    CORO_BEGIN();
+
+    index = SimpleInt64Random<>{}(seed++, thread_id) % node_num;
+    for(hop = 0;hop < HOP_NUM;hop++) {
+      CORO_PREFETCH(&node_list[index]);
+      index = node_list[index].next;
+    }
+
+    // Keep the result alive
+    if(index == node_num) {
+      dbg_printf("Unreachable\n");
+    }
+
+    CORO_END();
+  }
+};
+
+/*
+ * TestRunCoroutines() - Tests that finished operations are counted
+ */
+void TestRunCoroutines(uint64_t num_threads) {
+  _PrintTestName();
+
+  std::vector<uint64_t> trace_list[64];
+  assert(num_threads <= 64UL);
+
+  ThroughputReport report = RunCoroutinesForDuration<CountOp>(
+    num_threads, 0.05, 4, [&](uint64_t thread_id, uint64_t slot_id) {
+      return CountOp{slot_id, slot_id, &trace_list[thread_id]};
+    });
+
+  report.Print();
+  assert(report.GetThreadNum() == num_threads);
+
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    // Slot 0 finishes in every round, and the other slots yield
+    assert(report.GetOpCountList()[thread_id] > 0UL);
+    assert(trace_list[thread_id].size() > 0UL);
+  }
+
+  return;
+}
+
+/*
+ * BenchmarkInterleaving() - Prints pointer chasing throughput against the
+ *                           number of operations in flight per thread
+ */
+void BenchmarkInterleaving(uint64_t num_threads) {
+  _PrintTestName();
+
+  static constexpr uint64_t NODE_NUM = 1UL << 20;
+
+  std::vector<ChaseOp::Node> node_list(NODE_NUM);
+  for(uint64_t i = 0;i < NODE_NUM;i++) {
+    node_list[i].next = SimpleInt64Random<0, NODE_NUM>{}(i, 0);
+  }
+
+  for(uint64_t slot_num : {1UL, 2UL, 4UL, 8UL, 16UL, 32UL}) {
+    ThroughputReport report = RunCoroutinesForDuration<ChaseOp>(
+      num_threads, 0.2, slot_num, [&](uint64_t, uint64_t slot_id) {
+        return ChaseOp{node_list.data(), NODE_NUM, slot_id << 32};
+      });
+
+    dbg_printf("%lu in flight: %f MOps/sec\n",
+               slot_num,
+               report.GetThroughput() / 1e6);
+  }
+
+  return;
+}
+
+int main() {
+  TestCoroutine();
+  TestRunCoroutines(1);
+  TestRunCoroutines(GetCoreNum());
+  BenchmarkInterleaving(GetCoreNum());
+
+  return 0;
+}
@@ -0,0 +1,155 @@
+
+/*
+ * cpu_topology_test.cpp - Tests CPU topology and thread placement
+ */
+
+#include "cpu_topology.h"
+
+/*
+ * TestParseCpuList() - Tests parsing kernel CPU list format
+ */
+void TestParseCpuList() {
+  _PrintTestName();
+
+  std::vector<int> result = CpuTopology::ParseCpuList("0-3,8,10-11");
+  std::vector<int> expected{0, 1, 2, 3, 8, 10, 11};
+  assert(result == expected);
+
+  assert(CpuTopology::ParseCpuList("").size() == 0UL);
+  assert(CpuTopology::ParseCpuList("5") == std::vector<int>{5});
+
+  // User input must be well-formed as a whole
+  assert(CpuTopology::ParseCpuListStrict("0-3,8,10-11", &result) == true);
+  assert(result == expected);
+  assert(CpuTopology::ParseCpuListStrict("compat", &result) == false);
+  assert(CpuTopology::ParseCpuListStrict("scater", &result) == false);
+  assert(CpuTopology::ParseCpuListStrict("", &result) == false);
+  assert(CpuTopology::ParseCpuListStrict("1,", &result) == false);
+  assert(CpuTopology::ParseCpuListStrict("3-1", &result) == false);
+  assert(CpuTopology::ParseCpuListStrict("2x", &result) == false);
+  assert(result == expected);
+
+  return;
+}
+
+/*
+ * TestPlacement() - Tests whether every policy uses all CPUs exactly once
+ *                   before wrapping around
+ */
+void TestPlacement() {
+  _PrintTestName();
+
+  const CpuTopology &topology = CpuTopology::Get();
+  topology.Print();
+
+  // Placement only uses CPUs the process may run on
+  std::vector<CpuInfo> usable_list = topology.GetAllowedCpuList();
+  int usable_num = static_cast<int>(usable_list.size());
+  std::vector<int> usable_cpu_list{};
+  for(const CpuInfo &info : usable_list) {
+    usable_cpu_list.push_back(info.cpu_id);
+  }
+
+  std::vector<int> allowed_list = GetAllowedCoreList();
+  for(int cpu_id : usable_cpu_list) {
+    assert(std::find(allowed_list.begin(),
+                     allowed_list.end(),
+                     cpu_id) != allowed_list.end());
+  }
+
+  PlacementPolicy policy_list[] = {
+    PlacementPolicy::COMPACT,
+    PlacementPolicy::SCATTER,
+    PlacementPolicy::PHYSICAL_FIRST,
+  };
+
+  for(PlacementPolicy policy : policy_list) {
+    std::vector<int> placement = \
+      topology.GetPlacement(policy, usable_num * 2);
+
+    // The first usable_num entries are a permutation of the usable CPUs, 
+    // and then the order repeats
+    std::vector<int> first_round{placement.begin(),
+                                 placement.begin() + usable_num};
+    std::sort(first_round.begin(), first_round.end());
+    assert(first_round == usable_cpu_list);
+
+    for(int i = 0;i < usable_num;i++) {
+      assert(placement[i] == placement[i + usable_num]);
+    }
+
+    // Physical cores should come before any SMT sibling
+    if(policy == PlacementPolicy::PHYSICAL_FIRST) {
+      int prev_smt_id = 0;
+      for(int i = 0;i < usable_num;i++) {
+        for(const CpuInfo &info : usable_list) {
+          if(info.cpu_id == placement[i]) {
+            assert(info.smt_id >= prev_smt_id);
+            prev_smt_id = info.smt_id;
+          }
+        }
+      }
+    }
+  }
+
+  std::string explicit_cpu = std::to_string(usable_cpu_list[0]);
+  std::vector<int> explicit_list = topology.GetPlacement(explicit_cpu, 3);
+  assert(explicit_list == std::vector<int>(3, usable_cpu_list[0]));
+
+  return;
+}
+
+/*
+ * TestStartThreadsWithPolicy() - Tests whether threads run on the cores
+ *                                given by the placement
+ */
+void TestStartThreadsWithPolicy() {
+  _PrintTestName();
+
+  uint64_t num_threads = CpuTopology::Get().GetCpuNum();
+  std::vector<int> expected = \
+    CpuTopology::Get().GetPlacement(PlacementPolicy::SCATTER, num_threads);
+  std::vector<int> actual(num_threads, -1);
+
+  StartThreadsWithPolicy(PlacementPolicy::SCATTER,
+                         num_threads,
+                         [&actual](uint64_t thread_id) {
+    actual[thread_id] = GetThreadAffinity();
+  });
+
+  assert(actual == expected);
+
+  // The placement only lasts for one run
+  std::vector<int> allowed_list = GetAllowedCoreList();
+  std::fill(actual.begin(), actual.end(), -1);
+  StartThreads(num_threads, [&actual](uint64_t thread_id) {
+    actual[thread_id] = GetThreadAffinity();
+  });
+
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    assert(actual[thread_id] == \
+           allowed_list[thread_id % allowed_list.size()]);
+  }
+
+  // A nested call falls back to fresh threads, which are still placed
+  std::vector<int> nested_list{allowed_list.back()};
+  int nested_core = -1;
+  StartThreads(1, [&](uint64_t) {
+    StartThreadsOnCores(nested_list, [&nested_core](uint64_t) {
+      nested_core = GetThreadAffinity();
+    });
+  });
+
+  assert(nested_core == allowed_list.back());
+  (void)nested_core;
+
+  return;
+}
+
+int main() {
+  TestParseCpuList();
+  TestPlacement();
+  TestStartThreadsWithPolicy();
+
+  return 0;
+}
@@ -0,0 +1,173 @@
+
+/*
+ * cycle_timer_test.cpp - Tests TSC calibration and timers
+ */
+
+#include "test_suite.h"
+
+/*
+ * TestCalibration() - Tests the TSC frequency against CLOCK_MONOTONIC_RAW
+ */
+void TestCalibration() {
+  _PrintTestName();
+
+  Timer calibration_timer{true};
+  CycleClock::Calibrate();
+  calibration_timer.Stop();
+
+  dbg_printf("Invariant TSC: %s; %f GHz; calibrated in %f s\n",
+             CycleClock::IsInvariant() == true ? "yes" : "no",
+             CycleClock::GetCyclesPerNs(),
+             calibration_timer.GetInterval());
+
+  assert(CycleClock::GetCyclesPerNs() > 0.0);
+
+  // Compare over a longer window than calibration
+  for(int i = 0;i < 3;i++) {
+    uint64_t start_ns = GetMonotonicRawNs();
+    CycleTimer timer{true};
+    SleepFor(50);
+    timer.Stop();
+    uint64_t end_ns = GetMonotonicRawNs();
+
+    double error = std::abs(timer.GetNs() - (end_ns - start_ns)) / \
+                   (end_ns - start_ns);
+    dbg_printf("%lu cycles; %f ns; clock %lu ns; error %.4f%%\n",
+               timer.GetCycles(),
+               timer.GetNs(),
+               end_ns - start_ns,
+               error * 100.0);
+
+    assert(error < 0.01);
+    (void)error;
+  }
+
+  return;
+}
+
+/*
+ * TestTimers() - Tests that timers agree with each other
+ */
+void TestTimers() {
+  _PrintTestName();
+
+  Timer timer{false};
+  CycleTimer cycle_timer{false};
+  assert(cycle_timer.GetCycles() == 0UL);
+
+  timer.Start();
+  cycle_timer.Start();
+  SleepFor(20);
+  double cycle_interval = cycle_timer.Stop();
+  double interval = timer.Stop();
+
+  assert(cycle_interval >= 0.019 && cycle_interval <= interval * 1.01);
+  assert(std::abs(cycle_interval - cycle_timer.GetInterval()) < 1e-12);
+  (void)cycle_interval;
+  (void)interval;
+
+  // Consecutive reads never go back on one thread
+  uint64_t last = ReadCycleBegin();
+  for(int i = 0;i < 100000;i++) {
+    uint64_t now = ReadCycleEnd();
+    assert(now >= last);
+    last = now;
+  }
+
+  return;
+}
+
+/*
+ * BenchmarkTimerCost() - Prints the cost of a Start()/Stop() pair
+ */
+void BenchmarkTimerCost() {
+  _PrintTestName();
+
+  static constexpr uint64_t ITER_NUM = 1000000UL;
+
+  CycleTimer total{true};
+  CycleTimer cycle_timer{false};
+  uint64_t cycle_sum = 0UL;
+  for(uint64_t i = 0;i < ITER_NUM;i++) {
+    cycle_timer.Start();
+    cycle_timer.Stop();
+    cycle_sum += cycle_timer.GetCycles();
+  }
+
+  total.Stop();
+  dbg_printf("CycleTimer: %.1f cycles per empty region; "
+             "%.1f ns per Start()/Stop()\n",
+             static_cast<double>(cycle_sum) / ITER_NUM,
+             total.GetNs() / ITER_NUM);
+
+  total.Start();
+  Timer timer{false};
+  for(uint64_t i = 0;i < ITER_NUM;i++) {
+    timer.Start();
+    timer.Stop();
+  }
+
+  total.Stop();
+  dbg_printf("Timer: %.1f ns per Start()/Stop()\n",
+             total.GetNs() / ITER_NUM);
+
+  return;
+}
+
+/*
+ * TestSubtractOverhead() - Tests that empty regions measure close to zero
+ *                          once the overhead is subtracted
+ */
+void TestSubtractOverhead() {
+  _PrintTestName();
+
+  static constexpr int ITER_NUM = 10001;
+
+  const ClockOverhead::Result &result = ClockOverhead::Get();
+  assert(result.tsc_cycles > 0UL);
+  assert(result.steady_clock_ns > 0.0);
+  (void)result;
+
+  std::vector<uint64_t> raw_list{};
+  std::vector<uint64_t> net_list{};
+  CycleTimer raw_timer{false};
+  CycleTimer net_timer{false, true};
+  for(int i = 0;i < ITER_NUM;i++) {
+    raw_timer.Start();
+    raw_timer.Stop();
+    raw_list.push_back(raw_timer.GetCycles());
+
+    net_timer.Start();
+    net_timer.Stop();
+    net_list.push_back(net_timer.GetCycles());
+  }
+
+  std::sort(raw_list.begin(), raw_list.end());
+  std::sort(net_list.begin(), net_list.end());
+  dbg_printf("Median empty region: %lu cycles; %lu cycles subtracted\n",
+             raw_list[ITER_NUM / 2],
+             net_list[ITER_NUM / 2]);
+
+  assert(net_list[ITER_NUM / 2] < raw_list[ITER_NUM / 2]);
+
+  // Never negative
+  Timer timer{true, true};
+  assert(timer.Stop() >= 0.0);
+
+  // Long regions are barely changed
+  Timer long_timer{true, true};
+  SleepFor(10);
+  assert(long_timer.Stop() > 0.009);
+
+  return;
+}
+
+int main() {
+  PrintRunHeader();
+  TestCalibration();
+  TestTimers();
+  TestSubtractOverhead();
+  BenchmarkTimerCost();
+
+  return 0;
+}
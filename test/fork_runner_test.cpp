@@ -0,0 +1,118 @@
+
+/*
+ * fork_runner_test.cpp - Tests process-isolated runs
+ */
+
+#include <csignal>
+
+#include "fork_runner.h"
+
+// Children modify this; the parent must not see it
+static uint64_t global_counter = 0UL;
+
+/*
+ * TestForkRunner() - Tests results, isolation and failures
+ */
+void TestForkRunner(uint64_t num_threads) {
+  _PrintTestName();
+
+  // Make sure the parent's pool has workers that children do not inherit
+  StartThreads(num_threads, [](uint64_t) {});
+
+  ForkRunner<> runner{};
+
+  runner.AddConfig("run", [num_threads](uint64_t repeat, ForkResult *result_p) {
+    assert(global_counter == 0UL);
+    global_counter += repeat + 1UL;
+
+    std::vector<uint64_t> sum_list(num_threads, 0UL);
+    result_p->SetThroughputReport(
+      RunForDuration(num_threads, 0.05, [&sum_list](uint64_t thread_id) {
+        sum_list[thread_id] += \
+          SimpleInt64Random<>{}(sum_list[thread_id], thread_id);
+      }));
+
+    CacheMeter meter{};
+    result_p->SetCacheMeter(&meter);
+    result_p->counter_list[0] = global_counter;
+
+    LatencyHistogram histogram{};
+    for(uint64_t value = repeat + 1UL;value <= 1000UL;value++) {
+      histogram.Record(value * 1000UL);
+    }
+
+    result_p->SetHistogram(histogram);
+  });
+
+  runner.AddConfig("exit", [](uint64_t, ForkResult *result_p) {
+    result_p->counter_list[0] = 1UL;
+    exit(0);
+  });
+
+  runner.AddConfig("crash", [](uint64_t repeat, ForkResult *) {
+    if(repeat == 1UL) {
+      raise(SIGKILL);
+    }
+  });
+
+  uint64_t fail_num = runner.Run(3);
+  assert(fail_num == 4UL);
+  (void)fail_num;
+
+  assert(global_counter == 0UL);
+
+  for(uint64_t repeat = 0;repeat < 3;repeat++) {
+    const ForkResult &result = runner.GetResult(0, repeat);
+    assert(runner.IsSuccess(0, repeat) == true);
+    assert(result.thread_num == num_threads);
+    assert(result.GetThroughputReport().GetTotalOps() > 0UL);
+    assert(result.counter_list[0] == repeat + 1UL);
+
+    LatencyHistogram histogram = result.GetHistogram();
+    assert(histogram.GetTotalCount() == 1000UL - repeat);
+    assert(histogram.GetMin() == (repeat + 1UL) * 1000UL);
+    assert(histogram.GetMax() == 1000000UL);
+    assert(histogram.GetPercentile(50.0) >= 500000UL);
+    (void)result;
+    (void)histogram;
+
+    // Exiting before the functor returns is a failure
+    assert(runner.IsSuccess(1, repeat) == false);
+    assert(runner.GetResult(1, repeat).counter_list[0] == 1UL);
+    assert(runner.GetResult(1, repeat).GetHistogram().GetTotalCount() == 0UL);
+  }
+
+  assert(runner.IsSuccess(2, 0) == true);
+  assert(runner.IsSuccess(2, 1) == false);
+
+  std::vector<double> throughput_list = \
+    runner.GetValueList(0, [](const ForkResult &result) {
+      return result.GetThroughputReport().GetThroughput();
+    });
+
+  assert(throughput_list.size() == 3UL);
+  assert(runner.GetValueList(2, [](const ForkResult &) {
+    return 0.0;
+  }).size() == 2UL);
+
+  for(double throughput : throughput_list) {
+    dbg_printf("%f MOps/sec\n", throughput / 1e6);
+  }
+
+  // The parent's pool still works
+  std::atomic<uint64_t> count{0UL};
+  StartThreads(num_threads, [&count](uint64_t) {
+    count.fetch_add(1UL);
+  });
+
+  assert(count.load() == num_threads);
+
+  return;
+}
+
+int main() {
+  TestForkRunner(GetCoreNum());
+  TestForkRunner(GetCoreNum() * 2);
+
+  return 0;
+}
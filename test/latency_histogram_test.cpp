@@ -0,0 +1,267 @@
+
+/*
+ * latency_histogram_test.cpp - Tests latency histograms and recorders
+ */
+
+#include "latency_histogram.h"
+#include "bench_driver.h"
+
+/*
+ * TestBuckets() - Tests that every value falls into a bucket that contains
+ *                 it and that buckets are within the precision
+ */
+void TestBuckets(uint32_t precision_bits) {
+  _PrintTestName();
+
+  LatencyHistogram histogram{precision_bits};
+  assert(histogram.GetBucketNum() == \
+         (65UL - precision_bits) << precision_bits);
+
+  // Buckets are contiguous
+  for(uint64_t index = 1;index < histogram.GetBucketNum();index++) {
+    assert(histogram.GetLowerBound(index) == \
+           histogram.GetUpperBound(index - 1) + 1UL);
+  }
+
+  assert(histogram.GetUpperBound(histogram.GetBucketNum() - 1) == UINT64_MAX);
+
+  for(uint64_t i = 0;i < 100000;i++) {
+    uint64_t value = SimpleInt64Random<>{}(i, precision_bits) >> (i % 64);
+    uint64_t index = histogram.GetIndex(value);
+    uint64_t lower = histogram.GetLowerBound(index);
+    uint64_t upper = histogram.GetUpperBound(index);
+
+    assert(lower <= value && value <= upper);
+    assert(static_cast<double>(upper - lower) <= \
+           static_cast<double>(lower) / (1UL << precision_bits));
+    (void)lower;
+    (void)upper;
+  }
+
+  // A smaller range has fewer buckets
+  LatencyHistogram small{precision_bits, 1000000UL};
+  assert(small.GetBucketNum() == small.GetIndex(1000000UL) + 1UL);
+  small.Record(UINT64_MAX);
+  assert(small.GetCount(small.GetBucketNum() - 1) == 1UL);
+  assert(small.GetMax() == UINT64_MAX);
+
+  return;
+}
+
+/*
+ * TestPercentile() - Tests percentiles of a uniform distribution
+ */
+void TestPercentile() {
+  _PrintTestName();
+
+  LatencyHistogram histogram{};
+  assert(histogram.GetPercentile(50.0) == 0UL);
+  assert(histogram.GetMin() == 0UL);
+
+  for(uint64_t value = 1;value <= 1000000;value++) {
+    histogram.Record(value);
+  }
+
+  histogram.Print();
+
+  assert(histogram.GetTotalCount() == 1000000UL);
+  assert(histogram.GetMin() == 1UL);
+  assert(histogram.GetMax() == 1000000UL);
+  assert(histogram.GetPercentile(100.0) == 1000000UL);
+  assert(histogram.GetPercentile(0.0) == 1UL);
+
+  for(double percentile : {50.0, 90.0, 99.0, 99.9, 99.99}) {
+    double expected = percentile * 10000.0;
+    double error = std::abs(histogram.GetPercentile(percentile) - expected) / \
+                   expected;
+    assert(error < 1.0 / 128);
+    (void)error;
+  }
+
+  assert(std::abs(histogram.GetMean() - 500000.5) / 500000.5 < 0.01);
+
+  return;
+}
+
+/*
+ * TestSerialize() - Tests that a histogram survives serialization
+ */
+void TestSerialize() {
+  _PrintTestName();
+
+  LatencyHistogram histogram{5, 1UL << 40};
+  for(uint64_t i = 0;i < 10000;i++) {
+    histogram.Record(SimpleInt64Random<0, 1UL << 30>{}(i, 0), i % 3 + 1);
+  }
+
+  std::string data = histogram.Serialize();
+  dbg_printf("%lu values in %lu bytes\n",
+             histogram.GetTotalCount(),
+             data.size());
+
+  LatencyHistogram copy{};
+  assert(copy.Deserialize(data) == true);
+  assert(copy.GetPrecisionBits() == 5U);
+  assert(copy.GetMaxValue() == 1UL << 40);
+  assert(copy.GetTotalCount() == histogram.GetTotalCount());
+  assert(copy.GetMin() == histogram.GetMin());
+  assert(copy.GetMax() == histogram.GetMax());
+  for(uint64_t index = 0;index < histogram.GetBucketNum();index++) {
+    assert(copy.GetCount(index) == histogram.GetCount(index));
+  }
+
+  assert(copy.Serialize() == data);
+
+  // Truncated data is rejected and does not change the histogram
+  assert(copy.Deserialize(data.substr(0, data.size() - 1)) == false);
+  assert(copy.Deserialize("garbage") == false);
+  assert(copy.GetTotalCount() == histogram.GetTotalCount());
+
+  LatencyHistogram empty{};
+  assert(copy.Deserialize(empty.Serialize()) == true);
+  assert(copy.GetTotalCount() == 0UL);
+
+  return;
+}
+
+/*
+ * TestLatencyRecorder() - Tests per-thread recording and merging
+ */
+void TestLatencyRecorder(uint64_t num_threads) {
+  _PrintTestName();
+
+  static constexpr uint64_t VALUE_NUM = 100000UL;
+
+  LatencyRecorder recorder{num_threads};
+  StartThreads(num_threads, [&recorder](uint64_t thread_id) {
+    for(uint64_t value = 0;value < VALUE_NUM;value++) {
+      recorder.Record(thread_id, value + thread_id);
+    }
+  });
+
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    assert(recorder.GetHistogram(thread_id).GetTotalCount() == VALUE_NUM);
+    assert(recorder.GetHistogram(thread_id).GetMin() == thread_id);
+  }
+
+  LatencyHistogram merged = recorder.GetMerged();
+  assert(merged.GetTotalCount() == VALUE_NUM * num_threads);
+  assert(merged.GetMin() == 0UL);
+  assert(merged.GetMax() == VALUE_NUM - 1UL + num_threads - 1UL);
+
+  recorder.Reset();
+  assert(recorder.GetMerged().GetTotalCount() == 0UL);
+
+  // Time something
+  StartThreads(num_threads, [&recorder](uint64_t thread_id) {
+    CycleTimer timer{false};
+    std::atomic<uint64_t> value{0UL};
+    for(uint64_t i = 0;i < VALUE_NUM;i++) {
+      timer.Start();
+      value.fetch_add(i);
+      timer.Stop();
+      recorder.Record(thread_id, timer.GetCycles());
+    }
+  });
+
+  recorder.GetMerged().Print("cycles");
+
+  return;
+}
+
+/*
+ * BenchmarkRecord() - Prints the cost of Record()
+ */
+void BenchmarkRecord() {
+  _PrintTestName();
+
+  static constexpr uint64_t VALUE_NUM = 10000000UL;
+
+  LatencyHistogram histogram{};
+  CycleTimer timer{true};
+  for(uint64_t i = 0;i < VALUE_NUM;i++) {
+    histogram.Record(i * 0x9E3779B97F4A7C15UL >> (i % 48));
+  }
+
+  timer.Stop();
+  assert(histogram.GetTotalCount() == VALUE_NUM);
+
+  dbg_printf("%.2f ns per Record()\n", timer.GetNs() / VALUE_NUM);
+
+  return;
+}
+
+/*
+ * TestSampledLatencyRecorder() - Tests the number of samples
+ */
+void TestSampledLatencyRecorder() {
+  _PrintTestName();
+
+  static constexpr uint64_t OP_NUM = 100000UL;
+
+  SampledLatencyRecorder fixed{2, 10, false};
+  SampledLatencyRecorder randomized{2, 10, true};
+  assert(fixed.GetOpNum() == 0UL);
+  assert(fixed.GetMerged().GetTotalCount() == 0UL);
+
+  uint64_t call_num = 0UL;
+  for(uint64_t i = 0;i < OP_NUM;i++) {
+    fixed.Run(i % 2, [&call_num]() { call_num++; });
+    randomized.Run(i % 2, [&call_num]() { call_num++; });
+  }
+
+  assert(call_num == OP_NUM * 2);
+  assert(fixed.GetOpNum() == OP_NUM);
+  assert(fixed.GetSampleNum() == OP_NUM / 10);
+  assert(fixed.GetMerged().GetTotalCount() == OP_NUM / 10);
+
+  // Same rate on average
+  assert(randomized.GetOpNum() == OP_NUM);
+  assert(randomized.GetSampleNum() > OP_NUM / 10 * 9 / 10);
+  assert(randomized.GetSampleNum() < OP_NUM / 10 * 11 / 10);
+
+  assert(fixed.GetTimedCycles() > fixed.GetUntimedCycles());
+  assert(fixed.GetOverheadSeconds() > 0.0);
+
+  return;
+}
+
+/*
+ * BenchmarkSampling() - Prints throughput and estimated overhead of a short
+ *                       operation with different sampling intervals
+ */
+void BenchmarkSampling(uint64_t num_threads) {
+  _PrintTestName();
+
+  std::vector<uint64_t> sum_list(num_threads, 0UL);
+  for(uint64_t sample_interval : {1UL, 10UL, 100UL, 1000UL}) {
+    SampledLatencyRecorder recorder{num_threads, sample_interval};
+    ThroughputReport report = \
+      RunForDuration(num_threads, 0.2, [&](uint64_t thread_id) {
+        recorder.Run(thread_id, [&]() {
+          sum_list[thread_id] += \
+            SimpleInt64Random<>{}(sum_list[thread_id], thread_id);
+        });
+      });
+
+    report.Print();
+    recorder.Print(report.GetInterval());
+  }
+
+  return;
+}
+
+int main() {
+  TestBuckets(1);
+  TestBuckets(7);
+  TestBuckets(12);
+  TestPercentile();
+  TestSerialize();
+  TestLatencyRecorder(GetCoreNum());
+  TestLatencyRecorder(GetCoreNum() * 2);
+  BenchmarkRecord();
+  TestSampledLatencyRecorder();
+  BenchmarkSampling(GetCoreNum());
+
+  return 0;
+}
@@ -0,0 +1,174 @@
+
+/*
+ * mpmc_queue_test.cpp - Tests and benchmarks the bounded MPMC queue
+ */
+
+#include "mpmc_queue.h"
+#include "scaling_sweep.h"
+
+/*
+ * TestMPMCQueue() - Tests single threaded FIFO order, full and empty
+ */
+void TestMPMCQueue() {
+  _PrintTestName();
+
+  MPMCQueue<uint64_t> queue{6};
+  assert(queue.GetCapacity() == 8UL);
+
+  uint64_t item = 0UL;
+  assert(queue.Dequeue(&item) == false);
+
+  // Go around the ring a few times
+  for(uint64_t lap = 0;lap < 4;lap++) {
+    for(uint64_t i = 0;i < 8;i++) {
+      assert(queue.Enqueue(lap * 8 + i) == true);
+    }
+
+    assert(queue.Enqueue(100UL) == false);
+
+    for(uint64_t i = 0;i < 8;i++) {
+      assert(queue.Dequeue(&item) == true);
+      assert(item == lap * 8 + i);
+    }
+
+    assert(queue.Dequeue(&item) == false);
+  }
+
+  // Batches are cut at the capacity
+  uint64_t in[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  uint64_t out[10];
+  assert(queue.EnqueueBatch(in, 3) == 3UL);
+  assert(queue.EnqueueBatch(in + 3, 7) == 5UL);
+  assert(queue.EnqueueBatch(in + 8, 2) == 0UL);
+  assert(queue.DequeueBatch(out, 5) == 5UL);
+  assert(queue.EnqueueBatch(in + 8, 2) == 2UL);
+  assert(queue.DequeueBatch(out + 5, 10) == 5UL);
+
+  for(uint64_t i = 0;i < 10;i++) {
+    assert(out[i] == i);
+  }
+
+  return;
+}
+
+/*
+ * TestProducerConsumer() - Tests whether every item arrives exactly once
+ *                          and in order per producer
+ */
+void TestProducerConsumer(uint64_t producer_num,
+                          uint64_t consumer_num,
+                          size_t batch_size) {
+  _PrintTestName();
+
+  static constexpr uint64_t ITEM_NUM = 100000UL;
+  MPMCQueue<uint64_t> queue{256};
+
+  std::vector<uint64_t> next_list(producer_num, 0UL);
+  std::vector<std::atomic<uint8_t>> seen_list(producer_num * ITEM_NUM);
+  for(std::atomic<uint8_t> &seen : seen_list) {
+    seen.store(0);
+  }
+
+  // Last item of each producer seen by each consumer
+  std::vector<std::vector<int64_t>> last_list_list(
+    consumer_num, std::vector<int64_t>(producer_num, -1));
+
+  ProducerConsumerReport report = StartThreadsProducerConsumer(
+    &queue, producer_num, consumer_num, batch_size,
+    [&](uint64_t thread_id, uint64_t *item_p, size_t count) {
+      uint64_t &next = next_list[thread_id];
+      size_t i = 0;
+      for(;i < count && next < ITEM_NUM;i++) {
+        item_p[i] = (thread_id << 32) | next++;
+      }
+
+      return i;
+    },
+    [&](uint64_t thread_id, uint64_t item) {
+      uint64_t producer = item >> 32;
+      int64_t index = static_cast<int64_t>(item & 0xFFFFFFFFUL);
+      int64_t &last = last_list_list[thread_id - producer_num][producer];
+
+      assert(index > last);
+      last = index;
+
+      seen_list[producer * ITEM_NUM + index].fetch_add(1);
+    });
+
+  report.Print();
+
+  assert(report.GetProducedNum() == producer_num * ITEM_NUM);
+  assert(report.GetConsumedNum() == producer_num * ITEM_NUM);
+
+  for(const std::atomic<uint8_t> &seen : seen_list) {
+    assert(seen.load() == 1);
+    (void)seen;
+  }
+
+  return;
+}
+
+/*
+ * BenchmarkMPMCQueue() - Plots queue throughput against the number of
+ *                        threads, half of which are producers
+ */
+void BenchmarkMPMCQueue() {
+  _PrintTestName();
+
+  static constexpr uint64_t ITEM_NUM = 1UL << 20;
+
+  std::vector<uint64_t> thread_num_list{};
+  for(uint64_t num : ScalingSweep::GetDefaultThreadNumList()) {
+    thread_num_list.push_back(std::max<uint64_t>(num, 2UL));
+  }
+
+  thread_num_list.erase(std::unique(thread_num_list.begin(),
+                                    thread_num_list.end()),
+                        thread_num_list.end());
+
+  ScalingSweep sweep{3, thread_num_list};
+  for(size_t batch_size : {1UL, 32UL}) {
+    sweep.Run("Batch " + std::to_string(batch_size),
+              [batch_size](uint64_t num_threads) {
+      MPMCQueue<uint64_t> queue{1024};
+      uint64_t producer_num = num_threads / 2;
+      uint64_t item_per_producer = ITEM_NUM / producer_num;
+      std::vector<uint64_t> next_list(producer_num, 0UL);
+
+      ProducerConsumerReport report = StartThreadsProducerConsumer(
+        &queue, producer_num, num_threads - producer_num, batch_size,
+        [&](uint64_t thread_id, uint64_t *item_p, size_t count) {
+          uint64_t &next = next_list[thread_id];
+          size_t i = 0;
+          for(;i < count && next < item_per_producer;i++) {
+            item_p[i] = next++;
+          }
+
+          return i;
+        },
+        [](uint64_t, uint64_t) {});
+
+      return report.GetThroughput();
+    });
+  }
+
+  sweep.Print();
+
+  LineChart lc{};
+  sweep.FillChart(&lc);
+  lc.SetLegendFlag(true);
+  lc.Draw("MPMCQueue.pdf");
+
+  return;
+}
+
+int main() {
+  TestMPMCQueue();
+  TestProducerConsumer(1, 1, 1);
+  TestProducerConsumer(1, GetCoreNum() * 2, 16);
+  TestProducerConsumer(GetCoreNum() * 2, 1, 16);
+  TestProducerConsumer(GetCoreNum() * 2, GetCoreNum() * 2, 7);
+  BenchmarkMPMCQueue();
+
+  return 0;
+}
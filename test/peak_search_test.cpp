@@ -0,0 +1,67 @@
+
+/*
+ * peak_search_test.cpp - Tests peak-throughput thread count search
+ */
+
+#include "peak_search.h"
+
+/*
+ * TestPeakSearchModel() - Tests search on a synthetic throughput curve with
+ *                         noise, which peaks at a known thread count
+ */
+void TestPeakSearchModel(uint64_t peak, uint64_t max_thread_num) {
+  _PrintTestName();
+
+  uint64_t call_count = 0UL;
+  auto model = [peak, &call_count](uint64_t num_threads) {
+    // +/- 1% noise
+    double noise = \
+      (SimpleInt64Random<0, 2000>{}(call_count++, num_threads) - 1000.0) / 1e5;
+    double n = static_cast<double>(num_threads);
+
+    return n * (2.0 * peak - n) * 1e4 * (1.0 + noise);
+  };
+
+  PeakSearch search{max_thread_num};
+  uint64_t optimum = search.Run(model);
+  search.Print();
+
+  // Points near the peak are within noise of each other, and the search
+  // prefers fewer threads among those, so only check that the optimum is
+  // within the tolerance of the true peak throughput
+  double n = static_cast<double>(optimum);
+  assert(n * (2.0 * peak - n) >= 0.95 * peak * peak);
+  (void)n;
+  assert(search.GetCurve().size() < max_thread_num / 2);
+
+  return;
+}
+
+/*
+ * TestPeakSearchDuration() - Tests search on a real workload
+ */
+void TestPeakSearchDuration() {
+  _PrintTestName();
+
+  PeakSearch search{GetCoreNum() * 2};
+  search.RunForDuration(0.05, [](uint64_t thread_id) {
+    static thread_local uint64_t value = 0UL;
+    value = SimpleInt64Random<>{}(value, thread_id);
+  });
+
+  search.Print();
+
+  assert(search.GetOptimum() <= GetCoreNum() * 2);
+  assert(search.GetPeakThroughput() > 0.0);
+
+  return;
+}
+
+int main() {
+  TestPeakSearchModel(50, 128);
+  TestPeakSearchModel(100, 128);
+  TestPeakSearchModel(3, 128);
+  TestPeakSearchDuration();
+
+  return 0;
+}
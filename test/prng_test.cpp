@@ -0,0 +1,396 @@
+
+/*
+ * prng_test.cpp - Tests pseudo random number generators and hashes
+ */
+
+#include "test_suite.h"
+
+/*
+ * TestReference() - Tests outputs against the reference implementations
+ */
+void TestReference() {
+  _PrintTestName();
+
+  SplitMix64 splitmix{1234567UL};
+  for(uint64_t expected : {6457827717110365317UL,
+                           3203168211198807973UL,
+                           9817491932198370423UL,
+                           4593380528125082431UL,
+                           16408922859458223821UL}) {
+    assert(splitmix() == expected);
+    (void)expected;
+  }
+
+  Xoshiro256StarStar xoshiro{1UL, 2UL, 3UL, 4UL};
+  for(uint64_t expected : {11520UL,
+                           0UL,
+                           1509978240UL,
+                           1215971899390074240UL}) {
+    assert(xoshiro() == expected);
+    (void)expected;
+  }
+
+  // pcg64 rng(42, 54) in the PCG demo
+  PCG64 pcg{42, 54};
+  for(uint64_t expected : {0x86B1DA1D72062B68UL,
+                           0x1304AA46C9853D39UL,
+                           0xA3670E9E0DD50358UL,
+                           0xF9090E529A7DAE00UL,
+                           0xC85B9FD837996F2CUL,
+                           0x606121F8E3919196UL}) {
+    assert(pcg() == expected);
+    (void)expected;
+  }
+
+  return;
+}
+
+/*
+ * TestJump() - Tests jumps and streams
+ */
+void TestJump() {
+  _PrintTestName();
+
+  // Advance() is the same as stepping
+  PCG64 stepped{1UL};
+  PCG64 advanced = stepped;
+  for(int i = 0;i < 1000;i++) {
+    stepped();
+  }
+
+  advanced.Advance(1000);
+  assert(stepped() == advanced());
+
+  PCG64 jumped = advanced;
+  jumped.Jump();
+  advanced.Advance(static_cast<unsigned __int128>(1U) << 64);
+  assert(jumped() == advanced());
+
+  // Advancing by the period returns to the same place
+  PCG64 around = advanced;
+  around.Advance(static_cast<unsigned __int128>(1U) << 127);
+  assert(around() != advanced());
+  around = advanced;
+  around.Advance(static_cast<unsigned __int128>(1U) << 127);
+  around.Advance(static_cast<unsigned __int128>(1U) << 127);
+
+  assert(around() == advanced());
+
+  // Jumps commute with steps and with each other, as they are all powers of
+  // the same linear map
+  Xoshiro256StarStar a{1UL, 2UL, 3UL, 4UL};
+  Xoshiro256StarStar b = a;
+  a.Jump();
+  a.LongJump();
+  a();
+  b();
+  b.LongJump();
+  b.Jump();
+  for(int i = 0;i < 100;i++) {
+    assert(a() == b());
+  }
+
+  // Streams of one master seed differ from each other and are reproducible
+  FastRandom master{42UL};
+  std::vector<uint64_t> first_list{};
+  for(uint64_t stream_id = 0;stream_id < 8;stream_id++) {
+    FastRandom stream = master.GetStream(stream_id);
+    uint64_t first = stream();
+    assert(std::find(first_list.begin(), first_list.end(), first) == \
+           first_list.end());
+    first_list.push_back(first);
+    assert(master.GetStream(stream_id)() == first);
+  }
+
+  assert(master.GetStream(0)() == FastRandom{42UL}());
+
+  PCG64 pcg_master{42UL};
+  assert(pcg_master.GetStream(1)() != pcg_master.GetStream(2)());
+
+  return;
+}
+
+/*
+ * TestBounded() - Tests that bounded values are in range and uniform
+ */
+void TestBounded() {
+  _PrintTestName();
+
+  static constexpr uint64_t RANGE = 10UL;
+  static constexpr uint64_t DRAW_NUM = 1000000UL;
+
+  FastRandom rand{1UL};
+  std::vector<uint64_t> count_list(RANGE, 0UL);
+  for(uint64_t i = 0;i < DRAW_NUM;i++) {
+    uint64_t value = rand.GetBounded(RANGE);
+    assert(value < RANGE);
+    count_list[value]++;
+  }
+
+  // Chi-square with 9 degrees of freedom; 27.9 is the 0.001 critical value
+  double chi_square = 0.0;
+  for(uint64_t count : count_list) {
+    double expected = static_cast<double>(DRAW_NUM) / RANGE;
+    chi_square += (count - expected) * (count - expected) / expected;
+  }
+
+  dbg_printf("Chi-square of %lu draws in [0, %lu): %f\n",
+             DRAW_NUM,
+             RANGE,
+             chi_square);
+  assert(chi_square < 27.9);
+
+  for(int i = 0;i < 100;i++) {
+    assert(rand.GetBounded(1) == 0UL);
+    // Almost half of all 64 bit values are rejected for this range
+    assert(rand.GetBounded((1UL << 63) + 1UL) <= (1UL << 63));
+  }
+
+  // Signed and full ranges
+  Random<int> signed_rand{-5, 5, 1UL};
+  std::vector<uint64_t> signed_count_list(11, 0UL);
+  for(int i = 0;i < 10000;i++) {
+    int value = signed_rand();
+    assert(value >= -5 && value <= 5);
+    signed_count_list[value + 5]++;
+  }
+
+  for(uint64_t count : signed_count_list) {
+    assert(count > 0UL);
+    (void)count;
+  }
+
+  Random<uint64_t> full_rand{0UL, UINT64_MAX};
+  assert(full_rand() != full_rand());
+
+  // Same seed, same values
+  Random<uint32_t> seeded_a{0, 1000, 7UL};
+  Random<uint32_t> seeded_b{0, 1000, 7UL};
+  for(int i = 0;i < 100;i++) {
+    assert(seeded_a() == seeded_b());
+  }
+
+  double sum = 0.0;
+  for(uint64_t i = 0;i < DRAW_NUM;i++) {
+    double value = rand.GetDouble();
+    assert(value >= 0.0 && value < 1.0);
+    sum += value;
+  }
+
+  assert(std::abs(sum / DRAW_NUM - 0.5) < 0.01);
+
+  return;
+}
+
+/*
+ * TestPermutation() - Tests that all permutations of 3 are equally likely
+ */
+void TestPermutation() {
+  _PrintTestName();
+
+  static constexpr uint64_t ROUND_NUM = 60000UL;
+
+  std::map<std::vector<int>, uint64_t> count_map{};
+  Permutation<int> permutation{};
+  for(uint64_t i = 0;i < ROUND_NUM;i++) {
+    permutation.Generate(3, 0, i);
+    count_map[{permutation[0], permutation[1], permutation[2]}]++;
+  }
+
+  assert(count_map.size() == 6UL);
+  for(const auto &item : count_map) {
+    dbg_printf("%d %d %d: %lu\n",
+               item.first[0],
+               item.first[1],
+               item.first[2],
+               item.second);
+    assert(item.second > ROUND_NUM / 6 * 9 / 10);
+    assert(item.second < ROUND_NUM / 6 * 11 / 10);
+  }
+
+  // Same seed, same permutation
+  Permutation<uint64_t> a{1000, 0, 3UL};
+  Permutation<uint64_t> b{1000, 0, 3UL};
+  for(size_t i = 0;i < 1000;i++) {
+    assert(a[i] == b[i]);
+  }
+
+  return;
+}
+
+/*
+ * BenchmarkEngine() - Prints ns per value of an engine on every thread
+ */
+template <typename Engine, typename DrawFunc>
+void BenchmarkEngine(const char *name,
+                     uint64_t num_threads,
+                     DrawFunc draw_fn) {
+  static constexpr uint64_t DRAW_NUM = 10000000UL;
+
+  PaddedArray<uint64_t> sum_list{num_threads};
+  PaddedArray<double> ns_list{num_threads};
+  StartThreads(num_threads, [&](uint64_t thread_id) {
+    Engine engine{thread_id + 1UL};
+    uint64_t sum = 0UL;
+    CycleTimer timer{true};
+    for(uint64_t i = 0;i < DRAW_NUM;i++) {
+      sum += draw_fn(engine);
+    }
+
+    timer.Stop();
+    sum_list[thread_id] = sum;
+    ns_list[thread_id] = timer.GetNs() / DRAW_NUM;
+  });
+
+  double ns = 0.0;
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    ns += ns_list[thread_id];
+  }
+
+  dbg_printf("%s: %lu threads; %.2f ns per value\n",
+             name,
+             num_threads,
+             ns / num_threads);
+
+  return;
+}
+
+/*
+ * BenchmarkPRNG() - Compares generators with std engines
+ */
+void BenchmarkPRNG(uint64_t num_threads) {
+  _PrintTestName();
+
+  BenchmarkEngine<SplitMix64>(
+    "SplitMix64", num_threads, [](SplitMix64 &e) { return e(); });
+  BenchmarkEngine<Xoshiro256StarStar>(
+    "xoshiro256**", num_threads, [](Xoshiro256StarStar &e) { return e(); });
+  BenchmarkEngine<PCG64>(
+    "PCG64", num_threads, [](PCG64 &e) { return e(); });
+  BenchmarkEngine<std::mt19937_64>(
+    "std::mt19937_64", num_threads, [](std::mt19937_64 &e) { return e(); });
+
+  BenchmarkEngine<FastRandom>(
+    "xoshiro256** in [0, 1000)",
+    num_threads,
+    [](FastRandom &e) { return e.GetBounded(1000); });
+  BenchmarkEngine<std::mt19937_64>(
+    "std::mt19937_64 with uniform_int_distribution in [0, 1000)",
+    num_threads,
+    [](std::mt19937_64 &e) {
+      return std::uniform_int_distribution<uint64_t>{0UL, 999UL}(e);
+    });
+
+  return;
+}
+
+/*
+ * TestRuntimeInt64Random() - Tests range and distribution of runtime bounds
+ */
+void TestRuntimeInt64Random() {
+  _PrintTestName();
+
+  static constexpr uint64_t VALUE_NUM = 1000000UL;
+
+  RuntimeInt64Random rand{100UL, 110UL};
+  assert(rand.GetLower() == 100UL);
+  assert(rand.GetUpper() == 110UL);
+
+  std::vector<uint64_t> count_list(10, 0UL);
+  for(uint64_t i = 0;i < VALUE_NUM;i++) {
+    uint64_t value = rand(i, 1UL);
+    assert(value >= 100UL && value < 110UL);
+    count_list[value - 100UL]++;
+  }
+
+  // Chi-square with 9 degrees of freedom; 27.9 is the 0.001 critical value
+  double chi_square = 0.0;
+  for(uint64_t count : count_list) {
+    double expected = VALUE_NUM / 10.0;
+    chi_square += (count - expected) * (count - expected) / expected;
+  }
+
+  dbg_printf("Chi-square of %lu values in [100, 110): %f\n",
+             VALUE_NUM,
+             chi_square);
+  assert(chi_square < 27.9);
+
+  // Stateless: the same arguments give the same value; salts differ
+  assert(rand(12345UL, 1UL) == rand(12345UL, 1UL));
+  RuntimeInt64Random full{};
+  assert(full(12345UL, 1UL) != full(12345UL, 2UL));
+
+  // Single value range
+  RuntimeInt64Random single{7UL, 8UL};
+  for(uint64_t i = 0;i < 100;i++) {
+    assert(single(i, i) == 7UL);
+  }
+
+  (void)single;
+
+  return;
+}
+
+/*
+ * BenchmarkInt64Random() - Compares compile time bounds, runtime bounds with
+ *                          modulo, and runtime bounds with multiply-high
+ */
+void BenchmarkInt64Random() {
+  _PrintTestName();
+
+  static constexpr uint64_t VALUE_NUM = 100000000UL;
+  static constexpr uint64_t KEY_NUM = 1000003UL;
+
+  // Read through volatile such that the compiler could not fold the range
+  volatile uint64_t volatile_key_num = KEY_NUM;
+  uint64_t key_num = volatile_key_num;
+
+  uint64_t sum = 0UL;
+  CycleTimer timer{true};
+  for(uint64_t i = 0;i < VALUE_NUM;i++) {
+    sum += SimpleInt64Random<0, KEY_NUM>{}(i, 1UL);
+  }
+
+  timer.Stop();
+  dbg_printf("SimpleInt64Random<0, %lu>: %.2f ns per value\n",
+             KEY_NUM,
+             timer.GetNs() / VALUE_NUM);
+
+  timer.Start();
+  for(uint64_t i = 0;i < VALUE_NUM;i++) {
+    sum += SimpleInt64Random<>::Hash(i, 1UL) % key_num;
+  }
+
+  timer.Stop();
+  dbg_printf("Hash %% %lu at runtime: %.2f ns per value\n",
+             key_num,
+             timer.GetNs() / VALUE_NUM);
+
+  RuntimeInt64Random rand{0UL, key_num};
+  timer.Start();
+  for(uint64_t i = 0;i < VALUE_NUM;i++) {
+    sum += rand(i, 1UL);
+  }
+
+  timer.Stop();
+  dbg_printf("RuntimeInt64Random{0, %lu}: %.2f ns per value\n",
+             key_num,
+             timer.GetNs() / VALUE_NUM);
+
+  dbg_printf("(sum %lu)\n", sum);
+
+  return;
+}
+
+int main() {
+  TestReference();
+  TestJump();
+  TestBounded();
+  TestPermutation();
+  TestRuntimeInt64Random();
+  BenchmarkPRNG(1);
+  BenchmarkPRNG(GetCoreNum());
+  BenchmarkInt64Random();
+
+  return 0;
+}
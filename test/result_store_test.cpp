@@ -0,0 +1,270 @@
+
+/*
+ * result_store_test.cpp - Tests the result store and regression gate
+ */
+
+#include "result_store.h"
+
+/*
+ * GetSampleList() - Returns n noisy samples around a center
+ */
+std::vector<double> GetSampleList(double center, uint64_t n, uint64_t seed) {
+  std::vector<double> sample_list{};
+  for(uint64_t i = 0;i < n;i++) {
+    double noise = (SimpleInt64Random<0, 1000>{}(i, seed) - 500.0) / 10000.0;
+    sample_list.push_back(center * (1.0 + noise));
+  }
+
+  return sample_list;
+}
+
+/*
+ * TestMannWhitney() - Tests U and p-values against known cases
+ */
+void TestMannWhitney() {
+  _PrintTestName();
+
+  // Every value of a is larger: U is the number of pairs
+  MannWhitneyTest larger{{6.0, 7.0, 8.0, 9.0, 10.0}, {1.0, 2.0, 3.0, 4.0}};
+  assert(larger.GetU() == 20.0);
+  assert(larger.GetPValueGreater() < 0.05);
+  assert(larger.GetPValueLess() > 0.95);
+
+  // Identical samples are all ties
+  MannWhitneyTest same{{1.0, 1.0, 1.0}, {1.0, 1.0, 1.0}};
+  assert(same.GetU() == 4.5);
+  assert(same.GetPValue() == 1.0);
+
+  // Two samples of the same distribution
+  MannWhitneyTest null{GetSampleList(100.0, 20, 1), GetSampleList(100.0, 20, 2)};
+  dbg_printf("Same distribution: U = %f; p = %f\n",
+             null.GetU(),
+             null.GetPValue());
+  assert(null.GetPValue() > 0.01);
+
+  // 3% apart with 5% noise is found with enough samples
+  MannWhitneyTest shifted{GetSampleList(97.0, 30, 1),
+                          GetSampleList(100.0, 30, 2)};
+  dbg_printf("3%% shift: U = %f; p = %f\n",
+             shifted.GetU(),
+             shifted.GetPValueLess());
+  assert(shifted.GetPValueLess() < 0.01);
+
+  (void)larger;
+  (void)same;
+  (void)null;
+  (void)shifted;
+
+  return;
+}
+
+/*
+ * TestResultStore() - Tests appending, loading and finding baselines
+ */
+void TestResultStore(const std::string &path) {
+  _PrintTestName();
+
+  remove(path.c_str());
+
+  ResultStore store{path};
+  assert(store.Load().size() == 0UL);
+
+  dbg_printf("Revision %s\n", ResultStore::GetGitRevision().c_str());
+  dbg_printf("Machine %s\n", ResultStore::GetMachineFingerprint().c_str());
+
+  store.Append(ResultRecord{"Insert", "threads=1", "rev1", "m1", 1UL,
+                            {1.0, 2.0, 0.1}, false});
+  store.Append(ResultRecord{"Insert", "threads=1", "rev2", "m1", 2UL, {3.0},
+                            false});
+  store.Append(ResultRecord{"Insert", "threads=1", "rev3", "m2", 3UL, {4.0},
+                            false});
+  store.Append(ResultRecord{"Insert\tx", "a\nb", "rev3", "m1", 4UL, {5.0},
+                            false});
+  store.Append(ResultRecord{"Insert", "threads=1", "rev4", "m1", 5UL, {0.5},
+                            true});
+
+  // A line without the pass field passes; a line cut short is skipped
+  FILE *fp = fopen(path.c_str(), "a");
+  fprintf(fp, "Old\t\trev0\tm1\t0\t1.5\n");
+  fprintf(fp, "Insert\tthreads=1\trev5\tm1\t6\t");
+  fclose(fp);
+
+  std::vector<ResultRecord> record_list = store.Load();
+  assert(record_list.size() == 6UL);
+  assert(record_list[0].sample_list.size() == 3UL);
+  assert(record_list[0].sample_list[2] == 0.1);
+  assert(record_list[3].name == "Insert x");
+  assert(record_list[3].params == "a b");
+  assert(record_list[4].regression_flag == true);
+  assert(record_list[5].name == "Old");
+  assert(record_list[5].regression_flag == false);
+
+  ResultRecord record{};
+  assert(store.FindBaseline("Insert", "threads=1", "m1", "rev3", &record) == \
+         true);
+  assert(record.git_rev == "rev2");
+
+  // The current revision is not its own baseline
+  assert(store.FindBaseline("Insert", "threads=1", "m1", "rev2", &record) == \
+         true);
+  assert(record.git_rev == "rev1");
+
+  // A regression is never a baseline
+  assert(store.FindBaseline("Insert", "threads=1", "m1", "rev5", &record) == \
+         true);
+  assert(record.git_rev == "rev2");
+  assert(store.FindBaseline("Insert", "threads=1", "m1", "rev5", &record,
+                            "rev4") == false);
+
+  // An explicit baseline revision
+  assert(store.FindBaseline("Insert", "threads=1", "m1", "rev5", &record,
+                            "rev1") == true);
+  assert(record.git_rev == "rev1");
+
+  // Other machines are not compared
+  assert(store.FindBaseline("Insert", "threads=1", "m3", "rev3", &record) == \
+         false);
+  assert(store.FindBaseline("Insert", "threads=2", "m1", "rev3", &record) == \
+         false);
+
+  remove(path.c_str());
+
+  return;
+}
+
+/*
+ * TestRegressionGate() - Tests that only large and significant slowdowns
+ *                        fail the gate
+ */
+void TestRegressionGate(const std::string &path) {
+  _PrintTestName();
+
+  remove(path.c_str());
+
+  ResultStore store{path};
+
+  RegressionGate base_gate{&store, 0.05, 0.01};
+  base_gate.SetGitRevision("base");
+  assert(base_gate.Check("Throughput", "", GetSampleList(100.0, 20, 1)).\
+         baseline_rev.empty() == true);
+  base_gate.Check("Throughput", "small", GetSampleList(100.0, 20, 1));
+  base_gate.Check("Latency", "", GetSampleList(10.0, 20, 1), false);
+  base_gate.Check("Noisy", "", {100.0, 50.0, 150.0});
+  base_gate.Print();
+  assert(base_gate.GetExitCode() == 0);
+
+  RegressionGate gate{&store, 0.05, 0.01};
+  gate.SetGitRevision("change");
+
+  // 20% slower throughput
+  RegressionGate::Result slower = \
+    gate.Check("Throughput", "", GetSampleList(80.0, 20, 2));
+  assert(slower.baseline_rev == "base");
+  assert(slower.change < -0.15);
+  assert(slower.regression_flag == true);
+
+  // 3% slower is significant but below the threshold
+  assert(gate.Check("Throughput", "small", GetSampleList(98.0, 20, 2)).\
+         regression_flag == false);
+
+  // Lower latency is an improvement
+  RegressionGate::Result faster = \
+    gate.Check("Latency", "", GetSampleList(8.0, 20, 2), false);
+  assert(faster.change > 0.15);
+  assert(faster.regression_flag == false);
+
+  // 20% slower but too few and too noisy samples to tell
+  assert(gate.Check("Noisy", "", {80.0, 40.0, 120.0}).regression_flag == false);
+
+  // No baseline
+  assert(gate.Check("New", "", {1.0}).regression_flag == false);
+
+  gate.Print();
+  assert(gate.GetRegressionNum() == 1UL);
+  assert(gate.GetExitCode() == 1);
+
+  // The change is now stored, but only its passing results are baselines
+  // of a later run
+  assert(store.Load().size() == 9UL);
+  RegressionGate next_gate{&store, 0.05, 0.01};
+  next_gate.SetGitRevision("next");
+  RegressionGate::Result next = \
+    next_gate.Check("Throughput", "", GetSampleList(80.0, 20, 3));
+  assert(next.baseline_rev == "base");
+  assert(next.regression_flag == true);
+  assert(next_gate.Check("Throughput", "small", GetSampleList(98.0, 20, 3)).\
+         baseline_rev == "change");
+
+  // The baseline pinned to one revision
+  RegressionGate pinned_gate{&store, 0.05, 0.01};
+  pinned_gate.SetGitRevision("pinned");
+  pinned_gate.SetBaselineRevision("base");
+  assert(pinned_gate.Check("Throughput", "small", GetSampleList(98.0, 20, 4)).\
+         baseline_rev == "base");
+  pinned_gate.SetBaselineRevision("missing");
+  assert(pinned_gate.Check("Latency", "", GetSampleList(10.0, 20, 4), false).\
+         baseline_rev.empty() == true);
+  assert(pinned_gate.GetExitCode() == 0);
+
+  (void)slower;
+  (void)faster;
+  (void)next;
+
+  remove(path.c_str());
+
+  return;
+}
+
+/*
+ * TestUnknownRevision() - Tests whether runs without a known revision are
+ *                         still compared with each other
+ */
+void TestUnknownRevision(const std::string &path) {
+  _PrintTestName();
+
+  remove(path.c_str());
+
+  ResultStore store{path};
+
+  RegressionGate first_gate{&store, 0.05, 0.01};
+  first_gate.SetGitRevision("unknown");
+  assert(first_gate.Check("Throughput", "", GetSampleList(100.0, 20, 1)).\
+         baseline_rev.empty() == true);
+
+  // Every run is recorded as "unknown", so the newest passing record is the
+  // baseline even though it has the same revision
+  RegressionGate second_gate{&store, 0.05, 0.01};
+  second_gate.SetGitRevision("unknown");
+  RegressionGate::Result slower = \
+    second_gate.Check("Throughput", "", GetSampleList(80.0, 20, 2));
+  assert(slower.baseline_rev == "unknown");
+  assert(slower.regression_flag == true);
+  assert(second_gate.GetExitCode() == 1);
+
+  // The failed run is not a baseline, so the next one is compared with the
+  // first
+  RegressionGate third_gate{&store, 0.05, 0.01};
+  third_gate.SetGitRevision("unknown");
+  RegressionGate::Result same = \
+    third_gate.Check("Throughput", "", GetSampleList(100.0, 20, 3));
+  assert(same.baseline_rev == "unknown");
+  assert(same.baseline_median == TrialStats::GetMedian(
+           GetSampleList(100.0, 20, 1)));
+  assert(same.regression_flag == false);
+
+  (void)slower;
+  (void)same;
+
+  remove(path.c_str());
+
+  return;
+}
+
+int main() {
+  TestMannWhitney();
+  TestResultStore("result_store_test.tsv");
+  TestRegressionGate("result_store_test.tsv");
+  TestUnknownRevision("result_store_test.tsv");
+
+  return 0;
+}
@@ -0,0 +1,63 @@
+
+/*
+ * scaling_sweep_test.cpp - Tests thread scaling sweep and its line chart
+ */
+
+#include "scaling_sweep.h"
+
+/*
+ * TestDefaultThreadNumList() - Tests default thread counts
+ */
+void TestDefaultThreadNumList() {
+  _PrintTestName();
+
+  std::vector<uint64_t> expected{1, 2, 4, 8, 16, 20};
+  assert(ScalingSweep::GetDefaultThreadNumList(20) == expected);
+
+  expected = std::vector<uint64_t>{1, 2, 4, 8};
+  assert(ScalingSweep::GetDefaultThreadNumList(8) == expected);
+
+  expected = std::vector<uint64_t>{1};
+  assert(ScalingSweep::GetDefaultThreadNumList(1) == expected);
+
+  return;
+}
+
+/*
+ * TestScalingSweep() - Tests whether the chart gets exactly the numbers
+ *                      from the run
+ */
+void TestScalingSweep() {
+  _PrintTestName();
+
+  ScalingSweep sweep{3, {1, 2, 4}};
+
+  // A fake workload whose throughput is known
+  sweep.Run("Linear", [](uint64_t num_threads) {
+    return num_threads * 1e6;
+  });
+
+  sweep.RunForDuration("Hash", 0.05, [](uint64_t thread_id) {
+    static thread_local uint64_t value = 0UL;
+    value = SimpleInt64Random<>{}(value, thread_id);
+  });
+
+  sweep.Print();
+
+  assert(sweep.GetThroughput(0, 2) == 4e6);
+  assert(sweep.GetSampleList(1, 0).size() == 3UL);
+
+  LineChart lc{};
+  sweep.FillChart(&lc);
+  lc.SetLegendFlag(true);
+  lc.Draw("ScalingSweep.pdf");
+
+  return;
+}
+
+int main() {
+  TestDefaultThreadNumList();
+  TestScalingSweep();
+
+  return 0;
+}
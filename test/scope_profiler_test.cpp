@@ -0,0 +1,133 @@
+
+/*
+ * scope_profiler_test.cpp - Tests the hierarchical scope profiler
+ */
+
+#define USE_PROFILE_SCOPE
+#include "scope_profiler.h"
+
+/*
+ * Work() - Burns some cycles
+ */
+uint64_t Work(uint64_t n) {
+  uint64_t sum = 0UL;
+  for(uint64_t i = 0;i < n;i++) {
+    sum += SimpleInt64Random<>{}(i, n);
+  }
+
+  return sum;
+}
+
+/*
+ * Lookup() - A region called from two parents
+ */
+uint64_t Lookup(uint64_t n) {
+  PROFILE_SCOPE("Lookup");
+
+  return Work(n);
+}
+
+/*
+ * Insert() - A region with nested regions
+ */
+uint64_t Insert(uint64_t n) {
+  PROFILE_SCOPE("Insert");
+
+  uint64_t sum = Lookup(n);
+  if(n % 2 == 0) {
+    PROFILE_SCOPE("Split");
+    sum += Work(n * 4);
+  }
+
+  return sum + Work(n);
+}
+
+/*
+ * TestScopeProfiler() - Tests calls and nesting on several threads
+ */
+void TestScopeProfiler(uint64_t num_threads) {
+  _PrintTestName();
+
+  static constexpr uint64_t OP_NUM = 1000UL;
+
+  ScopeProfiler::Reset();
+
+  std::vector<uint64_t> sum_list(num_threads, 0UL);
+  StartThreads(num_threads, [&sum_list](uint64_t thread_id) {
+    PROFILE_SCOPE("Worker");
+    for(uint64_t i = 0;i < OP_NUM;i++) {
+      sum_list[thread_id] += Insert(i % 16 + 16);
+      sum_list[thread_id] += Lookup(16);
+    }
+  });
+
+  ScopeProfiler::Print();
+
+  assert(ScopeProfiler::GetThreadNum() >= 1UL);
+
+  std::pair<uint64_t, uint64_t> worker = ScopeProfiler::GetTotal({"Worker"});
+  std::pair<uint64_t, uint64_t> insert = \
+    ScopeProfiler::GetTotal({"Worker", "Insert"});
+  std::pair<uint64_t, uint64_t> split = \
+    ScopeProfiler::GetTotal({"Worker", "Insert", "Split"});
+  std::pair<uint64_t, uint64_t> nested_lookup = \
+    ScopeProfiler::GetTotal({"Worker", "Insert", "Lookup"});
+  std::pair<uint64_t, uint64_t> lookup = \
+    ScopeProfiler::GetTotal({"Worker", "Lookup"});
+
+  assert(worker.first == num_threads);
+  assert(insert.first == num_threads * OP_NUM);
+  assert(split.first == num_threads * OP_NUM / 2);
+  assert(nested_lookup.first == num_threads * OP_NUM);
+  assert(lookup.first == num_threads * OP_NUM);
+
+  // Children are inside their parents
+  assert(insert.second + lookup.second <= worker.second);
+  assert(split.second + nested_lookup.second <= insert.second);
+
+  assert(ScopeProfiler::GetTotal({"Insert"}).first == 0UL);
+  assert(ScopeProfiler::GetTotal({"Worker", "Missing"}).first == 0UL);
+
+  (void)worker;
+  (void)insert;
+  (void)split;
+  (void)nested_lookup;
+  (void)lookup;
+
+  return;
+}
+
+/*
+ * BenchmarkScopeCost() - Prints the cost of an empty scope
+ */
+void BenchmarkScopeCost() {
+  _PrintTestName();
+
+  static constexpr uint64_t ITER_NUM = 1000000UL;
+
+  ScopeProfiler::Reset();
+
+  CycleTimer timer{true};
+  {
+    PROFILE_SCOPE("Outer");
+    for(uint64_t i = 0;i < ITER_NUM;i++) {
+      PROFILE_SCOPE("Empty");
+    }
+  }
+
+  timer.Stop();
+
+  assert(ScopeProfiler::GetTotal({"Outer", "Empty"}).first == ITER_NUM);
+  dbg_printf("%.1f ns per scope\n", timer.GetNs() / ITER_NUM);
+
+  return;
+}
+
+int main() {
+  PrintRunHeader();
+  TestScopeProfiler(1);
+  TestScopeProfiler(GetCoreNum() * 2);
+  BenchmarkScopeCost();
+
+  return 0;
+}
@@ -0,0 +1,215 @@
+
+/*
+ * sync_primitives_test.cpp - Tests and benchmarks barriers and latches
+ */
+
+#include "test_suite.h"
+
+/*
+ * CheckBarrier() - Runs rounds of a barrier and checks that no thread gets
+ *                  more than one round ahead of the others
+ *
+ * wait_fn is called as wait_fn(thread_id) and must return true for exactly
+ * one thread per round
+ */
+template <typename WaitFn>
+void CheckBarrier(uint64_t num_threads, WaitFn &&wait_fn) {
+  static constexpr uint64_t ROUND_NUM = 1000UL;
+
+  std::vector<std::atomic<uint64_t>> round_list(num_threads);
+  for(std::atomic<uint64_t> &round : round_list) {
+    round.store(0UL);
+  }
+
+  std::atomic<uint64_t> elected_num{0UL};
+
+  StartThreads(num_threads, [&](uint64_t thread_id) {
+    for(uint64_t round = 0;round < ROUND_NUM;round++) {
+      round_list[thread_id].store(round + 1UL);
+      if(wait_fn(thread_id) == true) {
+        elected_num.fetch_add(1UL);
+      }
+
+      for(const std::atomic<uint64_t> &other : round_list) {
+        uint64_t other_round = other.load();
+        assert(other_round >= round + 1UL && other_round <= round + 2UL);
+        (void)other_round;
+      }
+    }
+  });
+
+  assert(elected_num.load() == ROUND_NUM);
+
+  return;
+}
+
+/*
+ * TestBarriers() - Tests all barriers
+ */
+void TestBarriers(uint64_t num_threads) {
+  _PrintTestName();
+
+  SpinBarrier spin_barrier{num_threads};
+  CheckBarrier(num_threads, [&](uint64_t) {
+    return spin_barrier.Wait();
+  });
+
+  // Local sense of each thread
+  PaddedArray<bool> sense_list{num_threads};
+
+  SenseReversingBarrier sense_barrier{num_threads};
+  CheckBarrier(num_threads, [&](uint64_t thread_id) {
+    return sense_barrier.Wait(&sense_list[thread_id]);
+  });
+
+  for(uint64_t fan_in : {2UL, 4UL}) {
+    PaddedArray<bool> tree_sense_list{num_threads};
+    CombiningTreeBarrier tree_barrier{num_threads, fan_in};
+    CheckBarrier(num_threads, [&](uint64_t thread_id) {
+      return tree_barrier.Wait(thread_id, &tree_sense_list[thread_id]);
+    });
+  }
+
+  return;
+}
+
+/*
+ * TestCombiningTreeShape() - Tests the number of nodes
+ */
+void TestCombiningTreeShape() {
+  _PrintTestName();
+
+  assert(CombiningTreeBarrier(1, 4).GetNodeNum() == 1UL);
+  assert(CombiningTreeBarrier(4, 4).GetNodeNum() == 1UL);
+  // 5 leaves, 2 inner nodes and the root
+  assert(CombiningTreeBarrier(17, 4).GetNodeNum() == 8UL);
+  assert(CombiningTreeBarrier(64, 4).GetNodeNum() == 21UL);
+
+  return;
+}
+
+/*
+ * TestCountdownLatch() - Tests waiters that spin and waiters that sleep
+ */
+void TestCountdownLatch(uint64_t num_threads) {
+  _PrintTestName();
+
+  for(uint64_t spin_count : {FutexWord::DEFAULT_SPIN_COUNT, 0UL}) {
+    CountdownLatch latch{num_threads};
+    std::atomic<uint64_t> counted_num{0UL};
+
+    // Half of the threads count down after a while; the rest only wait
+    StartThreads(num_threads * 2, [&](uint64_t thread_id) {
+      if(thread_id < num_threads) {
+        SleepFor(1);
+        counted_num.fetch_add(1UL);
+        latch.CountDown();
+      } else {
+        latch.Wait(spin_count);
+        assert(counted_num.load() == num_threads);
+        assert(latch.TryWait() == true);
+      }
+    });
+  }
+
+  CountdownLatch zero_latch{0};
+  assert(zero_latch.TryWait() == true);
+  zero_latch.Wait();
+
+  return;
+}
+
+/*
+ * MeasureRoundTrip() - Returns the average time of one barrier round in
+ *                      nanoseconds
+ */
+template <typename WaitFn>
+double MeasureRoundTrip(uint64_t num_threads,
+                        uint64_t round_num,
+                        WaitFn &&wait_fn) {
+  LaunchReport report = \
+    StartThreadsSynchronized(num_threads, [&](uint64_t thread_id) {
+      for(uint64_t round = 0;round < round_num;round++) {
+        wait_fn(thread_id, round);
+      }
+    });
+
+  return report.GetTotalInterval() * 1e9 / round_num;
+}
+
+/*
+ * BenchmarkBarriers() - Prints barrier round-trip latency from 2 to
+ *                       GetCoreNum() threads
+ */
+void BenchmarkBarriers() {
+  _PrintTestName();
+
+  static constexpr uint64_t ROUND_NUM = 10000UL;
+
+  uint64_t max_thread_num = std::max<uint64_t>(GetCoreNum(), 2UL);
+  std::vector<uint64_t> thread_num_list{};
+  for(uint64_t num_threads = 2;num_threads < max_thread_num;num_threads *= 2) {
+    thread_num_list.push_back(num_threads);
+  }
+
+  thread_num_list.push_back(max_thread_num);
+
+  for(uint64_t num_threads : thread_num_list) {
+    SpinBarrier spin_barrier{num_threads};
+    double spin = MeasureRoundTrip(num_threads, ROUND_NUM,
+                                   [&](uint64_t, uint64_t) {
+      spin_barrier.Wait();
+    });
+
+    PaddedArray<bool> sense_list{num_threads};
+    SenseReversingBarrier sense_barrier{num_threads};
+    double sense = MeasureRoundTrip(num_threads, ROUND_NUM,
+                                    [&](uint64_t thread_id, uint64_t) {
+      sense_barrier.Wait(&sense_list[thread_id]);
+    });
+
+    PaddedArray<bool> tree_sense_list{num_threads};
+    CombiningTreeBarrier tree_barrier{num_threads};
+    double tree = MeasureRoundTrip(num_threads, ROUND_NUM,
+                                   [&](uint64_t thread_id, uint64_t) {
+      tree_barrier.Wait(thread_id, &tree_sense_list[thread_id]);
+    });
+
+    // One single-use latch per round, where every thread counts down once
+    // and then waits
+    std::vector<std::unique_ptr<CountdownLatch>> latch_list{};
+    for(uint64_t round = 0;round < ROUND_NUM;round++) {
+      latch_list.emplace_back(new CountdownLatch{num_threads});
+    }
+
+    double latch = MeasureRoundTrip(num_threads, ROUND_NUM,
+                                    [&](uint64_t, uint64_t round) {
+      latch_list[round]->CountDown();
+      latch_list[round]->Wait();
+    });
+
+    dbg_printf("%lu threads: SpinBarrier %.1f ns; "
+               "SenseReversingBarrier %.1f ns; "
+               "CombiningTreeBarrier %.1f ns; "
+               "CountdownLatch %.1f ns\n",
+               num_threads,
+               spin,
+               sense,
+               tree,
+               latch);
+  }
+
+  return;
+}
+
+int main() {
+  TestCombiningTreeShape();
+  TestBarriers(2);
+  TestBarriers(GetCoreNum());
+  TestBarriers(GetCoreNum() * 2 + 1);
+  TestCountdownLatch(GetCoreNum());
+  TestCountdownLatch(GetCoreNum() * 2);
+  BenchmarkBarriers();
+
+  return 0;
+}
@@ -0,0 +1,308 @@
+
+/*
+ * thread_pool_test.cpp - Tests the persistent thread pool behind
+ *                        StartThreads()
+ */
+
+#include <sys/wait.h>
+
+#include "test_suite.h"
+
+/*
+ * TestThreadPoolBasic() - Tests whether every thread ID is executed exactly
+ *                         once in each run
+ */
+void TestThreadPoolBasic(uint64_t num_threads) {
+  _PrintTestName();
+
+  std::vector<uint64_t> count_list{};
+  count_list.resize(num_threads, 0UL);
+
+  // Each worker only writes its own element
+  auto fn = [&count_list](uint64_t thread_id, uint64_t delta) {
+    count_list[thread_id] += delta;
+  };
+
+  for(int i = 0;i < 100;i++) {
+    StartThreads(num_threads, fn, 1UL);
+  }
+
+  for(uint64_t i = 0;i < num_threads;i++) {
+    assert(count_list[i] == 100UL);
+  }
+
+  // Runs with fewer threads should not wake up the others
+  StartThreads(1, fn, 1UL);
+  assert(count_list[0] == 101UL);
+  for(uint64_t i = 1;i < num_threads;i++) {
+    assert(count_list[i] == 100UL);
+  }
+
+  dbg_printf("Pool size = %lu\n", ThreadPool::GetDefault().GetThreadNum());
+
+  return;
+}
+
+/*
+ * TestThreadPoolNested() - Tests whether StartThreads() could be called
+ *                          from inside a worker
+ */
+void TestThreadPoolNested() {
+  _PrintTestName();
+
+  std::atomic<uint64_t> counter{0UL};
+
+  StartThreads(2, [&counter](uint64_t) {
+    StartThreads(2, [&counter](uint64_t) {
+      counter.fetch_add(1UL);
+    });
+  });
+
+  assert(counter.load() == 4UL);
+
+  return;
+}
+
+/*
+ * class CallCounter - Functor that counts its own calls
+ */
+class CallCounter {
+ public:
+  uint64_t call_num;
+  std::vector<uint64_t> *result_list_p;
+
+  CallCounter(std::vector<uint64_t> *p_result_list_p) :
+    call_num{0UL},
+    result_list_p{p_result_list_p} {
+    return;
+  }
+
+  void operator()(uint64_t thread_id, uint64_t delta) {
+    call_num += delta;
+    (*result_list_p)[thread_id] = call_num;
+
+    return;
+  }
+};
+
+/*
+ * TestThreadPoolCopy() - Tests whether each worker calls its own copy of
+ *                        the functor and the arguments, pooled or not
+ */
+void TestThreadPoolCopy(uint64_t num_threads) {
+  _PrintTestName();
+
+  std::vector<uint64_t> result_list(num_threads, 0UL);
+  CallCounter counter{&result_list};
+
+  for(int i = 0;i < 3;i++) {
+    StartThreads(num_threads, counter, 1UL);
+    for(uint64_t value : result_list) {
+      assert(value == 1UL);
+      (void)value;
+    }
+  }
+
+  // The fallback copies the same way
+  std::fill(result_list.begin(), result_list.end(), 0UL);
+  StartThreads(1, [&](uint64_t) {
+    StartThreads(num_threads, counter, 1UL);
+  });
+
+  for(uint64_t value : result_list) {
+    assert(value == 1UL);
+    (void)value;
+  }
+
+  // The caller's object is not touched
+  assert(counter.call_num == 0UL);
+
+  return;
+}
+
+/*
+ * TestThreadPoolExit() - Tests whether exit() from a worker during a run
+ *                        ends the process instead of hanging in the
+ *                        destructor of the pool
+ */
+void TestThreadPoolExit() {
+  _PrintTestName();
+
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if(pid == 0) {
+    // The default pool belongs to the parent. This one is destroyed at
+    // exit() in the same way; a hang is killed by the alarm
+    alarm(10);
+    static ThreadPool pool{};
+    pool.Run(2, [](uint64_t thread_id) {
+      if(thread_id == 1UL) {
+        exit(3);
+      }
+    });
+
+    _exit(0);
+  }
+
+  int status = 0;
+  waitpid(pid, &status, 0);
+  dbg_printf("Child status 0x%x\n", status);
+  assert(WIFEXITED(status) != 0 && WEXITSTATUS(status) == 3);
+
+  return;
+}
+
+/*
+ * TestThreadPoolLatency() - Compares the cost of starting empty runs on the
+ *                           pool and on freshly created threads
+ */
+void TestThreadPoolLatency(uint64_t num_threads) {
+  _PrintTestName();
+
+  static constexpr int ITERATION = 1000;
+  auto fn = [](uint64_t) {};
+
+  Timer timer{true};
+  for(int i = 0;i < ITERATION;i++) {
+    ThreadPool::RunUnpooled(num_threads, fn);
+  }
+
+  double unpooled = timer.Stop();
+
+  timer.Start();
+  for(int i = 0;i < ITERATION;i++) {
+    StartThreads(num_threads, fn);
+  }
+
+  double pooled = timer.Stop();
+
+  dbg_printf("%lu threads: unpooled %.3f us/run; pooled %.3f us/run\n",
+             num_threads,
+             unpooled * 1000000.0 / ITERATION,
+             pooled * 1000000.0 / ITERATION);
+
+  return;
+}
+
+/*
+ * TestDefaultPlacement() - Tests that workers only run on cores the process
+ *                          is allowed to use
+ */
+void TestDefaultPlacement(uint64_t num_threads) {
+  _PrintTestName();
+
+  std::vector<int> allowed_list = GetAllowedCoreList();
+  assert(allowed_list.size() > 0UL);
+  dbg_printf("%lu of %lu cores allowed\n", allowed_list.size(), GetCoreNum());
+
+  std::vector<int> core_list(num_threads, -1);
+  StartThreads(num_threads, [&core_list](uint64_t thread_id) {
+    core_list[thread_id] = GetThreadAffinity();
+  });
+
+  for(int core_id : core_list) {
+    assert(std::find(allowed_list.begin(), allowed_list.end(), core_id) != \
+           allowed_list.end());
+    (void)core_id;
+  }
+
+  // Cores that could not be used are reported instead of aborting
+  assert(PinToCore(CPU_SETSIZE) == false);
+
+  return;
+}
+
+/*
+ * TestUnpinnedReport() - Tests whether placements that could not be applied
+ *                        are counted, both by the pool and the fallback
+ */
+void TestUnpinnedReport() {
+  _PrintTestName();
+
+  std::vector<int> core_list{GetAllowedCoreList()[0], CPU_SETSIZE};
+  std::atomic<uint64_t> counter{0UL};
+
+  ThreadPool pool{};
+  uint64_t unpinned_num = \
+    pool.RunOnCores(core_list, [&counter](uint64_t) {
+      counter.fetch_add(1UL);
+    });
+  assert(unpinned_num == 1UL);
+  assert(counter.load() == 2UL);
+
+  // The count is per run, not accumulated over the life of the pool
+  unpinned_num = pool.RunOnCores(std::vector<int>{core_list[0]}, 
+                                 [&counter](uint64_t) {
+    counter.fetch_add(1UL);
+  });
+  assert(unpinned_num == 0UL);
+  assert(counter.load() == 3UL);
+
+  unpinned_num = \
+    ThreadPool::RunUnpooledOnCores(core_list, [&counter](uint64_t) {
+      counter.fetch_add(1UL);
+    });
+  assert(unpinned_num == 1UL);
+  assert(counter.load() == 5UL);
+  (void)unpinned_num;
+
+  return;
+}
+
+/*
+ * TestStartThreadsSynchronized() - Tests barrier launch and skew report
+ */
+void TestStartThreadsSynchronized(uint64_t num_threads) {
+  _PrintTestName();
+
+  static constexpr uint64_t OP_COUNT = 1000000UL;
+  std::vector<uint64_t> result_list{};
+  result_list.resize(num_threads, 0UL);
+  ThreadCounterArray counter_array{num_threads};
+
+  LaunchReport report = \
+    StartThreadsSynchronized(&counter_array, [&](uint64_t thread_id) {
+      uint64_t sum = 0UL;
+      for(uint64_t i = 0;i < OP_COUNT;i++) {
+        sum += SimpleInt64Random<>{}(i, thread_id);
+        counter_array.Add(thread_id);
+      }
+
+      result_list[thread_id] = sum;
+    });
+
+  assert(report.GetThreadNum() == num_threads);
+  assert(report.GetOverlapInterval() <= report.GetTotalInterval());
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    assert(report.GetFinishList()[thread_id] >= 
+           report.GetStartList()[thread_id]);
+    assert(report.GetOverlapOpList()[thread_id] <= OP_COUNT);
+  }
+
+  report.Print();
+  dbg_printf("Overlap throughput = %f MOps/sec\n",
+             report.GetOverlapThroughput() / 1e6);
+
+  // Without counters there is nothing counted in the window
+  LaunchReport uncounted = \
+    StartThreadsSynchronized(num_threads, [](uint64_t) {});
+  assert(uncounted.GetOverlapThroughput() == 0.0);
+  (void)uncounted;
+
+  return;
+}
+
+int main() {
+  TestThreadPoolBasic(GetCoreNum());
+  TestThreadPoolBasic(GetCoreNum() * 2);
+  TestThreadPoolNested();
+  TestThreadPoolCopy(GetCoreNum() * 2);
+  TestThreadPoolExit();
+  TestThreadPoolLatency(GetCoreNum());
+  TestDefaultPlacement(GetCoreNum() * 2);
+  TestUnpinnedReport();
+  TestStartThreadsSynchronized(GetCoreNum());
+  TestStartThreadsSynchronized(GetCoreNum() * 2);
+
+  return 0;
+}
@@ -0,0 +1,122 @@
+
+/*
+ * throughput_sampler_test.cpp - Tests throughput time series
+ */
+
+#include "throughput_sampler.h"
+
+/*
+ * TestThroughputSampler() - Tests samples, dumps and the chart
+ */
+void TestThroughputSampler(uint64_t num_threads) {
+  _PrintTestName();
+
+  std::vector<uint64_t> sum_list(num_threads, 0UL);
+  ThroughputSampler sampler{num_threads, 1.0};
+
+  ThroughputReport report = \
+    sampler.RunForDuration(0.2, [&sum_list](uint64_t thread_id) {
+      sum_list[thread_id] += \
+        SimpleInt64Random<>{}(sum_list[thread_id], thread_id);
+    });
+
+  report.Print();
+  sampler.Print();
+
+  // At least half of the expected samples on a loaded machine
+  assert(sampler.GetSampleNum() > 100UL);
+  assert(sampler.GetDroppedNum() == 0UL);
+  assert(sampler.GetTotal(sampler.GetSampleNum() - 1) ==
+         report.GetTotalOps());
+
+  for(uint64_t i = 1;i < sampler.GetSampleNum();i++) {
+    assert(sampler.GetTimestamp(i) >= sampler.GetTimestamp(i - 1));
+    assert(sampler.GetTotal(i) >= sampler.GetTotal(i - 1));
+  }
+
+  assert(sampler.DumpCSV("ThroughputSampler.csv") == true);
+  assert(sampler.DumpBinary("ThroughputSampler.bin") == true);
+
+  // Check the binary header
+  FILE *fp = fopen("ThroughputSampler.bin", "rb");
+  uint64_t header[3];
+  size_t ret = fread(header, sizeof(header), 1, fp);
+  fclose(fp);
+  assert(ret == 1UL);
+  assert(header[0] == ThroughputSampler::BINARY_MAGIC);
+  assert(header[2] == sampler.GetSampleNum());
+  (void)ret;
+
+  LineChart lc{};
+  sampler.FillChart(&lc, "Hash", 50UL);
+  assert(lc.GetXValueCount() <= 50UL);
+  lc.Draw("ThroughputSampler.pdf");
+
+  return;
+}
+
+/*
+ * TestRingOverwrite() - Tests whether old samples are dropped when the ring
+ *                       is full
+ */
+void TestRingOverwrite() {
+  _PrintTestName();
+
+  ThroughputSampler sampler{1, 0.5, 16};
+  sampler.StartThreads([&sampler](uint64_t thread_id) {
+    for(uint64_t i = 0;i < 50;i++) {
+      sampler.Add(thread_id, 10UL);
+      SleepFor(1);
+    }
+  });
+
+  sampler.Print();
+
+  assert(sampler.GetSampleNum() == 16UL);
+  assert(sampler.GetDroppedNum() > 0UL);
+  assert(sampler.GetTotal(15) == 500UL);
+  assert(sampler.GetTimestamp(0) > 0UL);
+
+  return;
+}
+
+/*
+ * TestSamplerOverhead() - Compares throughput with and without sampling
+ *                         at 1 ms interval
+ */
+void TestSamplerOverhead(uint64_t num_threads) {
+  _PrintTestName();
+
+  static constexpr double SECONDS = 0.5;
+  std::vector<uint64_t> sum_list(num_threads, 0UL);
+  auto op_fn = [&sum_list](uint64_t thread_id) {
+    sum_list[thread_id] += \
+      SimpleInt64Random<>{}(sum_list[thread_id], thread_id);
+  };
+
+  // The first run also spawns pool threads
+  RunForDuration(num_threads, 0.05, op_fn);
+  double base = RunForDuration(num_threads, SECONDS, op_fn).GetThroughput();
+
+  ThroughputSampler sampler{num_threads, 1.0};
+  double sampled = sampler.RunForDuration(SECONDS, op_fn).GetThroughput();
+
+  dbg_printf("%lu threads: %f MOps/sec without sampler, %f with sampler "
+             "(overhead %.2f%%)\n",
+             num_threads,
+             base / 1e6,
+             sampled / 1e6,
+             (base - sampled) / base * 100.0);
+
+  return;
+}
+
+int main() {
+  TestThroughputSampler(GetCoreNum());
+  TestThroughputSampler(GetCoreNum() * 2);
+  TestRingOverwrite();
+  TestSamplerOverhead(GetCoreNum());
+  TestSamplerOverhead(64);
+
+  return 0;
+}
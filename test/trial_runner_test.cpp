@@ -0,0 +1,170 @@
+
+/*
+ * trial_runner_test.cpp - Tests repeated-trial statistics and error bars
+ */
+
+#include "trial_runner.h"
+#include "bench_driver.h"
+
+/*
+ * TestTrialStats() - Tests statistics of known samples
+ */
+void TestTrialStats() {
+  _PrintTestName();
+
+  TrialStats stats{{4.0, 1.0, 3.0, 2.0, 5.0}};
+  stats.Print("1 to 5");
+
+  assert(stats.GetSampleNum() == 5UL);
+  assert(stats.GetMean() == 3.0);
+  assert(stats.GetMedian() == 3.0);
+  assert(std::abs(stats.GetStddev() - std::sqrt(2.5)) < 1e-12);
+  assert(stats.GetMin() == 1.0);
+  assert(stats.GetMax() == 5.0);
+
+  std::pair<double, double> ci = stats.GetConfidenceInterval();
+  assert(ci.first < 3.0 && ci.second > 3.0);
+  assert(ci.first >= 1.0 && ci.second <= 5.0);
+
+  // Deterministic
+  assert(TrialStats({4.0, 1.0, 3.0, 2.0, 5.0}).GetConfidenceInterval() == ci);
+
+  // A single sample has no spread
+  TrialStats single{{7.0}};
+  assert(single.GetStddev() == 0.0);
+  assert(single.GetConfidenceInterval() == std::make_pair(7.0, 7.0));
+
+  // More samples from the same distribution give a narrower interval
+  std::vector<double> small_list{};
+  std::vector<double> large_list{};
+  for(uint64_t i = 0;i < 400;i++) {
+    double value = static_cast<double>(SimpleInt64Random<0, 1000>{}(i, 0));
+    if(i < 20) {
+      small_list.push_back(value);
+    }
+
+    large_list.push_back(value);
+  }
+
+  std::pair<double, double> small_ci = \
+    TrialStats{small_list}.GetConfidenceInterval();
+  std::pair<double, double> large_ci = \
+    TrialStats{large_list}.GetConfidenceInterval();
+  assert(large_ci.second - large_ci.first < small_ci.second - small_ci.first);
+
+  // Even sample count
+  assert(TrialStats::GetMedian({1.0, 2.0, 3.0, 10.0}) == 2.5);
+
+  (void)ci;
+  (void)small_ci;
+  (void)large_ci;
+
+  return;
+}
+
+/*
+ * TestTrialRunner() - Tests trial order and chart filling
+ */
+void TestTrialRunner(bool interleave_flag) {
+  _PrintTestName();
+
+  // Configuration i returns 10 * (i + 1) plus 0, 1 or 2
+  std::vector<std::string> order{};
+  TrialRunner runner{3, interleave_flag};
+  double base = 10.0;
+  for(const char *group : {"A", "B"}) {
+    for(const char *bar : {"x", "y"}) {
+      std::string name = std::string{group} + bar;
+      runner.AddTrial(group, bar, [&order, name, base]() {
+        order.push_back(name);
+        return base + order.size() % 3;
+      });
+
+      base += 10.0;
+    }
+  }
+
+  runner.Run();
+  runner.Print();
+
+  assert(order.size() == 12UL);
+  if(interleave_flag == true) {
+    assert(order[0] == "Ax" && order[1] == "Ay" && order[4] == "Ax");
+  } else {
+    assert(order[0] == "Ax" && order[1] == "Ax" && order[3] == "Ay");
+  }
+
+  assert((runner.GetGroupNameList() == std::vector<std::string>{"A", "B"}));
+  assert((runner.GetBarNameList() == std::vector<std::string>{"x", "y"}));
+  assert(runner.GetStats("B", "y").GetSampleNum() == 3UL);
+  assert(runner.GetStats("B", "y").GetMin() >= 40.0);
+
+  bool thrown = false;
+  try {
+    runner.GetStats("C", "x");
+  } catch(const char *) {
+    thrown = true;
+  }
+
+  assert(thrown == true);
+  (void)thrown;
+
+  for(TrialRunner::ErrorMode mode : {TrialRunner::ErrorMode::STDDEV,
+                                     TrialRunner::ErrorMode::CONFIDENCE_INTERVAL,
+                                     TrialRunner::ErrorMode::MIN_MAX}) {
+    BarChart bc{};
+    runner.FillChart(&bc, mode);
+    assert(bc.GetGroupCount() == 2UL);
+    assert(bc.GetBarNameCount() == 2UL);
+  }
+
+  return;
+}
+
+/*
+ * PlotTrialRunner() - Plots throughput of two workloads with bootstrap
+ *                     error bars
+ */
+void PlotTrialRunner(uint64_t num_threads) {
+  _PrintTestName();
+
+  std::vector<uint64_t> sum_list(num_threads, 0UL);
+  std::atomic<uint64_t> shared{0UL};
+
+  TrialRunner runner{5};
+  for(double seconds : {0.02, 0.05}) {
+    std::string group = std::to_string(static_cast<int>(seconds * 1000)) + \
+                        " ms";
+    runner.AddTrial(group, "Local", [&, seconds]() {
+      return RunForDuration(num_threads, seconds, [&](uint64_t thread_id) {
+        sum_list[thread_id] += \
+          SimpleInt64Random<>{}(sum_list[thread_id], thread_id);
+      }).GetThroughput() / 1e6;
+    });
+
+    runner.AddTrial(group, "Shared", [&, seconds]() {
+      return RunForDuration(num_threads, seconds, [&](uint64_t) {
+        shared.fetch_add(1UL);
+      }).GetThroughput() / 1e6;
+    });
+  }
+
+  runner.Run();
+  runner.Print();
+
+  BarChart bc{};
+  runner.FillChart(&bc, TrialRunner::ErrorMode::CONFIDENCE_INTERVAL);
+  bc.SetYAxisLabel("Throughput (MOps/Sec)");
+  bc.Draw("TrialRunner.pdf");
+
+  return;
+}
+
+int main() {
+  TestTrialStats();
+  TestTrialRunner(true);
+  TestTrialRunner(false);
+  PlotTrialRunner(GetCoreNum());
+
+  return 0;
+}
@@ -0,0 +1,148 @@
+
+/*
+ * work_stealing_test.cpp - Tests work-stealing deque and partitioned launch
+ */
+
+#include "work_stealing.h"
+
+/*
+ * TestChaseLevDeque() - Tests single threaded deque operations
+ */
+void TestChaseLevDeque() {
+  _PrintTestName();
+
+  ChaseLevDeque<uint64_t> deque{5};
+  for(uint64_t i = 0;i < 8;i++) {
+    bool ret = deque.Push(i);
+    assert(ret == true);
+    (void)ret;
+  }
+
+  // Rounded up to 8
+  assert(deque.Push(8UL) == false);
+  assert(deque.GetSize() == 8UL);
+
+  uint64_t item = 0UL;
+  assert(deque.Pop(&item) == true && item == 7UL);
+  assert(deque.Steal(&item) == ChaseLevDeque<uint64_t>::StealResult::SUCCESS);
+  assert(item == 0UL);
+
+  uint64_t count = 0UL;
+  while(deque.Pop(&item) == true) {
+    count++;
+  }
+
+  assert(count == 6UL);
+  assert(deque.Steal(&item) == ChaseLevDeque<uint64_t>::StealResult::EMPTY);
+
+  return;
+}
+
+/*
+ * TestConcurrentSteal() - Tests whether every item is taken exactly once
+ *                         while the owner pops and others steal
+ */
+void TestConcurrentSteal(uint64_t num_threads) {
+  _PrintTestName();
+
+  static constexpr uint64_t ITEM_NUM = 100000UL;
+  ChaseLevDeque<uint64_t> deque{ITEM_NUM};
+  std::vector<std::atomic<uint64_t>> taken_list(ITEM_NUM);
+  for(std::atomic<uint64_t> &taken : taken_list) {
+    taken.store(0UL);
+  }
+
+  for(uint64_t i = 0;i < ITEM_NUM;i++) {
+    deque.Push(i);
+  }
+
+  StartThreads(num_threads, [&](uint64_t thread_id) {
+    uint64_t item = 0UL;
+    if(thread_id == 0UL) {
+      while(deque.Pop(&item) == true) {
+        taken_list[item].fetch_add(1UL);
+      }
+
+      return;
+    }
+
+    while(true) {
+      ChaseLevDeque<uint64_t>::StealResult result = deque.Steal(&item);
+      if(result == ChaseLevDeque<uint64_t>::StealResult::SUCCESS) {
+        taken_list[item].fetch_add(1UL);
+      } else if(result == ChaseLevDeque<uint64_t>::StealResult::EMPTY) {
+        break;
+      }
+    }
+  });
+
+  for(const std::atomic<uint64_t> &taken : taken_list) {
+    assert(taken.load() == 1UL);
+    (void)taken;
+  }
+
+  return;
+}
+
+/*
+ * TestStartThreadsPartitioned() - Tests a skewed bulk load in both modes
+ *
+ * Keys in the first eighth of the range are 16 times as expensive, so the
+ * first thread is a straggler under static partitioning
+ */
+void TestStartThreadsPartitioned(uint64_t num_threads, PartitionMode mode) {
+  _PrintTestName();
+
+  static constexpr uint64_t KEY_NUM = 1UL << 16;
+  std::vector<uint64_t> value_list(KEY_NUM, 0UL);
+
+  PartitionReport report = \
+    StartThreadsPartitioned(mode, num_threads, KEY_NUM, 256,
+                            [&value_list](uint64_t thread_id,
+                                          uint64_t begin,
+                                          uint64_t end) {
+      for(uint64_t key = begin;key < end;key++) {
+        uint64_t round = (key < KEY_NUM / 8) ? 1024UL : 64UL;
+        uint64_t value = key;
+        for(uint64_t i = 0;i < round;i++) {
+          value = SimpleInt64Random<>{}(value, thread_id);
+        }
+
+        // Never 0 for any key
+        value_list[key] = value | 1UL;
+      }
+    });
+
+  report.Print();
+
+  uint64_t chunk_num = 0UL;
+  for(uint64_t thread_id = 0;thread_id < num_threads;thread_id++) {
+    chunk_num += report.GetChunkNum(thread_id);
+  }
+
+  assert(chunk_num == KEY_NUM / 256);
+  (void)chunk_num;
+
+  for(uint64_t value : value_list) {
+    assert(value != 0UL);
+    (void)value;
+  }
+
+  if(mode == PartitionMode::STATIC) {
+    assert(report.GetTotalStealNum() == 0UL);
+  }
+
+  return;
+}
+
+int main() {
+  TestChaseLevDeque();
+  TestConcurrentSteal(GetCoreNum());
+  TestConcurrentSteal(GetCoreNum() * 4);
+  TestStartThreadsPartitioned(GetCoreNum(), PartitionMode::STATIC);
+  TestStartThreadsPartitioned(GetCoreNum(), PartitionMode::WORK_STEALING);
+  TestStartThreadsPartitioned(GetCoreNum() * 4, PartitionMode::STATIC);
+  TestStartThreadsPartitioned(GetCoreNum() * 4, PartitionMode::WORK_STEALING);
+
+  return 0;
+}